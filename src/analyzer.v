@@ -1,12 +1,78 @@
 module main
 
 import os
+import sync
+import time
 import parsers
 
 pub struct Analyzer {
 pub mut:
-	parsers_map map[string]parsers.Parser
-	target_lang string
+	parsers_map   map[string]parsers.Parser
+	target_lang   string
+	jobs          int = 1 // number of worker threads used by analyze_directory
+	cache         &ResultCache = unsafe { nil } // optional on-disk cache, see cache.v
+	max_file_size u64  // files larger than this are skipped; 0 means no limit
+	count_lines   bool // count lines of every file read, for --stats
+	chunk_size    int = default_chunk_size // larger files are parsed in chunks of this size; 0 disables
+	chunk_jobs    int = 1 // threads parsing the chunks of large files, shared by all workers; see parse_chunked
+	chunk_slots   &sync.Semaphore = unsafe { nil } // chunk_jobs threads not in use, see take_chunk_threads
+	buffered      bool // the sink keeps every result anyway, so analyze_parallel need not bound its reorder buffer
+	// File list from git: used instead of the walk when use_file_list is
+	// set, see git.v
+	files         []string
+	use_file_list bool
+	// --shard, see shard.v: files whose relative path hashes to another
+	// shard are left to other runs
+	shard_index     int
+	shard_count     int = 1
+	shard_root      string
+	shard_positions []u32 // walk position of every emitted file
+	// --dedup and --collapse-duplicates, see dedup.v
+	contents    &ContentIndex = unsafe { nil } // shared by all workers
+	collapse    bool
+	first_paths map[u64]string // content key -> first file emitted with it; collecting thread only
+	// Stamps of every file the run saw, for serve to tell changed files
+	record_stamps bool
+	stamps        map[string]FileStamp // collecting thread only
+	// Walk filters, see ignore.v
+	excludes        IgnoreSet // --exclude
+	includes        IgnoreSet // --include
+	no_ignore_files bool      // --no-ignore: do not read .gitignore / .codeanalyzerignore
+mut:
+	lang_extensions map[string]bool   // set by set_language, see dispatch.v
+	rules           []parsers.RuleSet // custom languages from the config file
+	reader          FileReader        // per-analyzer read buffer, see reader.v
+}
+
+// FileJob is one unit of work handed to an analysis worker.
+struct FileJob {
+	index int
+	path  string
+	size  u64 // as found by the walk, for scheduling
+}
+
+// FileOutcome carries a worker's result back to the collecting thread.
+// `index` is the position of the file in the collected list, so results
+// can be put back in walk order regardless of completion order.
+struct FileOutcome {
+	index       int
+	path        string
+	result      parsers.ParseResult
+	err         string
+	skipped     string // reason the file was left out on purpose, see reader.v
+	language    string // parser extension chosen from the content, see detect.v; empty when the file extension decided
+	cached      bool   // result was served from the cache
+	foreign     bool   // the file belongs to another shard
+	duplicate   bool   // the elements were reused from a file with the same content
+	content_key u64    // see content_key; 0 when the content was not hashed
+	stamped     bool   // mtime and size are set, with the cache or record_stamps
+	mtime       i64
+	size        u64
+	// Measurements for --stats, see stats.v
+	read_ns  i64
+	parse_ns i64
+	bytes    u64
+	lines    int
 }
 
 pub fn new_analyzer() Analyzer {
@@ -15,165 +81,649 @@ pub fn new_analyzer() Analyzer {
 	return a
 }
 
-fn (mut a Analyzer) register_parsers() {
-	// Register all built-in parsers
-	python_parser := parsers.PythonParser{}
-	for ext in python_parser.get_extensions() {
-		a.parsers_map[ext] = python_parser
+// fork returns an analyzer with the same settings but its own parser
+// instances. Parsers cache compiled patterns that are mutated while
+// matching, so every worker thread analyzes through its own fork.
+fn (a &Analyzer) fork() Analyzer {
+	mut worker := Analyzer{
+		target_lang:     a.target_lang
+		cache:           a.cache
+		max_file_size:   a.max_file_size
+		count_lines:     a.count_lines
+		chunk_size:      a.chunk_size
+		chunk_jobs:      a.chunk_jobs
+		chunk_slots:     a.chunk_slots
+		shard_index:     a.shard_index
+		shard_count:     a.shard_count
+		shard_root:      a.shard_root
+		contents:        a.contents
+		record_stamps:   a.record_stamps
+		buffered:        a.buffered
+		rules:           a.rules
+		lang_extensions: a.lang_extensions.clone()
 	}
+	worker.register_parsers()
+	return worker
+}
+
+// builtin_parsers returns a new instance of every built-in parser, in
+// registration order: a later one takes an extension over from an earlier
+// one.
+fn builtin_parsers() []parsers.Parser {
+	return [
+		parsers.Parser(&parsers.PythonParser{}),
+		&parsers.JsTsParser{},
+		&parsers.JavaParser{},
+		&parsers.RustParser{},
+		&parsers.CppParser{},
+		&parsers.CSharpParser{},
+		&parsers.DartParser{},
+		&parsers.CParser{},
+		&parsers.DParser{},
+		&parsers.LuaParser{},
+		&parsers.PascalParser{},
+		&parsers.SwiftParser{},
+		&parsers.RubyParser{},
+		&parsers.GoParser{},
+		&parsers.VlangParser{},
+		&parsers.KotlinParser{},
+		&parsers.ScalaParser{},
+		&parsers.PhpParser{},
+		&parsers.ZigParser{},
+	]
+}
 
-	js_ts_parser := parsers.JsTsParser{}
-	for ext in js_ts_parser.get_extensions() {
-		a.parsers_map[ext] = js_ts_parser
+fn (mut a Analyzer) register_parsers() {
+	for parser in builtin_parsers() {
+		for ext in parser.get_extensions() {
+			a.parsers_map[ext] = parser
+		}
 	}
 
-	java_parser := parsers.JavaParser{}
-	for ext in java_parser.get_extensions() {
-		a.parsers_map[ext] = java_parser
+	// Custom languages come last, so a rule can take over an extension from
+	// a built-in parser. Their patterns were checked by add_custom_languages.
+	for rules in a.rules {
+		mut rule_parser := parsers.new_rule_parser(rules) or { continue }
+		a.parsers_map[rules.extension] = rule_parser
 	}
+}
 
-	rust_parser := parsers.RustParser{}
-	for ext in rust_parser.get_extensions() {
-		a.parsers_map[ext] = rust_parser
+// new_parser returns a new instance of the parser register_parsers maps
+// `key` to, without building all the others as fork does.
+fn (a &Analyzer) new_parser(key string) !parsers.Parser {
+	for i := a.rules.len - 1; i >= 0; i-- {
+		if a.rules[i].extension == key {
+			return parsers.new_rule_parser(a.rules[i])!
+		}
 	}
+	builtins := builtin_parsers()
+	for i := builtins.len - 1; i >= 0; i-- {
+		if key in builtins[i].get_extensions() {
+			return builtins[i]
+		}
+	}
+	return error('No parser found for ${key}')
+}
 
-	cpp_parser := parsers.CppParser{}
-	for ext in cpp_parser.get_extensions() {
-		a.parsers_map[ext] = cpp_parser
+// add_custom_languages registers a rule-driven parser for every custom
+// language from the config file, failing if any of its patterns is not a
+// valid regex.
+pub fn (mut a Analyzer) add_custom_languages(rules []CustomLanguageRule) ! {
+	for rule in rules {
+		set := rule.rule_set()
+		mut rule_parser := parsers.new_rule_parser(set) or {
+			return error('custom language ${set.extension}: ${err}')
+		}
+		a.rules << set
+		a.parsers_map[set.extension] = rule_parser
 	}
+}
 
-	csharp_parser := parsers.CSharpParser{}
-	for ext in csharp_parser.get_extensions() {
-		a.parsers_map[ext] = csharp_parser
+// Number of files each worker may have in flight ahead of the next result
+// to emit. This bounds the reorder buffer in analyze_parallel, unless the
+// sink is buffered.
+const reorder_window_per_worker = 16
+
+// analyze_directory analyzes every supported file under `root_path` and
+// hands the non-empty results to `sink` in walk order.
+pub fn (mut a Analyzer) analyze_directory(root_path string, mut progress ProgressTracker, mut sink ResultSink) ! {
+	if a.jobs <= 1 {
+		// Get all files to process
+		walk := time.new_stopwatch()
+		files := if a.use_file_list { a.files } else { a.collect_files(root_path) }
+		progress.stats.walk_ns += walk.elapsed().nanoseconds()
+		progress.total_files = files.len
+		a.analyze_serial(files, mut progress, mut sink)!
+		return
 	}
 
-	dart_parser := parsers.DartParser{}
-	for ext in dart_parser.get_extensions() {
-		a.parsers_map[ext] = dart_parser
+	if a.chunk_jobs > 1 && isnil(a.chunk_slots) {
+		a.chunk_slots = sync.new_semaphore_init(u32(a.chunk_jobs))
 	}
 
-	c_parser := parsers.CParser{}
-	for ext in c_parser.get_extensions() {
-		a.parsers_map[ext] = c_parser
+	// Walk in the background and start analyzing as soon as the first
+	// paths are found
+	found := chan FoundFile{cap: 4096}
+	walker := if a.use_file_list {
+		spawn feed_files(a.files, found)
+	} else {
+		spawn walk_tree(a, root_path, found, a.jobs)
 	}
+	progress.stats.walk_concurrent = true
+	// On failure the seeding thread keeps draining `found`, so the walker
+	// is not left blocked on it
+	a.analyze_parallel(found, mut progress, mut sink) or {
+		progress.stats.walk_ns += walker.wait()
+		return err
+	}
+	progress.stats.walk_ns += walker.wait()
+}
+
+fn (mut a Analyzer) analyze_serial(files []string, mut progress ProgressTracker, mut sink ResultSink) ! {
+	for i, file_path in files {
+		if !a.in_shard(file_path) {
+			continue
+		}
+		progress.report_file(file_path)
 
-	d_parser := parsers.DParser{}
-	for ext in d_parser.get_extensions() {
-		a.parsers_map[ext] = d_parser
+		outcome := a.process_file(i, file_path)
+		if !a.accept(outcome, mut progress) {
+			continue
+		}
+
+		if outcome.result.elements.len > 0 {
+			a.emit_result(mut sink, outcome, mut progress)!
+		}
 	}
+}
 
-	lua_parser := parsers.LuaParser{}
-	for ext in lua_parser.get_extensions() {
-		a.parsers_map[ext] = lua_parser
+// analyze_parallel analyzes the files arriving on `found` on `a.jobs`
+// worker threads and emits the results in walk order, so the output is
+// identical to the serial run. Files are scheduled largest first, using
+// the sizes from the walk, over per-worker queues that idle workers steal
+// from (see scheduler.v), so the biggest files do not end up as a tail
+// running alone. Completed results wait in `pending` until every earlier
+// file has been emitted; unless the sink is buffered, only a bounded
+// window of files is admitted ahead of the next one to emit, so memory
+// does not grow with the size of the tree. Progress, errors and cache
+// updates are handled on this thread.
+fn (mut a Analyzer) analyze_parallel(found chan FoundFile, mut progress ProgressTracker, mut sink ResultSink) ! {
+	worker_count := a.jobs
+	window := worker_count * reorder_window_per_worker
+	outcomes := chan FileOutcome{cap: window}
+	mut slots := &sync.Semaphore(unsafe { nil })
+	if !a.buffered {
+		slots = sync.new_semaphore_init(u32(window))
 	}
 
-	pascal_parser := parsers.PascalParser{}
-	for ext in pascal_parser.get_extensions() {
-		a.parsers_map[ext] = pascal_parser
+	sw := time.new_stopwatch()
+	mut queues := new_work_queues(worker_count)
+	seeder := spawn seed_queues(found, mut queues, slots)
+	mut workers := []thread WorkerStats{}
+	for i in 0 .. worker_count {
+		workers << spawn analyze_worker(a, i, mut queues, outcomes)
 	}
+	finisher := spawn finish_workers(workers, outcomes)
+
+	mut pending := map[int]FileOutcome{}
+	mut next_emit := 0
+	for {
+		outcome := <-outcomes or { break }
+		progress.total_files = queues.seeded_count()
+		if !outcome.foreign {
+			progress.report_file(outcome.path)
+		}
+		pending[outcome.index] = outcome
+
+		for {
+			ready := pending[next_emit] or { break }
+			pending.delete(next_emit)
+			next_emit++
+			if !isnil(slots) {
+				slots.post()
+			}
+			if a.accept(ready, mut progress) && ready.result.elements.len > 0 {
+				a.emit_result(mut sink, ready, mut progress) or {
+					queues.close(true)
+					if !isnil(slots) {
+						slots.post()
+					}
+					for {
+						_ = <-outcomes or { break }
+					}
+					seeder.wait()
+					finisher.wait()
+					return err
+				}
+			}
+		}
+	}
+	seeder.wait()
+	progress.stats.record_workers(finisher.wait(), sw.elapsed().nanoseconds())
+}
 
-	swift_parser := parsers.SwiftParser{}
-	for ext in swift_parser.get_extensions() {
-		a.parsers_map[ext] = swift_parser
+// finish_workers waits for the workers and then closes `outcomes`, which
+// ends the collecting loop of analyze_parallel.
+fn finish_workers(workers []thread WorkerStats, outcomes chan FileOutcome) []WorkerStats {
+	stats := workers.wait()
+	outcomes.close()
+	return stats
+}
+
+// emit_result hands the result of a finished file to the sink, timing the
+// output stage.
+fn (mut a Analyzer) emit_result(mut sink ResultSink, outcome FileOutcome, mut progress ProgressTracker) ! {
+	if a.shard_count > 1 {
+		a.shard_positions << u32(outcome.index)
 	}
+	result := a.collapse_duplicate(outcome)
+	sw := time.new_stopwatch()
+	sink.emit(result)!
+	progress.stats.add_output(sw.elapsed())
+	progress.stats.elements_emitted += result.elements.len
+}
 
-	ruby_parser := parsers.RubyParser{}
-	for ext in ruby_parser.get_extensions() {
-		a.parsers_map[ext] = ruby_parser
+fn analyze_worker(a &Analyzer, id int, mut queues WorkQueues, outcomes chan FileOutcome) WorkerStats {
+	mut worker := a.fork()
+	mut stats := WorkerStats{}
+	for {
+		job, stolen := queues.take(id) or { break }
+		sw := time.new_stopwatch()
+		outcome := worker.process_file(job.index, job.path)
+		stats.busy_ns += sw.elapsed().nanoseconds()
+		stats.files++
+		stats.bytes += job.size
+		if stolen {
+			stats.stolen++
+		}
+		outcomes <- outcome
 	}
+	return stats
+}
 
-	go_parser := parsers.GoParser{}
-	for ext in go_parser.get_extensions() {
-		a.parsers_map[ext] = go_parser
+// process_file analyzes one file, consulting the cache first when one is
+// configured. It is safe to call from worker threads: the cache is only
+// read here, never written.
+fn (mut a Analyzer) process_file(index int, file_path string) FileOutcome {
+	mut outcome := FileOutcome{
+		index: index
+		path:  file_path
+	}
+	if !a.in_shard(file_path) {
+		outcome.foreign = true
+		return outcome
 	}
 
-	vlang_parser := parsers.VlangParser{}
-	for ext in vlang_parser.get_extensions() {
-		a.parsers_map[ext] = vlang_parser
+	if !isnil(a.cache) || a.record_stamps {
+		stat := os.stat(file_path) or {
+			outcome.err = 'Failed to stat file: ${err}'
+			return outcome
+		}
+		outcome.stamped = true
+		outcome.mtime = stat.mtime
+		outcome.size = stat.size
+	}
+	if !isnil(a.cache) {
+		if entry := a.cache.lookup_entry(file_path) {
+			// A stale entry's language is not reused: the edit may have
+			// changed the shebang or modeline it was detected from
+			if entry.mtime == outcome.mtime && entry.size == outcome.size {
+				if !a.accepts_cached_language(mut outcome, entry.language) {
+					return outcome
+				}
+				outcome.result = entry.result
+				outcome.cached = true
+				a.note_content(mut outcome, entry.content_key)
+				return outcome
+			}
+		}
 	}
 
-	kotlin_parser := parsers.KotlinParser{}
-	for ext in kotlin_parser.get_extensions() {
-		a.parsers_map[ext] = kotlin_parser
+	outcome.result = a.read_and_parse(mut outcome) or {
+		if err is SkippedFile {
+			outcome.skipped = err.reason
+		} else {
+			outcome.err = err.msg()
+		}
+		return outcome
 	}
+	return outcome
+}
 
-	scala_parser := parsers.ScalaParser{}
-	for ext in scala_parser.get_extensions() {
-		a.parsers_map[ext] = scala_parser
+// accepts_cached_language records the language a cache entry was detected
+// as, or skips the file when this run's parsers or --lang exclude it.
+fn (a &Analyzer) accepts_cached_language(mut outcome FileOutcome, language string) bool {
+	if language.len > 0 {
+		a.check_language(language) or {
+			if err is SkippedFile {
+				outcome.skipped = err.reason
+			} else {
+				outcome.err = err.msg()
+			}
+			return false
+		}
 	}
+	outcome.language = language
+	return true
+}
 
-	php_parser := parsers.PhpParser{}
-	for ext in php_parser.get_extensions() {
-		a.parsers_map[ext] = php_parser
+// accept records a finished outcome on the collecting thread and returns
+// whether it produced a usable result.
+fn (mut a Analyzer) accept(outcome FileOutcome, mut progress ProgressTracker) bool {
+	if outcome.foreign {
+		return false
+	}
+	if a.record_stamps && outcome.stamped {
+		a.stamps[outcome.path] = FileStamp{
+			mtime: outcome.mtime
+			size:  outcome.size
+		}
+	}
+	if outcome.err.len > 0 {
+		progress.report_error(outcome.path, outcome.err)
+		return false
 	}
+	if outcome.skipped.len > 0 {
+		progress.report_skip(outcome.path, outcome.skipped)
+		return false
+	}
+	progress.stats.record_file(outcome)
+	if !isnil(a.cache) {
+		progress.report_cache(outcome.cached)
+		a.cache.store(outcome.path, outcome.mtime, outcome.size, outcome.language, outcome.content_key,
+			outcome.result)
+	}
+	return true
+}
 
-	zig_parser := parsers.ZigParser{}
-	for ext in zig_parser.get_extensions() {
-		a.parsers_map[ext] = zig_parser
+fn (a Analyzer) collect_files(root_path string) []string {
+	mut files := []string{}
+	entries := read_dir_entries(root_path)
+	a.walk_directory(root_path, '', a.enter_dir(unsafe { nil }, root_path, '', entries), entries, mut
+		files)
+	return files
+}
+
+pub fn (mut a Analyzer) analyze_file(file_path string) !parsers.ParseResult {
+	mut outcome := FileOutcome{
+		path: file_path
 	}
+	return a.read_and_parse(mut outcome)
 }
 
-pub fn (mut a Analyzer) analyze_directory(root_path string, mut progress ProgressTracker) []parsers.ParseResult {
-	mut results := []parsers.ParseResult{}
+// read_and_parse analyzes `outcome.path`, recording read and parse times
+// and sizes in `outcome`. Under --dedup a content parsed before is not
+// parsed again; files parsed in chunks are never read whole, so they are
+// not hashed.
+fn (mut a Analyzer) read_and_parse(mut outcome FileOutcome) !parsers.ParseResult {
+	file_path := outcome.path
+	ext := os.file_ext(file_path)
+	detect := a.needs_detection(ext) && outcome.language.len == 0
 
-	// Get all files to process
-	files := a.collect_files(root_path)
-	progress.total_files = files.len
+	if a.chunk_size > 0 && os.file_size(file_path) > u64(a.chunk_size) {
+		if detect {
+			head := read_head(file_path, detect_size) or {
+				return error('Failed to read file: ${err}')
+			}
+			outcome.language = a.detect_language(ext, head)!
+		}
+		mut parser := a.parser_for(ext, outcome.language)!
+		return a.parse_chunked(mut parser, mut outcome)
+	}
 
-	for file_path in files {
-		progress.report_file(file_path)
+	mut sw := time.new_stopwatch()
+	content := a.reader.read(file_path, a.max_file_size) or {
+		if err is SkippedFile {
+			return err
+		}
+		return error('Failed to read file: ${err}')
+	}
+	outcome.read_ns = sw.elapsed().nanoseconds()
+	outcome.bytes = u64(content.len)
+	if a.count_lines {
+		outcome.lines = count_lines(content)
+	}
 
-		result := a.analyze_file(file_path) or {
-			progress.report_error(file_path, err.msg())
-			continue
+	sw.restart()
+	if detect {
+		outcome.language = a.detect_language(ext, content)!
+	}
+	mut parser := a.parser_for(ext, outcome.language)!
+	if !isnil(a.contents) {
+		parser_key := if outcome.language.len > 0 { outcome.language } else { ext }
+		outcome.content_key = content_key(parser_key, content)
+		if elements := a.contents.lookup(outcome.content_key) {
+			outcome.duplicate = true
+			outcome.parse_ns = sw.elapsed().nanoseconds()
+			return parsers.ParseResult{
+				file_path: file_path
+				elements:  elements
+			}
 		}
+	}
+	mut result := parser.parse(content, file_path)
+	a.reader.detach(mut result)
+	if !isnil(a.contents) {
+		a.contents.add(outcome.content_key, result.elements)
+	}
+	outcome.parse_ns = sw.elapsed().nanoseconds()
+	return result
+}
 
-		if result.elements.len > 0 {
-			results << result
+// note_content records the content key of a result served from the cache
+// and, under --dedup, offers its elements to later copies of the content.
+fn (mut a Analyzer) note_content(mut outcome FileOutcome, key u64) {
+	outcome.content_key = key
+	if key != 0 && !isnil(a.contents) {
+		a.contents.add(key, outcome.result.elements)
+	}
+}
+
+// parser_for returns the parser for a file with extension `ext`, or for
+// `language` when the content decided it.
+fn (a &Analyzer) parser_for(ext string, language string) !parsers.Parser {
+	key := if language.len > 0 { language } else { ext }
+	return a.parsers_map[key] or { error('No parser found for extension: ${ext}') }
+}
+
+// parse_chunked parses a file larger than the chunk size one chunk at a
+// time, so memory stays bounded by the chunk size however big the file is.
+// When a chunk could not end between declarations, its last lines are
+// parsed again at the start of the next one (see chunk_lookbehind_lines);
+// elements found there are dropped, as the previous chunk already reported
+// them. With chunk_jobs > 1 the chunks are parsed concurrently, on as
+// many of those threads as no other file is using.
+fn (mut a Analyzer) parse_chunked(mut parser parsers.Parser, mut outcome FileOutcome) !parsers.ParseResult {
+	file_path := outcome.path
+	mut sw := time.new_stopwatch()
+	mut cursor := a.reader.open_chunks(file_path, a.max_file_size, a.chunk_size) or {
+		if err is SkippedFile {
+			return err
+		}
+		return error('Failed to read file: ${err}')
+	}
+	defer {
+		cursor.close()
+	}
+	outcome.read_ns += sw.elapsed().nanoseconds()
+	outcome.bytes = os.file_size(file_path)
+	threads := a.take_chunk_threads()
+	if threads > 0 {
+		parser_key := if outcome.language.len > 0 { outcome.language } else { os.file_ext(file_path) }
+		result := a.parse_chunks_parallel(mut cursor, mut outcome, parser_key, threads) or {
+			a.release_chunk_threads(threads)
+			return err
 		}
+		a.release_chunk_threads(threads)
+		return result
 	}
 
-	return results
+	mut result := parsers.ParseResult{
+		file_path: file_path
+	}
+	for {
+		sw.restart()
+		chunk := a.reader.next_chunk(mut cursor) or { break }
+		outcome.read_ns += sw.elapsed().nanoseconds()
+		outcome.lines += chunk.lines
+
+		sw.restart()
+		mut part := parser.parse(chunk.text, file_path)
+		a.reader.detach(mut part)
+		result.elements << chunk_elements(part.elements, chunk.first_line, chunk.lookbehind)
+		outcome.parse_ns += sw.elapsed().nanoseconds()
+	}
+	return result
 }
 
-fn (a Analyzer) collect_files(root_path string) []string {
-	mut files := []string{}
-	a.walk_directory(root_path, mut files)
-	return files
+// ChunkJob is one chunk of a file handed to a chunk worker. It owns its
+// text, since the reader's buffer moves on to the next chunk.
+struct ChunkJob {
+	index      int
+	text       string
+	first_line int
+	lookbehind int
+}
+
+struct ChunkOutcome {
+	index    int
+	elements []parsers.CodeElement
+	parse_ns i64
 }
 
-fn (a Analyzer) walk_directory(dir_path string, mut files []string) {
-	entries := os.ls(dir_path) or { return }
+// take_chunk_threads reserves up to chunk_jobs threads for the chunks of
+// one file and returns how many it got; 0 means parse them serially. The
+// threads are shared by all workers of analyze_directory, so large files
+// taken up at once never run more than chunk_jobs of them in total. An
+// analyzer used outside analyze_directory has a single caller and no
+// budget to share.
+fn (a &Analyzer) take_chunk_threads() int {
+	if a.chunk_jobs <= 1 {
+		return 0
+	}
+	if isnil(a.chunk_slots) {
+		return a.chunk_jobs
+	}
+	mut threads := 0
+	for threads < a.chunk_jobs && a.chunk_slots.try_wait() {
+		threads++
+	}
+	return threads
+}
 
-	for entry in entries {
-		full_path := os.join_path(dir_path, entry)
+fn (a &Analyzer) release_chunk_threads(threads int) {
+	if isnil(a.chunk_slots) {
+		return
+	}
+	for _ in 0 .. threads {
+		a.chunk_slots.post()
+	}
+}
 
-		// Skip hidden files and directories
-		if entry.starts_with('.') {
-			continue
+// parse_chunks_parallel reads the chunks of one file on this thread and
+// parses them on `threads` workers, each with its own instance of the
+// parser for `parser_key`, then puts the elements back in file order. At
+// most two chunks per worker are held in memory at a time.
+fn (mut a Analyzer) parse_chunks_parallel(mut cursor ChunkCursor, mut outcome FileOutcome, parser_key string, threads int) !parsers.ParseResult {
+	file_path := outcome.path
+	mut chunk_parsers := []parsers.Parser{cap: threads}
+	for _ in 0 .. threads {
+		chunk_parsers << a.new_parser(parser_key)!
+	}
+	window := 2 * threads
+	// Both channels hold a full window, so neither side blocks on a send
+	jobs := chan ChunkJob{cap: window}
+	outcomes := chan ChunkOutcome{cap: window}
+	mut workers := []thread{}
+	for parser in chunk_parsers {
+		workers << spawn chunk_worker(parser, file_path, jobs, outcomes)
+	}
+
+	mut parts := []ChunkOutcome{}
+	mut in_flight := 0
+	mut sw := time.new_stopwatch()
+	for {
+		sw.restart()
+		chunk := a.reader.next_chunk(mut cursor) or { break }
+		job := ChunkJob{
+			index:      parts.len
+			text:       chunk.text.clone()
+			first_line: chunk.first_line
+			lookbehind: chunk.lookbehind
 		}
+		outcome.read_ns += sw.elapsed().nanoseconds()
+		outcome.lines += chunk.lines
 
-		if os.is_dir(full_path) {
-			// Recursively walk subdirectories
-			a.walk_directory(full_path, mut files)
-		} else if os.is_file(full_path) {
-			// Check if file has supported extension
-			ext := os.file_ext(full_path)
-			if ext in a.parsers_map || a.target_lang.len == 0 {
-				files << full_path
-			}
+		if in_flight == window {
+			done := <-outcomes
+			parts[done.index] = done
+			in_flight--
 		}
+		parts << ChunkOutcome{}
+		jobs <- job
+		in_flight++
 	}
-}
+	jobs.close()
+	for in_flight > 0 {
+		done := <-outcomes
+		parts[done.index] = done
+		in_flight--
+	}
+	workers.wait()
 
-pub fn (a Analyzer) analyze_file(file_path string) !parsers.ParseResult {
-	ext := os.file_ext(file_path)
+	mut result := parsers.ParseResult{
+		file_path: file_path
+	}
+	for part in parts {
+		result.elements << part.elements
+		outcome.parse_ns += part.parse_ns
+	}
+	return result
+}
 
-	parser := a.parsers_map[ext] or { return error('No parser found for extension: ${ext}') }
+// chunk_worker parses chunks of `file_path` through `chunk_parser`, which
+// no other thread uses.
+fn chunk_worker(chunk_parser parsers.Parser, file_path string, jobs chan ChunkJob, outcomes chan ChunkOutcome) {
+	mut parser := chunk_parser
+	for {
+		job := <-jobs or { break }
+		sw := time.new_stopwatch()
+		part := parser.parse(job.text, file_path)
+		outcomes <- ChunkOutcome{
+			index:    job.index
+			elements: chunk_elements(part.elements, job.first_line, job.lookbehind)
+			parse_ns: sw.elapsed().nanoseconds()
+		}
+	}
+}
 
-	content := os.read_file(file_path) or { return error('Failed to read file: ${err}') }
+// chunk_elements returns the elements parsed from a chunk numbered by file
+// line, without those on its first `lookbehind` lines.
+fn chunk_elements(elements []parsers.CodeElement, first_line int, lookbehind int) []parsers.CodeElement {
+	mut shifted := []parsers.CodeElement{cap: elements.len}
+	for element in elements {
+		if element.line_number <= lookbehind {
+			continue
+		}
+		shifted << parsers.CodeElement{
+			...element
+			line_number: element.line_number + first_line
+		}
+	}
+	return shifted
+}
 
-	return parser.parse(content, file_path)
+// count_lines counts lines the way SourceLines splits them, closely enough
+// for statistics: every `\n` ends a line, as does the end of the content.
+fn count_lines(content string) int {
+	if content.len == 0 {
+		return 0
+	}
+	mut n := content.count('\n')
+	if !content.ends_with('\n') {
+		n++
+	}
+	return n
 }
 
 pub fn (a Analyzer) get_supported_extensions() []string {
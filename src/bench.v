@@ -0,0 +1,216 @@
+module main
+
+import os
+import flag
+import time
+import runtime
+import parsers
+
+// Size of each generated file in the end-to-end corpus.
+const bench_file_size = 64 * 1024
+
+struct BenchOptions {
+mut:
+	samples    string
+	size_kib   int
+	iterations int
+	jobs       int
+	keep       bool
+}
+
+// BenchSample is one seed file from the samples directory.
+struct BenchSample {
+	name    string
+	ext     string
+	content string
+}
+
+// BenchSink counts the emitted results and drops them, so the pipeline
+// benchmark measures analysis rather than output.
+struct BenchSink {
+mut:
+	files    int
+	elements int
+}
+
+fn (mut s BenchSink) emit(result parsers.ParseResult) ! {
+	s.files++
+	s.elements += result.elements.len
+}
+
+// run_bench implements `code-analyzer bench`: every sample is scaled to a
+// synthetic corpus and parsed in memory to measure each parser on its own,
+// then the same corpus is written to a temporary tree and run through the
+// whole pipeline, serially and with the requested number of jobs.
+fn run_bench(argv []string) {
+	opts := parse_bench_arguments(argv)
+	samples := load_bench_samples(opts.samples) or {
+		eprintln('Error: ${err}')
+		exit(1)
+	}
+	target := opts.size_kib * 1024
+
+	println('Parser throughput (${opts.size_kib} KiB per sample, best of ${opts.iterations})')
+	print_bench_header('sample')
+	mut a := new_analyzer()
+	for sample in samples {
+		bench_parser(mut a, sample, scale_sample(sample.content, target), opts.iterations)
+	}
+
+	dir := os.join_path(os.temp_dir(), 'code-analyzer-bench-${os.getpid()}')
+	bytes, lines := write_bench_corpus(dir, samples, target) or {
+		eprintln('Error writing benchmark corpus: ${err}')
+		exit(1)
+	}
+	println('')
+	println('Pipeline throughput (${samples.len} languages, ${bytes / 1024} KiB)')
+	print_bench_header('run')
+	bench_pipeline(dir, 1, bytes, lines)
+	if opts.jobs > 1 {
+		bench_pipeline(dir, opts.jobs, bytes, lines)
+	}
+
+	if opts.keep {
+		println('Corpus kept in ${dir}')
+	} else {
+		os.rmdir_all(dir) or { eprintln('Warning: failed to remove ${dir}: ${err}') }
+	}
+}
+
+fn parse_bench_arguments(argv []string) BenchOptions {
+	mut fp := flag.new_flag_parser(argv)
+	fp.application('code-analyzer bench')
+	fp.description('Measure parser and pipeline throughput on synthetic corpora')
+	fp.skip_executable()
+
+	mut opts := BenchOptions{}
+	opts.samples = fp.string('samples', `s`, 'test/sample_code', 'Directory with one seed file per language')
+	opts.size_kib = fp.int('size', 0, 1024, 'Corpus size per sample in KiB')
+	opts.iterations = fp.int('iterations', 0, 3, 'Runs per parser; the fastest is reported')
+	opts.jobs = fp.int('jobs', `j`, runtime.nr_cpus(), 'Worker threads for the parallel pipeline run')
+	opts.keep = fp.bool('keep', 0, false, 'Keep the generated corpus directory')
+
+	fp.finalize() or {
+		eprintln('Error parsing arguments: ${err}')
+		println(fp.usage())
+		exit(1)
+	}
+	if opts.size_kib <= 0 {
+		opts.size_kib = 1
+	}
+	if opts.iterations <= 0 {
+		opts.iterations = 1
+	}
+	return opts
+}
+
+// load_bench_samples reads every file in `dir` that a registered parser
+// handles, in name order.
+fn load_bench_samples(dir string) ![]BenchSample {
+	a := new_analyzer()
+	mut names := os.ls(dir) or { return error('cannot list samples in ${dir}: ${err}') }
+	names.sort()
+
+	mut samples := []BenchSample{}
+	for name in names {
+		ext := os.file_ext(name)
+		if ext !in a.parsers_map {
+			continue
+		}
+		content := os.read_file(os.join_path(dir, name))!
+		if content.len == 0 {
+			continue
+		}
+		samples << BenchSample{
+			name:    name
+			ext:     ext
+			content: content
+		}
+	}
+	if samples.len == 0 {
+		return error('no samples for any supported language in ${dir}')
+	}
+	return samples
+}
+
+// scale_sample repeats `content` until the result reaches `target` bytes.
+fn scale_sample(content string, target int) string {
+	copies := if content.len >= target { 1 } else { (target + content.len - 1) / content.len }
+	mut body := content
+	if !body.ends_with('\n') {
+		body += '\n'
+	}
+	return body.repeat(copies)
+}
+
+fn bench_parser(mut a Analyzer, sample BenchSample, corpus string, iterations int) {
+	mut parser := a.parsers_map[sample.ext] or { return }
+	lines := corpus.count('\n')
+	mut best := 0.0
+	mut elements := 0
+	for _ in 0 .. iterations {
+		sw := time.new_stopwatch()
+		result := parser.parse(corpus, sample.name)
+		seconds := sw.elapsed().seconds()
+		elements = result.elements.len
+		if best == 0.0 || seconds < best {
+			best = seconds
+		}
+	}
+	print_bench_row(sample.name, corpus.len, lines, elements, best)
+}
+
+// write_bench_corpus writes each scaled sample under `dir`, split into
+// files of about bench_file_size bytes, and returns the total bytes and
+// lines written.
+fn write_bench_corpus(dir string, samples []BenchSample, target int) !(int, int) {
+	os.mkdir_all(dir)!
+	mut bytes := 0
+	mut lines := 0
+	for sample in samples {
+		sub_dir := os.join_path(dir, sample.name.replace('.', '_'))
+		os.mkdir_all(sub_dir)!
+		chunk := scale_sample(sample.content, bench_file_size)
+		chunk_lines := chunk.count('\n')
+		file_count := if target > chunk.len { target / chunk.len } else { 1 }
+		for i in 0 .. file_count {
+			os.write_file(os.join_path(sub_dir, 'corpus_${i}${sample.ext}'), chunk)!
+		}
+		bytes += chunk.len * file_count
+		lines += chunk_lines * file_count
+	}
+	return bytes, lines
+}
+
+fn bench_pipeline(dir string, jobs int, bytes int, lines int) {
+	mut a := new_analyzer()
+	a.jobs = jobs
+	mut progress := ProgressTracker{}
+	progress.init(false, 0)
+	mut sink := BenchSink{}
+
+	sw := time.new_stopwatch()
+	a.analyze_directory(dir, mut progress, mut sink) or {
+		eprintln('Error: pipeline run failed: ${err}')
+		return
+	}
+	seconds := sw.elapsed().seconds()
+	if progress.files_failed > 0 {
+		eprintln('Warning: ${progress.files_failed} file(s) failed during the pipeline run')
+	}
+	print_bench_row('${jobs} job(s), ${progress.files_processed} files', bytes, lines, sink.elements,
+		seconds)
+}
+
+fn print_bench_header(label string) {
+	println('${label:-36}       MB/s      lines/s   elements/s')
+}
+
+fn print_bench_row(label string, bytes int, lines int, elements int, seconds f64) {
+	// Guard against a timer resolution of zero on tiny corpora
+	secs := if seconds > 0 { seconds } else { 1e-9 }
+	mb_per_s := f64(bytes) / (1024.0 * 1024.0) / secs
+	lines_per_s := f64(lines) / secs
+	elements_per_s := f64(elements) / secs
+	println('${label:-36} ${mb_per_s:10.2f} ${lines_per_s:12.0f} ${elements_per_s:12.0f}')
+}
@@ -0,0 +1,51 @@
+// Directory reading helpers for src/walker.v.
+//
+// They expose the entry type that readdir already returns in d_type, so the
+// walker only has to stat entries on filesystems that do not report it.
+#ifndef CODE_ANALYZER_FASTWALK_H
+#define CODE_ANALYZER_FASTWALK_H
+
+#include <dirent.h>
+#include <stddef.h>
+
+// Entry kinds, mirrored by the entry_* constants in walker.v
+#define CA_ENTRY_END -1
+#define CA_ENTRY_UNKNOWN 0
+#define CA_ENTRY_FILE 1
+#define CA_ENTRY_DIR 2
+#define CA_ENTRY_OTHER 3
+
+static inline void* ca_open_dir(const char* path) {
+	return (void*)opendir(path);
+}
+
+static inline void ca_close_dir(void* dir) {
+	closedir((DIR*)dir);
+}
+
+// ca_next_entry stores the next entry name in *name and returns its kind.
+// Symlinks are reported as unknown so the caller resolves them with stat.
+static inline int ca_next_entry(void* dir, char** name) {
+	struct dirent* ent = readdir((DIR*)dir);
+	if (ent == NULL) {
+		return CA_ENTRY_END;
+	}
+	*name = ent->d_name;
+#ifdef DT_DIR
+	switch (ent->d_type) {
+	case DT_REG:
+		return CA_ENTRY_FILE;
+	case DT_DIR:
+		return CA_ENTRY_DIR;
+	case DT_UNKNOWN:
+	case DT_LNK:
+		return CA_ENTRY_UNKNOWN;
+	default:
+		return CA_ENTRY_OTHER;
+	}
+#else
+	return CA_ENTRY_UNKNOWN;
+#endif
+}
+
+#endif
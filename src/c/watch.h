@@ -0,0 +1,127 @@
+// File change notification helpers for src/watch.v.
+//
+// On Linux they wrap inotify and reduce each event to one of the
+// CA_WATCH_* kinds below. Elsewhere ca_watch_init fails, and watch.v falls
+// back to polling.
+#ifndef CODE_ANALYZER_WATCH_H
+#define CODE_ANALYZER_WATCH_H
+
+// Event kinds, mirrored by the watch_* constants in watch.v
+#define CA_WATCH_END 0
+#define CA_WATCH_IGNORED 1
+#define CA_WATCH_CHANGED 2
+#define CA_WATCH_REMOVED 3
+#define CA_WATCH_DIR_ADDED 4
+#define CA_WATCH_DIR_REMOVED 5
+#define CA_WATCH_OVERFLOW 6
+#define CA_WATCH_GONE 7
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define CA_WATCH_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+static inline int ca_watch_init(void) {
+	return inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+static inline int ca_watch_add(int fd, const char* path) {
+	return inotify_add_watch(fd, path, CA_WATCH_MASK);
+}
+
+static inline void ca_watch_close(int fd) {
+	close(fd);
+}
+
+// ca_watch_read waits up to timeout_ms for events and reads them into buf.
+// Returns the number of bytes read, 0 on timeout, or -1 on error.
+static inline int ca_watch_read(int fd, char* buf, int len, int timeout_ms) {
+	struct pollfd p = {fd, POLLIN, 0};
+	int ready = poll(&p, 1, timeout_ms);
+	if (ready <= 0) {
+		return ready < 0 && errno != EINTR ? -1 : 0;
+	}
+	ssize_t n = read(fd, buf, (size_t)len);
+	if (n < 0) {
+		return errno == EAGAIN || errno == EINTR ? 0 : -1;
+	}
+	return (int)n;
+}
+
+// ca_watch_next decodes the event at *offset in buf, advancing *offset.
+// It stores the watch descriptor and the entry name (empty for events on
+// the watched directory itself) and returns the event kind.
+static inline int ca_watch_next(const char* buf, int len, int* offset, int* wd, char** name) {
+	if (*offset + (int)sizeof(struct inotify_event) > len) {
+		return CA_WATCH_END;
+	}
+	const struct inotify_event* ev = (const struct inotify_event*)(buf + *offset);
+	*offset += (int)sizeof(struct inotify_event) + (int)ev->len;
+	*wd = ev->wd;
+	*name = ev->len > 0 ? (char*)ev->name : (char*)"";
+
+	if (ev->mask & IN_Q_OVERFLOW) {
+		return CA_WATCH_OVERFLOW;
+	}
+	if (ev->mask & IN_IGNORED) {
+		return CA_WATCH_GONE;
+	}
+	if (ev->mask & IN_ISDIR) {
+		if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+			return CA_WATCH_DIR_ADDED;
+		}
+		if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+			return CA_WATCH_DIR_REMOVED;
+		}
+		return CA_WATCH_IGNORED;
+	}
+	// New files are picked up by the IN_CLOSE_WRITE that follows
+	if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+		return CA_WATCH_CHANGED;
+	}
+	if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+		return CA_WATCH_REMOVED;
+	}
+	return CA_WATCH_IGNORED;
+}
+
+#else
+
+static inline int ca_watch_init(void) {
+	return -1;
+}
+
+static inline int ca_watch_add(int fd, const char* path) {
+	(void)fd;
+	(void)path;
+	return -1;
+}
+
+static inline void ca_watch_close(int fd) {
+	(void)fd;
+}
+
+static inline int ca_watch_read(int fd, char* buf, int len, int timeout_ms) {
+	(void)fd;
+	(void)buf;
+	(void)len;
+	(void)timeout_ms;
+	return -1;
+}
+
+static inline int ca_watch_next(const char* buf, int len, int* offset, int* wd, char** name) {
+	(void)buf;
+	(void)len;
+	(void)offset;
+	(void)wd;
+	(void)name;
+	return CA_WATCH_END;
+}
+
+#endif
+
+#endif
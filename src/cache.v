@@ -0,0 +1,127 @@
+module main
+
+import os
+import json
+import hash.fnv1a
+import parsers
+
+// Bump whenever parser output or the cache layout changes, so results
+// cached by an older build are not reused.
+const cache_format_version = 8
+
+const cache_file_name = 'results.json'
+
+// CacheEntry is the cached analysis of one file. It stays valid while the
+// file's size and modification time are unchanged.
+pub struct CacheEntry {
+pub mut:
+	path        string
+	mtime       i64
+	size        u64
+	language    string // parser extension detected from the content, see detect.v
+	content_key u64    // see dedup.v; 0 when the content was not hashed
+	result      parsers.ParseResult
+}
+
+struct CacheFile {
+pub mut:
+	version int
+	rules   string // fingerprint of the custom language rules in use
+	entries []CacheEntry
+}
+
+// ResultCache is the persistent per-file result cache behind --cache-dir.
+// `entries` holds the previous run and is only read during analysis, so
+// workers can share it; `updated` collects this run's results on the
+// collecting thread and becomes the next cache file on save.
+pub struct ResultCache {
+pub mut:
+	dir      string
+	rules    string
+	entries  map[string]CacheEntry
+	updated  []CacheEntry
+	compress bool // save the cache file compressed, see compression.v
+}
+
+// load_result_cache reads the cache stored in `dir`, compressed or not. A
+// missing, unreadable or outdated cache file simply yields an empty cache,
+// as does one written with different custom language rules (`rules` is
+// their fingerprint).
+pub fn load_result_cache(dir string, rules string) &ResultCache {
+	mut cache := &ResultCache{
+		dir:   dir
+		rules: rules
+	}
+
+	cache_path := os.join_path(dir, cache_file_name)
+	if !os.exists(cache_path) {
+		return cache
+	}
+
+	content := read_decompressed(cache_path) or {
+		eprintln('Warning: ignoring unreadable cache ${cache_path}: ${err}')
+		return cache
+	}
+	stored := json.decode(CacheFile, content.bytestr()) or {
+		eprintln('Warning: ignoring corrupt cache ${cache_path}: ${err}')
+		return cache
+	}
+	if stored.version != cache_format_version || stored.rules != rules {
+		return cache
+	}
+
+	for entry in stored.entries {
+		cache.entries[entry.path] = entry
+	}
+	return cache
+}
+
+// lookup_entry returns the cached entry for `path` without checking the
+// file's stamp.
+pub fn (c &ResultCache) lookup_entry(path string) ?CacheEntry {
+	return c.entries[path] or { return none }
+}
+
+// store records the result of the current run for `path`, and the
+// language detected for it and its content key, if any.
+pub fn (mut c ResultCache) store(path string, mtime i64, size u64, language string, key u64, result parsers.ParseResult) {
+	c.updated << CacheEntry{
+		path:        path
+		mtime:       mtime
+		size:        size
+		language:    language
+		content_key: key
+		result:      result
+	}
+}
+
+// save replaces the cache file with the results of the current run, which
+// also drops entries for files that no longer exist.
+pub fn (c &ResultCache) save() ! {
+	os.mkdir_all(c.dir) or { return error('Failed to create cache directory: ${err}') }
+
+	cache_path := os.join_path(c.dir, cache_file_name)
+	tmp_path := cache_path + '.tmp'
+	content := json.encode(CacheFile{
+		version: cache_format_version
+		rules:   c.rules
+		entries: c.updated
+	})
+	if c.compress {
+		write_compressed_file(tmp_path, content.bytes()) or {
+			return error('Failed to write cache file: ${err}')
+		}
+	} else {
+		os.write_file(tmp_path, content) or { return error('Failed to write cache file: ${err}') }
+	}
+	os.mv(tmp_path, cache_path) or { return error('Failed to replace cache file: ${err}') }
+}
+
+// rules_fingerprint identifies the custom language rules in use, so cached
+// results are dropped when a rule changes. Empty without custom languages.
+fn (a &Analyzer) rules_fingerprint() string {
+	if a.rules.len == 0 {
+		return ''
+	}
+	return fnv1a.sum64_string(json.encode(a.rules)).hex()
+}
@@ -0,0 +1,140 @@
+module main
+
+import parsers
+
+// Element kinds produced by the built-in parsers. They are interned first,
+// so their ids are fixed; kinds from custom rules are added after them.
+const element_kinds = ['module', 'class', 'function', 'method', 'interface', 'struct', 'enum',
+	'trait', 'object', 'constant', 'match_expression', 'data class', 'abstract class']
+
+// Access modifiers produced by the built-in parsers; id 0 is "no modifier".
+const element_access = ['', 'public', 'private', 'protected', 'internal', 'pub', 'static', 'open',
+	'fileprivate']
+
+// Interner maps a small vocabulary (element kinds, access modifiers) to
+// dense ids, so each distinct spelling is stored once per run instead of
+// once per element.
+struct Interner {
+mut:
+	ids   map[string]u32
+	names []string
+}
+
+fn new_interner(seed []string) Interner {
+	mut t := Interner{}
+	for s in seed {
+		t.intern(s)
+	}
+	return t
+}
+
+fn (mut t Interner) intern(s string) u32 {
+	if id := t.ids[s] {
+		return id
+	}
+	id := u32(t.names.len)
+	owned := s.clone()
+	t.names << owned
+	t.ids[owned] = id
+	return id
+}
+
+// CompactElement is a CodeElement without strings of its own: kind and
+// access are interned ids, and name, parent and doc are consecutive byte
+// ranges of the file's arena starting at `offset`.
+struct CompactElement {
+	kind        u32
+	access      u32
+	line_number int
+	offset      u32
+	name_len    u32
+	parent_len  u32
+	doc_len     u32
+}
+
+// CompactResult holds the elements of one file in two allocations: the
+// record array and a byte arena with every name, parent and doc. Neither
+// contains pointers, so the GC does not scan them, and the whole file is
+// released at once.
+pub struct CompactResult {
+pub:
+	file_path    string
+	duplicate_of string // see parsers.ParseResult; such a result keeps no elements
+mut:
+	arena    []u8
+	elements []CompactElement
+}
+
+// compact_result copies `result` into a CompactResult, interning kinds and
+// access modifiers into `kinds` and `access`.
+fn compact_result(result parsers.ParseResult, mut kinds Interner, mut access Interner) CompactResult {
+	if result.duplicate_of.len > 0 {
+		return CompactResult{
+			file_path:    result.file_path.clone()
+			duplicate_of: result.duplicate_of.clone()
+		}
+	}
+	mut size := 0
+	for element in result.elements {
+		size += element.name.len + element.parent.len + element.doc.len
+	}
+
+	mut compact := CompactResult{
+		file_path: result.file_path.clone()
+		arena:     []u8{cap: size}
+		elements:  []CompactElement{cap: result.elements.len}
+	}
+	for element in result.elements {
+		offset := u32(compact.arena.len)
+		compact.push_text(element.name)
+		compact.push_text(element.parent)
+		compact.push_text(element.doc)
+		compact.elements << CompactElement{
+			kind:        kinds.intern(element.element_type)
+			access:      access.intern(element.access)
+			line_number: element.line_number
+			offset:      offset
+			name_len:    u32(element.name.len)
+			parent_len:  u32(element.parent.len)
+			doc_len:     u32(element.doc.len)
+		}
+	}
+	return compact
+}
+
+@[inline]
+fn (mut r CompactResult) push_text(s string) {
+	if s.len > 0 {
+		unsafe { r.arena.push_many(s.str, s.len) }
+	}
+}
+
+// text returns a view of `len` arena bytes at `offset`. It is only valid
+// while the result is alive.
+@[inline]
+fn (r &CompactResult) text(offset u32, len u32) string {
+	if len == 0 {
+		return ''
+	}
+	return unsafe { tos(&r.arena[int(offset)], int(len)) }
+}
+
+fn (r &CompactResult) name(e CompactElement) string {
+	return r.text(e.offset, e.name_len)
+}
+
+fn (r &CompactResult) parent(e CompactElement) string {
+	return r.text(e.offset + e.name_len, e.parent_len)
+}
+
+fn (r &CompactResult) doc(e CompactElement) string {
+	return r.text(e.offset + e.name_len + e.parent_len, e.doc_len)
+}
+
+// free releases the arena and the records.
+fn (mut r CompactResult) free() {
+	unsafe {
+		r.arena.free()
+		r.elements.free()
+	}
+}
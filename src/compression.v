@@ -0,0 +1,228 @@
+module main
+
+import os
+import runtime
+import compress.deflate
+import compress.gzip
+import hash.crc32
+
+// Compressed outputs and caches (--compress) are gzip files, so zcat and
+// other gzip tools read them. They are made of independent members, one
+// per output buffer flush, each giving its own size in a gzip extra
+// subfield (`CA`): readers split the file without inflating it, and a
+// binary output's header, written as an uncompressed member of fixed size,
+// can be rewritten in place once the section sizes are known. Members are
+// deflated on compressor threads while analysis goes on, and written in
+// order by a writer thread.
+//
+// Every reader (query, merge, index --from, the cache) goes through
+// read_decompressed, so compressed and plain files are accepted alike.
+
+const gzip_member_header_size = 20 // fixed header, XLEN and the CA subfield
+const gzip_member_trailer_size = 8 // CRC-32 and input size
+const compress_max_threads = 4
+
+// gzip_member wraps `payload`, the deflated form of `data`, into a member.
+fn gzip_member(data []u8, payload []u8) []u8 {
+	size := gzip_member_header_size + payload.len + gzip_member_trailer_size
+	mut m := []u8{cap: size}
+	// ID1 ID2, deflate, FEXTRA, no mtime, no extra flags, unknown OS
+	m << [u8(0x1f), 0x8b, 8, 0x04, 0, 0, 0, 0, 0, 255]
+	put_u16(mut m, 8)
+	m << [u8(`C`), `A`]
+	put_u16(mut m, 4)
+	put_u32(mut m, u32(size))
+	m << payload
+	put_u32(mut m, crc32.sum(data))
+	put_u32(mut m, u32(data.len))
+	return m
+}
+
+fn compress_member(data []u8) ![]u8 {
+	return gzip_member(data, deflate.compress(data)!)
+}
+
+// stored_member is a member holding `data` (at most 64 KiB) as a stored
+// deflate block, so its size only depends on data.len.
+fn stored_member(data []u8) []u8 {
+	mut payload := []u8{cap: 5 + data.len}
+	payload << u8(1) // final block, not compressed
+	put_u16(mut payload, u16(data.len))
+	put_u16(mut payload, ~u16(data.len))
+	payload << data
+	return gzip_member(data, payload)
+}
+
+// is_compressed reports whether `data` starts like a gzip file.
+fn is_compressed(data []u8) bool {
+	return data.len >= 2 && data[0] == 0x1f && data[1] == 0x8b
+}
+
+// read_decompressed reads the file at `path`, inflating it when it is
+// compressed.
+fn read_decompressed(path string) ![]u8 {
+	data := os.read_bytes(path)!
+	if !is_compressed(data) {
+		return data
+	}
+	return decompress_members(data) or { error('${path}: ${err}') }
+}
+
+fn decompress_members(data []u8) ![]u8 {
+	mut out := []u8{}
+	mut pos := 0
+	for pos < data.len {
+		size := member_size(data, pos) or {
+			if pos == 0 {
+				// Compressed by another tool: a plain gzip file
+				return gzip.decompress(data)
+			}
+			return err
+		}
+		if size < gzip_member_header_size + gzip_member_trailer_size || pos + size > data.len {
+			return error('truncated compressed data')
+		}
+		member := data[pos..pos + size]
+		inflated := deflate.decompress(member[gzip_member_header_size..size - gzip_member_trailer_size])!
+		if crc32.sum(inflated) != get_u32(member, u64(size - 8))
+			|| u32(inflated.len) != get_u32(member, u64(size - 4)) {
+			return error('corrupt compressed data')
+		}
+		out << inflated
+		pos += size
+	}
+	return out
+}
+
+// member_size returns the size recorded in the CA subfield of the member
+// at `pos`.
+fn member_size(data []u8, pos int) !int {
+	if pos + gzip_member_header_size > data.len || data[pos] != 0x1f || data[pos + 1] != 0x8b
+		|| data[pos + 3] != 0x04 || get_u16(data, u64(pos + 10)) != 8 || data[pos + 12] != `C`
+		|| data[pos + 13] != `A` {
+		return error('compressed data not written by code-analyzer')
+	}
+	return int(get_u32(data, u64(pos + 16)))
+}
+
+// write_compressed_file replaces the file at `path` with `data`, compressed.
+fn write_compressed_file(path string, data []u8) ! {
+	mut f := os.create(path)!
+	mut c := new_block_compressor(f)
+	c.push_all(data)
+	c.finish() or {
+		f.close()
+		return err
+	}
+	f.close()
+}
+
+// CompressedBlock is one block on its way through a BlockCompressor.
+struct CompressedBlock {
+mut:
+	seq  int
+	data []u8
+	err  string
+}
+
+// BlockCompressor deflates the blocks pushed to it on up to
+// compress_max_threads threads and appends them to a file in push order.
+// `push` blocks while the compressors are busy, which bounds the data in
+// flight.
+@[heap]
+struct BlockCompressor {
+mut:
+	input   chan CompressedBlock
+	output  chan CompressedBlock
+	workers []thread
+	writer  thread string
+	next    int
+}
+
+fn new_block_compressor(file os.File) &BlockCompressor {
+	cpus := runtime.nr_cpus()
+	threads := if cpus > compress_max_threads { compress_max_threads } else if cpus < 1 { 1 } else { cpus }
+	mut c := &BlockCompressor{
+		input:  chan CompressedBlock{cap: threads}
+		output: chan CompressedBlock{cap: 2 * threads}
+	}
+	for _ in 0 .. threads {
+		c.workers << spawn compress_blocks(c.input, c.output)
+	}
+	c.writer = spawn write_blocks(file, c.output)
+	return c
+}
+
+// push queues `data` for compression. The caller must not modify it
+// afterwards.
+fn (mut c BlockCompressor) push(data []u8) {
+	c.input <- CompressedBlock{
+		seq:  c.next
+		data: data
+	}
+	c.next++
+}
+
+// push_all queues `data` in blocks of output_flush_size.
+fn (mut c BlockCompressor) push_all(data []u8) {
+	for start := 0; start < data.len; start += output_flush_size {
+		end := if start + output_flush_size < data.len { start + output_flush_size } else { data.len }
+		c.push(data[start..end])
+	}
+}
+
+// finish waits until every block is written and returns the first error.
+fn (mut c BlockCompressor) finish() ! {
+	c.input.close()
+	c.workers.wait()
+	c.output.close()
+	failure := c.writer.wait()
+	if failure.len > 0 {
+		return error(failure)
+	}
+}
+
+fn compress_blocks(input chan CompressedBlock, output chan CompressedBlock) {
+	for {
+		block := <-input or { break }
+		mut done := CompressedBlock{
+			seq: block.seq
+		}
+		done.data = compress_member(block.data) or {
+			done.err = 'Failed to compress output: ${err}'
+			[]u8{}
+		}
+		output <- done
+	}
+}
+
+// write_blocks appends the compressed blocks to `file` in sequence order
+// and returns the first error; after one, the remaining blocks are only
+// drained.
+fn write_blocks(file os.File, output chan CompressedBlock) string {
+	mut f := file
+	mut pending := map[int][]u8{}
+	mut next := 0
+	mut failure := ''
+	for {
+		block := <-output or { break }
+		if failure.len > 0 {
+			continue
+		}
+		if block.err.len > 0 {
+			failure = block.err
+			continue
+		}
+		pending[block.seq] = block.data
+		for {
+			data := pending[next] or { break }
+			pending.delete(next)
+			next++
+			f.write(data) or {
+				failure = 'Failed to write to output file: ${err}'
+				break
+			}
+		}
+	}
+	return failure
+}
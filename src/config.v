@@ -2,6 +2,7 @@ module main
 
 import os
 import json
+import parsers
 
 pub struct CustomLanguageRule {
 pub mut:
@@ -14,6 +15,21 @@ pub mut:
 	doc_before_element bool
 }
 
+// rule_set converts the rule into the description RuleParser is built from,
+// normalizing the extension to start with a dot.
+pub fn (r CustomLanguageRule) rule_set() parsers.RuleSet {
+	extension := if r.extension.starts_with('.') { r.extension } else { '.' + r.extension }
+	return parsers.RuleSet{
+		extension:          extension
+		class_pattern:      r.class_pattern
+		function_pattern:   r.function_pattern
+		method_pattern:     r.method_pattern
+		module_pattern:     r.module_pattern
+		doc_comment_marker: r.doc_comment_marker
+		doc_before_element: r.doc_before_element
+	}
+}
+
 pub struct Config {
 pub mut:
 	custom_languages []CustomLanguageRule
@@ -103,11 +119,12 @@ fn extract_yaml_value(line string) string {
 
 	value := parts[1..].join(':').trim_space()
 
-	// Remove quotes if present
-	if value.starts_with('"') && value.ends_with('"') {
-		return value[1..value.len - 1]
+	// Remove quotes if present. Double-quoted YAML values use backslash
+	// escapes, so "class\\s+" stands for the regex class\s+
+	if value.len >= 2 && value.starts_with('"') && value.ends_with('"') {
+		return value[1..value.len - 1].replace('\\\\', '\\').replace('\\"', '"')
 	}
-	if value.starts_with("'") && value.ends_with("'") {
+	if value.len >= 2 && value.starts_with("'") && value.ends_with("'") {
 		return value[1..value.len - 1]
 	}
 
@@ -0,0 +1,74 @@
+module main
+
+import sync
+import hash.fnv1a
+import parsers
+
+// Under --dedup, the elements parsed for each distinct file content are
+// kept, so vendored copies and generated duplicates are parsed once: a
+// later file with the same content reuses the elements with its own path.
+// Contents are identified by a 64-bit hash and not compared, which leaves
+// a collision between two files of one tree vanishingly unlikely.
+//
+// With --collapse-duplicates the output lists such files once: every later
+// copy, in walk order, only names the first one (see write_duplicate).
+
+const fnv64_prime = u64(1099511628211)
+
+// ContentIndex maps content keys to parsed elements. It is shared by all
+// workers of a run.
+@[heap]
+struct ContentIndex {
+mut:
+	mu      &sync.Mutex = sync.new_mutex()
+	entries map[u64][]parsers.CodeElement
+}
+
+fn (mut x ContentIndex) lookup(key u64) ?[]parsers.CodeElement {
+	x.mu.@lock()
+	defer {
+		x.mu.unlock()
+	}
+	return x.entries[key] or { return none }
+}
+
+// add records the elements parsed for a content. When two workers parse
+// the same content at once, the first to finish wins; both results are
+// the same.
+fn (mut x ContentIndex) add(key u64, elements []parsers.CodeElement) {
+	x.mu.@lock()
+	if key !in x.entries {
+		x.entries[key] = elements
+	}
+	x.mu.unlock()
+}
+
+// content_key hashes `content` followed by the parser key (`ext`, or the
+// language detected for the file): the same header parsed as C and as C++
+// has different elements. Never 0, which stands for "no key".
+fn content_key(parser_key string, content string) u64 {
+	mut h := fnv1a.sum64_string(content)
+	for c in parser_key {
+		h = (h ^ u64(c)) * fnv64_prime
+	}
+	return if h == 0 { 1 } else { h }
+}
+
+// collapse_duplicate turns `result` into a reference to the first file
+// emitted with the same content, if there was one; otherwise the file is
+// remembered as the first. Runs on the collecting thread, in walk order,
+// so the output does not depend on which worker parsed a content first.
+fn (mut a Analyzer) collapse_duplicate(outcome FileOutcome) parsers.ParseResult {
+	if !a.collapse || outcome.content_key == 0 {
+		return outcome.result
+	}
+	if first := a.first_paths[outcome.content_key] {
+		return parsers.ParseResult{
+			file_path:    outcome.result.file_path
+			elements:     outcome.result.elements
+			duplicate_of: first
+		}
+	}
+	a.first_paths[outcome.content_key] = outcome.path
+	return outcome.result
+}
@@ -0,0 +1,276 @@
+module main
+
+import os
+
+// Bytes at the start of a file that detect_language looks at.
+const detect_size = 4 * 1024
+
+// Extensions used by more than one language, with the candidates
+// detect_language chooses from, the one analyzed so far first. Candidates
+// are parser extensions; `verilog` has no parser and is skipped.
+const ambiguous_extensions = {
+	'.h':   ['.cpp', '.c']
+	'.inc': ['.pas', '.php', '.cpp']
+	'.v':   ['.v', 'verilog']
+}
+
+// Markers counted in the lower-cased start of a file to pick between the
+// candidates of an ambiguous extension, with their weight.
+const language_markers = {
+	'.cpp':    {
+		'\nclass ':   2
+		'namespace ': 2
+		'template<':  2
+		'template <': 2
+		'public:':    2
+		'private:':   2
+		'protected:': 2
+		'virtual ':   2
+		'std::':      2
+		'nullptr':    1
+		'constexpr':  1
+		'operator':   1
+		'::':         1
+	}
+	'.c':      {
+		'typedef struct':     2
+		'typedef enum':       2
+		'#ifdef __cplusplus': 3
+		'extern "c"':         1
+	}
+	'.pas':    {
+		'procedure ':     2
+		'function ':      1
+		'begin':          1
+		'end;':           2
+		'{$':             2
+		'implementation': 3
+		'unit ':          1
+	}
+	'.php':    {
+		'<?php':   10
+		'<?=':     10
+		'$this->': 2
+	}
+	'.v':      {
+		'fn ':     3
+		'pub ':    2
+		'import ': 2
+		'mut ':    2
+		':= ':     1
+		'struct ': 1
+	}
+	'verilog': {
+		'endmodule':  5
+		'`timescale': 5
+		'always @':   3
+		'posedge':    2
+		'negedge':    2
+		'endcase':    2
+		'assign ':    2
+		'`define':    2
+		'wire ':      1
+		'reg ':       1
+	}
+}
+
+// Interpreters named by a shebang line, without version suffixes.
+const interpreter_languages = {
+	'python':  '.py'
+	'pypy':    '.py'
+	'ruby':    '.rb'
+	'jruby':   '.rb'
+	'node':    '.js'
+	'nodejs':  '.js'
+	'bun':     '.js'
+	'deno':    '.ts'
+	'ts-node': '.ts'
+	'lua':     '.lua'
+	'luajit':  '.lua'
+	'php':     '.php'
+	'kotlin':  '.kts'
+	'scala':   '.scala'
+	'swift':   '.swift'
+	'dart':    '.dart'
+	'rdmd':    '.d'
+	'v':       '.v'
+}
+
+// Language names used in Emacs and Vim modelines. An empty extension is a
+// language without a parser.
+const modeline_languages = {
+	'python':        '.py'
+	'ruby':          '.rb'
+	'javascript':    '.js'
+	'js':            '.js'
+	'typescript':    '.ts'
+	'java':          '.java'
+	'rust':          '.rs'
+	'c':             '.c'
+	'cpp':           '.cpp'
+	'c++':           '.cpp'
+	'csharp':        '.cs'
+	'cs':            '.cs'
+	'dart':          '.dart'
+	'd':             '.d'
+	'lua':           '.lua'
+	'pascal':        '.pas'
+	'delphi':        '.pas'
+	'swift':         '.swift'
+	'go':            '.go'
+	'v':             '.v'
+	'vlang':         '.v'
+	'kotlin':        '.kt'
+	'scala':         '.scala'
+	'php':           '.php'
+	'zig':           '.zig'
+	'verilog':       ''
+	'systemverilog': ''
+}
+
+// needs_detection reports whether the parser for files with extension
+// `ext` is chosen from their content: extension-less scripts and the
+// ambiguous extensions, unless a custom language claims the extension.
+fn (a &Analyzer) needs_detection(ext string) bool {
+	if ext.len == 0 {
+		return true
+	}
+	if ext !in ambiguous_extensions {
+		return false
+	}
+	return !a.rules.any(it.extension == ext)
+}
+
+// detect_language picks the parser extension for a file with extension
+// `ext` from its first detect_size bytes: a shebang line first, then a
+// modeline, then (for ambiguous extensions) the language whose markers
+// score highest. Files that are not in a supported language, or not in
+// the one selected with --lang, are skipped.
+fn (a &Analyzer) detect_language(ext string, content string) !string {
+	head := if content.len > detect_size { content[..detect_size] } else { content }
+	mut language := ''
+	if head.starts_with('#!') {
+		line_end := head.index_u8(`\n`)
+		interpreter := shebang_interpreter(if line_end < 0 { head } else { head[..line_end] })
+		language = interpreter_languages[interpreter] or { '' }
+		if language.len == 0 && ext.len == 0 {
+			return SkippedFile{
+				reason: 'script for ${interpreter}, which has no parser'
+			}
+		}
+	}
+	if language.len == 0 {
+		if name := modeline_name(head) {
+			language = modeline_languages[name] or { '' }
+			if language.len == 0 {
+				return SkippedFile{
+					reason: 'modeline names ${name}, which has no parser'
+				}
+			}
+		}
+	}
+	if language.len == 0 {
+		candidates := ambiguous_extensions[ext] or {
+			return SkippedFile{
+				reason: 'no shebang or modeline naming a supported language'
+			}
+		}
+		language = best_candidate(candidates, head.to_lower())
+		if language == 'verilog' {
+			return SkippedFile{
+				reason: 'Verilog source, which has no parser'
+			}
+		}
+	}
+
+	a.check_language(language)!
+	return language
+}
+
+// check_language fails with a SkippedFile unless `language`, detected now
+// or on an earlier run, has a parser and is allowed by --lang.
+fn (a &Analyzer) check_language(language string) ! {
+	if language !in a.parsers_map {
+		return SkippedFile{
+			reason: 'detected as ${language}, which has no parser'
+		}
+	}
+	if a.lang_extensions.len > 0 && language !in a.lang_extensions {
+		return SkippedFile{
+			reason: 'detected as ${language}, not the selected language'
+		}
+	}
+}
+
+// shebang_interpreter returns the interpreter a `#!` line runs, looking
+// past `env` and its options, without a version suffix (`python3.12` is
+// `python`).
+fn shebang_interpreter(line string) string {
+	words := line[2..].fields()
+	if words.len == 0 {
+		return ''
+	}
+	mut interpreter := os.base(words[0])
+	if interpreter == 'env' {
+		interpreter = ''
+		for word in words[1..] {
+			if !word.starts_with('-') && !word.contains('=') {
+				interpreter = os.base(word)
+				break
+			}
+		}
+	}
+	return interpreter.trim_right('0123456789.')
+}
+
+// modeline_name returns the lower-cased language of an Emacs
+// (`-*- mode: ruby -*-`) or Vim (`vim: set ft=python:`) modeline in the
+// first lines of `head`.
+fn modeline_name(head string) ?string {
+	for line in head.split_nth('\n', 6)#[..5] {
+		if start := line.index('-*-') {
+			rest := line[start + 3..]
+			end := rest.index('-*-') or { continue }
+			spec := rest[..end].trim_space().to_lower()
+			if !spec.contains(':') {
+				return spec
+			}
+			for part in spec.split(';') {
+				kv := part.split_nth(':', 2)
+				if kv.len == 2 && kv[0].trim_space() == 'mode' {
+					return kv[1].trim_space()
+				}
+			}
+			continue
+		}
+		for marker in ['vim:', 'vi:', 'ex:'] {
+			at := line.index(marker) or { continue }
+			for setting in line[at + marker.len..].replace(':', ' ').fields() {
+				kv := setting.split_nth('=', 2)
+				if kv.len == 2 && kv[0] in ['ft', 'filetype', 'syntax'] {
+					return kv[1].to_lower()
+				}
+			}
+		}
+	}
+	return none
+}
+
+// best_candidate returns the candidate whose markers score highest in
+// `text`; ties go to the earlier candidate.
+fn best_candidate(candidates []string, text string) string {
+	mut best := candidates[0]
+	mut best_score := 0
+	for candidate in candidates {
+		markers := language_markers[candidate] or { continue }
+		mut score := 0
+		for marker, weight in markers {
+			score += text.count(marker) * weight
+		}
+		if score > best_score {
+			best = candidate
+			best_score = score
+		}
+	}
+	return best
+}
@@ -0,0 +1,89 @@
+module main
+
+import os
+
+// Extensions selected by each --lang name. They must stay a subset of what
+// the registered parsers handle.
+const language_extensions = {
+	'python':     ['.py']
+	'javascript': ['.js', '.jsx']
+	'typescript': ['.ts', '.tsx']
+	'java':       ['.java']
+	'rust':       ['.rs']
+	'cpp':        ['.cpp', '.cc', '.cxx', '.hpp', '.h', '.hxx']
+	'csharp':     ['.cs']
+	'dart':       ['.dart']
+	'c':          ['.c']
+	'd':          ['.d']
+	'lua':        ['.lua']
+	'pascal':     ['.pas', '.pp', '.inc']
+	'swift':      ['.swift']
+	'ruby':       ['.rb']
+	'go':         ['.go']
+	'v':          ['.v', '.vv']
+	'kotlin':     ['.kt', '.kts']
+	'scala':      ['.scala']
+	'php':        ['.php']
+	'zig':        ['.zig']
+}
+
+// Other spellings accepted by --lang.
+const language_aliases = {
+	'py':     'python'
+	'js':     'javascript'
+	'ts':     'typescript'
+	'rs':     'rust'
+	'c++':    'cpp'
+	'cs':     'csharp'
+	'c#':     'csharp'
+	'rb':     'ruby'
+	'golang': 'go'
+	'vlang':  'v'
+	'kt':     'kotlin'
+}
+
+// set_language restricts analysis to the files of one language: a built-in
+// language name or alias, or the extension of a custom language (with or
+// without the dot). An empty name selects every supported language.
+pub fn (mut a Analyzer) set_language(lang string) ! {
+	a.target_lang = lang
+	a.lang_extensions = map[string]bool{}
+	if lang.len == 0 {
+		return
+	}
+
+	mut name := lang.to_lower()
+	for rules in a.rules {
+		if rules.extension == name || rules.extension == '.' + name {
+			a.lang_extensions[rules.extension] = true
+			return
+		}
+	}
+	name = language_aliases[name] or { name }
+	extensions := language_extensions[name] or {
+		return error('Unsupported language: ${lang}')
+	}
+	for ext in extensions {
+		a.lang_extensions[ext] = true
+	}
+}
+
+// wants_file is the dispatch check applied during the walk, before a file
+// is ever opened: only extensions with a registered parser (and of the
+// selected language, if any) are analyzed. Executable files without an
+// extension are taken too, and so are ambiguous extensions that may turn
+// out to be the selected language; their content decides, see detect.v.
+fn (a &Analyzer) wants_file(file_path string) bool {
+	ext := os.file_ext(file_path)
+	if ext.len == 0 {
+		return os.is_executable(file_path)
+	}
+	if ext !in a.parsers_map {
+		return false
+	}
+	if a.lang_extensions.len == 0 || ext in a.lang_extensions {
+		return true
+	}
+	candidates := ambiguous_extensions[ext] or { return false }
+	return a.needs_detection(ext) && candidates.any(it in a.lang_extensions)
+}
@@ -0,0 +1,463 @@
+module main
+
+import os
+
+// ResultFormat selects how OutputWriter encodes results (--format).
+pub enum ResultFormat {
+	text   // human-readable listing, one line per element
+	jsonl  // one JSON object per element
+	binary // fixed-width records and a string table, see below
+}
+
+pub fn parse_result_format(name string) !ResultFormat {
+	return match name {
+		'text', 'txt' { .text }
+		'jsonl', 'json-lines', 'ndjson' { .jsonl }
+		'binary', 'bin' { .binary }
+		else { error('unknown output format: ${name} (expected text, jsonl or binary)') }
+	}
+}
+
+// write_json_string writes `s` as a quoted JSON string.
+fn write_json_string(mut b OutputBuffer, s string) {
+	b.write_u8(`"`)
+	mut start := 0
+	for i in 0 .. s.len {
+		c := s[i]
+		if c >= 0x20 && c != `"` && c != `\\` {
+			continue
+		}
+		if i > start {
+			unsafe { b.data.push_many(s.str + start, i - start) }
+		}
+		match c {
+			`"` { b.write_string('\\"') }
+			`\\` { b.write_string('\\\\') }
+			`\n` { b.write_string('\\n') }
+			`\r` { b.write_string('\\r') }
+			`\t` { b.write_string('\\t') }
+			else {
+				b.write_string('\\u00')
+				b.write_u8(hex_digits[c >> 4])
+				b.write_u8(hex_digits[c & 0xf])
+			}
+		}
+		start = i + 1
+	}
+	if s.len > start {
+		unsafe { b.data.push_many(s.str + start, s.len - start) }
+	}
+	b.write_u8(`"`)
+}
+
+const hex_digits = '0123456789abcdef'
+
+// write_jsonl_element writes one element as a JSON Lines record, see
+// write_json_element.
+fn write_jsonl_element(mut b OutputBuffer, file_path string, line_number int, access string, kind string, name string, parent string, doc string) {
+	write_json_element(mut b, file_path, line_number, access, kind, name, parent, doc)
+	b.write_u8(`\n`)
+}
+
+// write_json_element writes one element as a JSON object:
+// {"file":..,"line":..,"kind":..,"access":..,"name":..,"parent":..,"doc":..}
+fn write_json_element(mut b OutputBuffer, file_path string, line_number int, access string, kind string, name string, parent string, doc string) {
+	b.write_string('{"file":')
+	write_json_string(mut b, file_path)
+	b.write_string(',"line":')
+	b.write_int(line_number)
+	b.write_string(',"kind":')
+	write_json_string(mut b, kind)
+	b.write_string(',"access":')
+	write_json_string(mut b, access)
+	b.write_string(',"name":')
+	write_json_string(mut b, name)
+	b.write_string(',"parent":')
+	write_json_string(mut b, parent)
+	b.write_string(',"doc":')
+	write_json_string(mut b, doc)
+	b.write_u8(`}`)
+}
+
+// Binary format (--format binary). All integers are little-endian and
+// every section is 4-byte aligned, so a reader can map the file and use it
+// in place:
+//
+//   header    binary_header_size bytes, see BinaryHeader
+//   records   element_count x binary_record_size bytes:
+//             u32 file, u32 line, u16 kind, u16 access,
+//             u32 name, u32 parent, u32 doc
+//   files     file_count x 12 bytes: u32 path, u32 first record, u32 count
+//   kinds     kind_count x u32 string
+//   access    access_count x u32 string
+//   strings   each string is a u32 byte length followed by the bytes,
+//             padded to 4 bytes; offset 0 is the empty string
+//   [index]   only when the header's flags has binary_flag_indexed
+//   [shard]   only when the header's flags has binary_flag_sharded
+//
+// String fields hold offsets into the strings section; kind and access
+// hold indexes into the kinds and access tables. Records are grouped by
+// file, in output order. Strings are deduplicated. A file collapsed by
+// --collapse-duplicates has no records of its own: its entry shares the
+// record range of the earlier file with the same content.
+const binary_magic = 'CODEANLZ'
+const binary_version = u32(1)
+const binary_header_size = 88
+const binary_record_size = 24
+const binary_file_entry_size = 12
+const binary_header_flags_offset = 28
+
+// Header flag set by `code-analyzer index`: a symbol index follows the
+// strings section (see index.v).
+const binary_flag_indexed = u32(1)
+
+// Header flag set by --shard runs: the shard section follows the strings
+// section (see shard.v).
+const binary_flag_sharded = u32(2)
+
+// BinaryHeader is the decoded header of a binary output file.
+pub struct BinaryHeader {
+pub mut:
+	version        u32
+	record_size    u32
+	file_count     u32
+	kind_count     u32
+	access_count   u32
+	flags          u32
+	element_count  u64
+	records_offset u64
+	files_offset   u64
+	kinds_offset   u64
+	access_offset  u64
+	strings_offset u64
+	strings_size   u64
+}
+
+// BinaryEncoder accumulates the tables written after the records. Records
+// themselves are streamed through the OutputWriter's buffer.
+struct BinaryEncoder {
+mut:
+	strings       []u8 = []u8{len: 4} // offset 0: the empty string
+	string_ids    map[string]u32
+	kinds         Interner
+	access        Interner
+	files         []u8
+	file_count    u32
+	element_count u64
+	current_file  u32
+	file_first    u64
+	file_ids      map[u32]u32 // path string -> file, for write_duplicate
+}
+
+@[inline]
+fn put_u16(mut data []u8, v u16) {
+	data << u8(v)
+	data << u8(v >> 8)
+}
+
+@[inline]
+fn put_u32(mut data []u8, v u32) {
+	data << u8(v)
+	data << u8(v >> 8)
+	data << u8(v >> 16)
+	data << u8(v >> 24)
+}
+
+fn put_u64(mut data []u8, v u64) {
+	put_u32(mut data, u32(v))
+	put_u32(mut data, u32(v >> 32))
+}
+
+// string_ref returns the strings-section offset of `s`, adding it on first
+// use.
+fn (mut e BinaryEncoder) string_ref(s string) !u32 {
+	if s.len == 0 {
+		return 0
+	}
+	if offset := e.string_ids[s] {
+		return offset
+	}
+	if u64(e.strings.len) + u64(s.len) + 8 > u64(max_u32) {
+		return error('binary output string table exceeds 4 GiB')
+	}
+	offset := u32(e.strings.len)
+	put_u32(mut e.strings, u32(s.len))
+	unsafe { e.strings.push_many(s.str, s.len) }
+	for e.strings.len % 4 != 0 {
+		e.strings << 0
+	}
+	e.string_ids[s.clone()] = offset
+	return offset
+}
+
+fn (mut e BinaryEncoder) begin_file(path string) ! {
+	e.current_file = e.file_count
+	e.file_first = e.element_count
+	path_ref := e.string_ref(path)!
+	put_u32(mut e.files, path_ref)
+	e.file_ids[path_ref] = e.file_count
+	e.file_count++
+}
+
+// write_duplicate adds a file entry for `path` with the records of the
+// file `first`, written earlier.
+fn (mut e BinaryEncoder) write_duplicate(path string, first string) ! {
+	file := e.file_ids[e.string_ref(first)!] or {
+		return error('${path} is a duplicate of ${first}, which was not written')
+	}
+	entry := int(file) * binary_file_entry_size
+	range := e.files[entry + 4..entry + binary_file_entry_size].clone()
+	put_u32(mut e.files, e.string_ref(path)!)
+	e.files << range
+	e.file_count++
+}
+
+fn (mut e BinaryEncoder) end_file() {
+	put_u32(mut e.files, u32(e.file_first))
+	put_u32(mut e.files, u32(e.element_count - e.file_first))
+}
+
+// write_record appends one element record to `b`.
+fn (mut e BinaryEncoder) write_record(mut b OutputBuffer, line_number int, access string, kind string, name string, parent string, doc string) ! {
+	kind_id := e.kinds.intern(kind)
+	access_id := e.access.intern(access)
+	if kind_id > max_u16 || access_id > max_u16 {
+		return error('binary output supports at most 65536 kinds and access modifiers')
+	}
+	if e.element_count >= u64(max_u32) {
+		return error('binary output supports at most ${max_u32} elements')
+	}
+	put_u32(mut b.data, e.current_file)
+	put_u32(mut b.data, u32(line_number))
+	put_u16(mut b.data, u16(kind_id))
+	put_u16(mut b.data, u16(access_id))
+	put_u32(mut b.data, e.string_ref(name)!)
+	put_u32(mut b.data, e.string_ref(parent)!)
+	put_u32(mut b.data, e.string_ref(doc)!)
+	e.element_count++
+}
+
+// finish returns the tables that follow the records, which the strings
+// section follows in turn, and the header.
+fn (mut e BinaryEncoder) finish() !([]u8, []u8) {
+	mut h := BinaryHeader{
+		version:        binary_version
+		record_size:    binary_record_size
+		file_count:     e.file_count
+		kind_count:     u32(e.kinds.names.len)
+		access_count:   u32(e.access.names.len)
+		element_count:  e.element_count
+		records_offset: binary_header_size
+	}
+	h.files_offset = h.records_offset + e.element_count * binary_record_size
+	h.kinds_offset = h.files_offset + u64(e.files.len)
+
+	mut tables := []u8{cap: e.files.len + 4 * (e.kinds.names.len + e.access.names.len)}
+	tables << e.files
+	for kind in e.kinds.names {
+		put_u32(mut tables, e.string_ref(kind)!)
+	}
+	h.access_offset = h.kinds_offset + u64(4 * e.kinds.names.len)
+	for access in e.access.names {
+		put_u32(mut tables, e.string_ref(access)!)
+	}
+	h.strings_offset = h.access_offset + u64(4 * e.access.names.len)
+	h.strings_size = u64(e.strings.len)
+
+	return tables, encode_binary_header(h)
+}
+
+fn encode_binary_header(h BinaryHeader) []u8 {
+	mut data := []u8{cap: binary_header_size}
+	data << binary_magic.bytes()
+	put_u32(mut data, h.version)
+	put_u32(mut data, h.record_size)
+	put_u32(mut data, h.file_count)
+	put_u32(mut data, h.kind_count)
+	put_u32(mut data, h.access_count)
+	put_u32(mut data, h.flags)
+	put_u64(mut data, h.element_count)
+	put_u64(mut data, h.records_offset)
+	put_u64(mut data, h.files_offset)
+	put_u64(mut data, h.kinds_offset)
+	put_u64(mut data, h.access_offset)
+	put_u64(mut data, h.strings_offset)
+	put_u64(mut data, h.strings_size)
+	return data
+}
+
+// BinaryIndex is a loaded binary output file. Nothing is decoded up front:
+// the accessors read records and strings straight from `data`, and the
+// strings they return are views into it.
+pub struct BinaryIndex {
+pub:
+	header     BinaryHeader
+	data       []u8 // inflated when the file is compressed
+	compressed bool // the file is compressed, see compression.v
+}
+
+// BinaryElement is one decoded record.
+pub struct BinaryElement {
+pub:
+	file   u32
+	line   u32
+	kind   u16
+	access u16
+	name   u32
+	parent u32
+	doc    u32
+}
+
+@[inline]
+fn get_u16(data []u8, pos u64) u16 {
+	i := int(pos)
+	return u16(data[i]) | (u16(data[i + 1]) << 8)
+}
+
+@[inline]
+fn get_u32(data []u8, pos u64) u32 {
+	i := int(pos)
+	return u32(data[i]) | (u32(data[i + 1]) << 8) | (u32(data[i + 2]) << 16) | (u32(data[i + 3]) << 24)
+}
+
+@[inline]
+fn get_u64(data []u8, pos u64) u64 {
+	return u64(get_u32(data, pos)) | (u64(get_u32(data, pos + 4)) << 32)
+}
+
+// binary_strings_end returns where the strings section of `h` ends, or
+// none when the section offsets do not follow from the counts. Every sum
+// is checked, so a crafted header cannot wrap around to pass.
+fn binary_strings_end(h BinaryHeader) ?u64 {
+	files := checked_add(h.records_offset, checked_mul(h.element_count, u64(binary_record_size))?)?
+	kinds := checked_add(files, u64(h.file_count) * binary_file_entry_size)?
+	access := checked_add(kinds, u64(h.kind_count) * 4)?
+	strings := checked_add(access, u64(h.access_count) * 4)?
+	if h.files_offset != files || h.kinds_offset != kinds || h.access_offset != access
+		|| h.strings_offset != strings {
+		return none
+	}
+	return checked_add(strings, h.strings_size)
+}
+
+fn checked_add(a u64, b u64) ?u64 {
+	if a > max_u64 - b {
+		return none
+	}
+	return a + b
+}
+
+fn checked_mul(a u64, b u64) ?u64 {
+	if a != 0 && b > max_u64 / a {
+		return none
+	}
+	return a * b
+}
+
+// load_binary_index reads a binary output file and checks that its header
+// and section bounds are consistent.
+pub fn load_binary_index(path string) !BinaryIndex {
+	raw := os.read_bytes(path) or { return error('cannot read ${path}: ${err}') }
+	compressed := is_compressed(raw)
+	data := if compressed {
+		decompress_members(raw) or { return error('cannot read ${path}: ${err}') }
+	} else {
+		raw
+	}
+	if data.len < binary_header_size || data[..8].bytestr() != binary_magic {
+		return error('${path} is not a code-analyzer binary file')
+	}
+	h := BinaryHeader{
+		version:        get_u32(data, 8)
+		record_size:    get_u32(data, 12)
+		file_count:     get_u32(data, 16)
+		kind_count:     get_u32(data, 20)
+		access_count:   get_u32(data, 24)
+		flags:          get_u32(data, binary_header_flags_offset)
+		element_count:  get_u64(data, 32)
+		records_offset: get_u64(data, 40)
+		files_offset:   get_u64(data, 48)
+		kinds_offset:   get_u64(data, 56)
+		access_offset:  get_u64(data, 64)
+		strings_offset: get_u64(data, 72)
+		strings_size:   get_u64(data, 80)
+	}
+	if h.version != binary_version || h.record_size != binary_record_size {
+		return error('${path}: unsupported binary format version ${h.version}')
+	}
+	strings_end := binary_strings_end(h) or { max_u64 }
+	if h.records_offset != binary_header_size || strings_end > u64(data.len) {
+		return error('${path}: corrupt binary file (section table does not match the file size)')
+	}
+	if h.flags & (binary_flag_indexed | binary_flag_sharded) == 0 && strings_end != u64(data.len) {
+		return error('${path}: corrupt binary file (unexpected data after the strings section)')
+	}
+	// Readers take a file's record range as is, so check them all once
+	for file in 0 .. h.file_count {
+		entry := h.files_offset + u64(file) * binary_file_entry_size
+		if u64(get_u32(data, entry + 4)) + u64(get_u32(data, entry + 8)) > h.element_count {
+			return error('${path}: corrupt binary file (file ${file} has records past the end)')
+		}
+	}
+	return BinaryIndex{
+		header:     h
+		data:       data
+		compressed: compressed
+	}
+}
+
+// The accessors check every reference against the header, which
+// load_binary_index validated: a corrupt record yields empty strings, not
+// a read past its section.
+
+// element returns record `i`, or an empty element when there is none.
+pub fn (x &BinaryIndex) element(i u64) BinaryElement {
+	if i >= x.header.element_count {
+		return BinaryElement{}
+	}
+	pos := x.header.records_offset + i * binary_record_size
+	return BinaryElement{
+		file:   get_u32(x.data, pos)
+		line:   get_u32(x.data, pos + 4)
+		kind:   get_u16(x.data, pos + 8)
+		access: get_u16(x.data, pos + 10)
+		name:   get_u32(x.data, pos + 12)
+		parent: get_u32(x.data, pos + 16)
+		doc:    get_u32(x.data, pos + 20)
+	}
+}
+
+// string_at returns the string at `offset` of the strings section, or ''
+// when it does not lie within the section.
+pub fn (x &BinaryIndex) string_at(offset u32) string {
+	if u64(offset) + 4 > x.header.strings_size {
+		return ''
+	}
+	pos := x.header.strings_offset + offset
+	len := get_u32(x.data, pos)
+	if len == 0 || u64(offset) + 4 + len > x.header.strings_size {
+		return ''
+	}
+	return unsafe { tos(&x.data[int(pos) + 4], int(len)) }
+}
+
+pub fn (x &BinaryIndex) file_path(file u32) string {
+	if file >= x.header.file_count {
+		return ''
+	}
+	return x.string_at(get_u32(x.data, x.header.files_offset + u64(file) * binary_file_entry_size))
+}
+
+pub fn (x &BinaryIndex) kind_name(kind u16) string {
+	if u32(kind) >= x.header.kind_count {
+		return ''
+	}
+	return x.string_at(get_u32(x.data, x.header.kinds_offset + u64(kind) * 4))
+}
+
+pub fn (x &BinaryIndex) access_name(access u16) string {
+	if u32(access) >= x.header.access_count {
+		return ''
+	}
+	return x.string_at(get_u32(x.data, x.header.access_offset + u64(access) * 4))
+}
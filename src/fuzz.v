@@ -0,0 +1,359 @@
+module main
+
+import os
+import flag
+import time
+
+// `code-analyzer fuzz` feeds every parser mutated copies of its sample in
+// test/sample_code, aimed at the inputs that stall regex-based parsers:
+// very long lines, files without line breaks, long comment runs above a
+// declaration, deep nesting, unterminated comments and strings. Each parse
+// must stay within a time and a memory budget per MB of input; the worst
+// inputs are reported and every input over budget is saved for replay. A
+// parse still running after fuzz_stall_factor times its time budget is
+// abandoned: its input is saved and the harness exits.
+
+// Inputs smaller than this are budgeted as if they had this size, so timer
+// and allocator noise on small inputs does not trip the budget.
+const fuzz_min_budget_bytes = 64 * 1024
+const fuzz_stall_factor = 10
+const fuzz_worst_cases = 10
+
+// Mutations, applied in turn; see mutate.
+const fuzz_mutations = ['long-line', 'no-newlines', 'comment-run', 'doc-block', 'deep-nesting',
+	'long-token', 'unterminated', 'repeat-line', 'byte-flip', 'truncate', 'splice']
+
+// Openers left unterminated by the `unterminated` mutation.
+const fuzz_openers = ['/*', '/**', '"', "'", '`', '"""', "'''", '{-', '(*', '{', '--[[', '=begin\n',
+	'<?php', '#[', 'r#"', '<<<EOT\n']
+
+struct FuzzOptions {
+mut:
+	samples    string
+	iterations int
+	size_kib   int
+	seed       u64
+	ms_per_mb  int
+	mem_per_mb int
+	out        string
+}
+
+// FuzzRng is a xorshift64* generator, so that a run is reproducible from
+// its seed.
+struct FuzzRng {
+mut:
+	state u64
+}
+
+fn (mut r FuzzRng) next() u64 {
+	r.state ^= r.state >> 12
+	r.state ^= r.state << 25
+	r.state ^= r.state >> 27
+	return r.state * 0x2545f4914f6cdd1d
+}
+
+// intn returns a number in [0, n).
+fn (mut r FuzzRng) intn(n int) int {
+	if n <= 0 {
+		return 0
+	}
+	return int(r.next() % u64(n))
+}
+
+// FuzzCase is one mutated input, handed to the fuzz worker.
+struct FuzzCase {
+	name    string
+	ext     string
+	content string
+}
+
+// FuzzRun is what the fuzz worker measured for one case.
+struct FuzzRun {
+	parse_ns i64
+	peak_kib i64 // growth of the peak RSS during the parse; 0 where unknown
+	elements int
+}
+
+// FuzzResult is one measured case, scaled per MB of input.
+struct FuzzResult {
+	sample     string
+	mutation   string
+	iteration  int
+	bytes      int
+	ms_per_mb  f64
+	mem_per_mb f64
+	over       bool
+}
+
+// run_fuzz implements `code-analyzer fuzz`. It exits with status 1 when an
+// input is over budget and 2 when a parse stalls.
+fn run_fuzz(argv []string) {
+	opts := parse_fuzz_arguments(argv)
+	samples := load_bench_samples(opts.samples) or {
+		eprintln('Error: ${err}')
+		exit(1)
+	}
+	target := opts.size_kib * 1024
+	seed := if opts.seed != 0 { opts.seed } else { u64(time.now().unix_nano()) | 1 }
+	mut rng := FuzzRng{
+		state: seed
+	}
+
+	cases := chan FuzzCase{}
+	runs := chan FuzzRun{}
+	spawn fuzz_worker(cases, runs)
+
+	println('Fuzzing ${samples.len} parsers with ${opts.iterations} inputs each (${opts.size_kib} KiB, --seed ${seed})')
+	println('Budget per MB of input: ${opts.ms_per_mb} ms, ${opts.mem_per_mb} MB')
+	println('sample                        worst ms/MB mutation        worst MB/MB mutation       over')
+	mut results := []FuzzResult{}
+	mut over := 0
+	for sample in samples {
+		base := scale_sample(sample.content, target)
+		mut slowest := FuzzResult{}
+		mut largest := FuzzResult{}
+		mut sample_over := 0
+		for i in 0 .. opts.iterations {
+			mutation := fuzz_mutations[i % fuzz_mutations.len]
+			content := mutate(mutation, base, sample.ext, mut rng, samples)
+			budget_mb := f64(if content.len > fuzz_min_budget_bytes {
+				content.len
+			} else {
+				fuzz_min_budget_bytes
+			}) / (1024.0 * 1024.0)
+			stall_ms := i64(f64(opts.ms_per_mb) * budget_mb * fuzz_stall_factor) + 1000
+
+			cases <- FuzzCase{
+				name:    sample.name
+				ext:     sample.ext
+				content: content
+			}
+			mut run := FuzzRun{}
+			select {
+				r := <-runs {
+					run = r
+				}
+				stall_ms * time.millisecond {
+					path := save_fuzz_input(opts.out, sample, mutation, i, content)
+					eprintln('STALL: ${sample.name} ${mutation} #${i} (${content.len} bytes) still parsing after ${stall_ms} ms; input saved to ${path}')
+					exit(2)
+				}
+			}
+
+			ms_per_mb := ms(run.parse_ns) / budget_mb
+			mem_per_mb := f64(run.peak_kib) / 1024.0 / budget_mb
+			result := FuzzResult{
+				sample:     sample.name
+				mutation:   mutation
+				iteration:  i
+				bytes:      content.len
+				ms_per_mb:  ms_per_mb
+				mem_per_mb: mem_per_mb
+				over:       ms_per_mb > f64(opts.ms_per_mb)
+					|| (opts.mem_per_mb > 0 && mem_per_mb > f64(opts.mem_per_mb))
+			}
+			if result.over {
+				sample_over++
+				path := save_fuzz_input(opts.out, sample, mutation, i, content)
+				eprintln('OVER BUDGET: ${sample.name} ${mutation} #${i}: ${result.ms_per_mb:.0f} ms/MB, ${result.mem_per_mb:.0f} MB/MB; input saved to ${path}')
+			}
+			if result.ms_per_mb > slowest.ms_per_mb {
+				slowest = result
+			}
+			if result.mem_per_mb > largest.mem_per_mb {
+				largest = result
+			}
+			results << result
+		}
+		over += sample_over
+		println('${sample.name:-28} ${slowest.ms_per_mb:12.1f} ${slowest.mutation:-14} ${largest.mem_per_mb:12.1f} ${largest.mutation:-14} ${sample_over}')
+	}
+	cases.close()
+
+	results.sort(a.ms_per_mb > b.ms_per_mb)
+	println('\nWorst inputs by time (reproduce with the same --seed, --size and --iterations):')
+	for result in results#[..fuzz_worst_cases] {
+		println('  ${result.ms_per_mb:10.1f} ms/MB ${result.mem_per_mb:8.1f} MB/MB  ${result.sample} ${result.mutation} #${result.iteration} (${result.bytes} bytes)')
+	}
+	if over > 0 {
+		eprintln('\n${over} input(s) over budget, saved in ${opts.out}')
+		exit(1)
+	}
+}
+
+fn parse_fuzz_arguments(argv []string) FuzzOptions {
+	mut fp := flag.new_flag_parser(argv)
+	fp.application('code-analyzer fuzz')
+	fp.description('Check parsers against time and memory budgets on mutated samples')
+	fp.skip_executable()
+
+	mut opts := FuzzOptions{}
+	opts.samples = fp.string('samples', `s`, 'test/sample_code', 'Directory with one seed file per language')
+	opts.iterations = fp.int('iterations', 0, 2 * fuzz_mutations.len, 'Mutated inputs per sample')
+	opts.size_kib = fp.int('size', 0, 256, 'Size of each sample before mutation, in KiB')
+	opts.seed = fp.string('seed', 0, '0', 'Seed of the mutations (0 = from the clock)').u64()
+	opts.ms_per_mb = fp.int('budget-ms', 0, 2000, 'Parse time budget per MB of input')
+	opts.mem_per_mb = fp.int('budget-mem', 0, 256, 'Peak memory growth budget in MB per MB of input (0 = none)')
+	opts.out = fp.string('out', `o`, 'fuzz-failures', 'Directory for inputs over budget')
+
+	fp.finalize() or {
+		eprintln('Error parsing arguments: ${err}')
+		println(fp.usage())
+		exit(1)
+	}
+	if opts.iterations <= 0 {
+		opts.iterations = 1
+	}
+	if opts.size_kib <= 0 {
+		opts.size_kib = 1
+	}
+	if opts.ms_per_mb <= 0 {
+		opts.ms_per_mb = 1
+	}
+	return opts
+}
+
+// fuzz_worker parses the cases it is sent with its own parsers, which stay
+// warm from one case to the next, and measures each parse.
+fn fuzz_worker(cases chan FuzzCase, runs chan FuzzRun) {
+	mut a := new_analyzer()
+	for {
+		c := <-cases or { break }
+		mut parser := a.parsers_map[c.ext] or {
+			runs <- FuzzRun{}
+			continue
+		}
+		gc_collect()
+		reset_peak_rss()
+		before := proc_status_kib('VmRSS')
+		sw := time.new_stopwatch()
+		result := parser.parse(c.content, c.name)
+		parse_ns := sw.elapsed().nanoseconds()
+		peak := proc_status_kib('VmHWM')
+		runs <- FuzzRun{
+			parse_ns: parse_ns
+			peak_kib: if peak > before { peak - before } else { 0 }
+			elements: result.elements.len
+		}
+	}
+}
+
+// mutate returns `content` changed by `mutation`. Insertions go at the
+// start of a random line, so they read as new declarations or comments.
+fn mutate(mutation string, content string, ext string, mut rng FuzzRng, samples []BenchSample) string {
+	pos := line_start(content, rng.intn(content.len))
+	half := content.len / 2
+	match mutation {
+		'long-line' {
+			return content.replace('\n', ' ')
+		}
+		'no-newlines' {
+			return content.replace('\n', '').replace('\r', '')
+		}
+		'comment-run' {
+			line := '${line_comment(ext)} documentation that goes on and on\n'
+			return insert_at(content, pos, line.repeat(half / line.len + 1))
+		}
+		'doc-block' {
+			open, prefix, close := doc_block(ext)
+			line := '${prefix}documentation that goes on and on\n'
+			return insert_at(content, pos, '${open}\n${line.repeat(half / line.len + 1)}${close}\n')
+		}
+		'deep-nesting' {
+			return insert_at(content, pos, '{'.repeat(half / 4) + '('.repeat(half / 4))
+		}
+		'long-token' {
+			return insert_at(content, pos, 'a'.repeat(half))
+		}
+		'unterminated' {
+			return insert_at(content, rng.intn(content.len), fuzz_openers[rng.intn(fuzz_openers.len)])
+		}
+		'repeat-line' {
+			lines := content.split_into_lines()
+			line := lines[rng.intn(lines.len)] + '\n'
+			return insert_at(content, pos, line.repeat(half / line.len + 1))
+		}
+		'byte-flip' {
+			mut bytes := content.bytes()
+			for _ in 0 .. bytes.len / 1000 + 1 {
+				bytes[rng.intn(bytes.len)] = u8(rng.intn(256))
+			}
+			return bytes.bytestr()
+		}
+		'truncate' {
+			return content[..rng.intn(content.len) + 1]
+		}
+		'splice' {
+			other := samples[rng.intn(samples.len)].content
+			start := rng.intn(other.len)
+			end := start + rng.intn(other.len - start) + 1
+			return insert_at(content, rng.intn(content.len), other[start..end])
+		}
+		else {
+			return content
+		}
+	}
+}
+
+// line_start returns the start of the line containing byte `i`.
+fn line_start(s string, i int) int {
+	return (s[..i].last_index('\n') or { -1 }) + 1
+}
+
+fn insert_at(s string, pos int, piece string) string {
+	return s[..pos] + piece + s[pos..]
+}
+
+fn line_comment(ext string) string {
+	return match ext {
+		'.py', '.rb' { '#' }
+		'.lua' { '---' }
+		else { '///' }
+	}
+}
+
+// doc_block returns the opener, line prefix and closer of a block doc
+// comment in the language of `ext`.
+fn doc_block(ext string) (string, string, string) {
+	if ext == '.py' {
+		return '"""', '', '"""'
+	}
+	if ext == '.rb' {
+		return '=begin', '', '=end'
+	}
+	if ext == '.lua' {
+		return '--[[', '', ']]'
+	}
+	if ext == '.pas' {
+		return '{', '  ', '}'
+	}
+	return '/**', ' * ', ' */'
+}
+
+// save_fuzz_input writes a case to `dir` and returns its path.
+fn save_fuzz_input(dir string, sample BenchSample, mutation string, iteration int, content string) string {
+	path := os.join_path(dir, '${sample.name.replace('.', '_')}-${mutation}-${iteration}${sample.ext}')
+	os.mkdir_all(dir) or {
+		eprintln('Warning: cannot create ${dir}: ${err}')
+		return path
+	}
+	os.write_file(path, content) or { eprintln('Warning: cannot write ${path}: ${err}') }
+	return path
+}
+
+// proc_status_kib returns a field of /proc/self/status, such as VmRSS, in
+// KiB, or 0 where there is no such file.
+fn proc_status_kib(field string) i64 {
+	status := os.read_file('/proc/self/status') or { return 0 }
+	for line in status.split_into_lines() {
+		if line.starts_with(field + ':') {
+			return line.all_after(':').trim_space().all_before(' ').i64()
+		}
+	}
+	return 0
+}
+
+// reset_peak_rss restarts VmHWM from the current RSS (Linux 4.0 and later).
+fn reset_peak_rss() {
+	os.write_file('/proc/self/clear_refs', '5') or {}
+}
@@ -0,0 +1,78 @@
+module main
+
+import os
+
+// use_git makes analyze_directory take its file list from git instead of
+// walking `root`: the tracked files plus the untracked ones that are not
+// ignored, so .gitignore is respected. With a non-empty `since` and no
+// cache, only the files changed since that revision are listed; with a
+// cache every file is, as under --git-index, and the cache's stamp check
+// decides which are parsed again.
+pub fn (mut a Analyzer) use_git(root string, since string) ! {
+	if since.starts_with('-') {
+		return error('invalid revision: ${since}')
+	}
+	listed := run_git(root, ['ls-files', '-z', '--cached', '--others', '--exclude-standard'])!
+	// Only needed to narrow the list, since a cache re-checks every file
+	narrow := since.len > 0 && isnil(a.cache)
+	mut changed := map[string]bool{}
+	if narrow {
+		for path in run_git(root, ['diff', '--name-only', '-z', '--relative', since, '--'])! {
+			changed[path] = true
+		}
+		for path in run_git(root, ['ls-files', '-z', '--others', '--exclude-standard'])! {
+			changed[path] = true
+		}
+	}
+
+	a.files = []string{}
+	a.use_file_list = true
+	mut seen := map[string]bool{}
+	// git already applied .gitignore; this adds --exclude, --include and
+	// .codeanalyzerignore
+	mut scopes := map[string]&IgnoreScope{}
+	for rel in listed {
+		// Skip hidden files and directories, like the walk; --cached and
+		// --others both list files with unresolved merge conflicts
+		if rel in seen || rel.split('/').any(it.starts_with('.')) {
+			continue
+		}
+		seen[rel] = true
+		full_path := os.join_path(root, rel)
+		if !a.wants_file(full_path) || !os.is_file(full_path)
+			|| a.path_excluded(root, full_path, false, mut scopes) {
+			continue
+		}
+		// Without a cache there is nothing to reuse the unchanged files from
+		if narrow && rel !in changed {
+			continue
+		}
+		a.files << full_path
+	}
+}
+
+// run_git runs git in `dir` and returns the NUL-separated fields it prints.
+fn run_git(dir string, args []string) ![]string {
+	mut cmd := 'git -C ${os.quoted_path(dir)}'
+	for arg in args {
+		cmd += ' ' + os.quoted_path(arg)
+	}
+	res := os.execute(cmd)
+	if res.exit_code != 0 {
+		return error('git ${args[0]} failed: ${res.output.trim_space()}')
+	}
+	return res.output.split('\0').filter(it.len > 0)
+}
+
+// feed_files sends `files` to `found` and closes it, standing in for
+// walk_tree when the file list comes from git.
+fn feed_files(files []string, found chan FoundFile) i64 {
+	for path in files {
+		found <- FoundFile{
+			path: path
+			size: os.file_size(path)
+		}
+	}
+	found.close()
+	return 0
+}
@@ -0,0 +1,421 @@
+module main
+
+import os
+
+// Ignore files read in every directory the walk visits, unless --no-ignore.
+const ignore_file_names = ['.gitignore', '.codeanalyzerignore']
+
+// IgnoreRule is one line of an ignore file, or one --exclude / --include
+// glob, with gitignore semantics: a pattern without a slash matches the
+// entry name at any depth; one with a slash is anchored to the directory
+// of its ignore file (the root for command-line globs).
+struct IgnoreRule {
+	pattern  string
+	negate   bool // `!pattern` re-includes what an earlier line excluded
+	dir_only bool // `pattern/` matches directories only
+	anchored bool // matched against the relative path instead of the name
+}
+
+// parse_ignore_rule compiles one ignore file line, returning none for
+// blank lines and comments.
+fn parse_ignore_rule(line string) ?IgnoreRule {
+	mut s := line.trim_right('\r')
+	// Trailing spaces are ignored unless escaped
+	for s.len > 0 && s[s.len - 1] == ` ` && !(s.len > 1 && s[s.len - 2] == `\\`) {
+		s = s[..s.len - 1]
+	}
+	if s.len == 0 || s[0] == `#` {
+		return none
+	}
+	negate := s[0] == `!`
+	if negate {
+		s = s[1..]
+	} else if s.starts_with('\\#') || s.starts_with('\\!') {
+		s = s[1..]
+	}
+	dir_only := s.ends_with('/')
+	if dir_only {
+		s = s.trim_right('/')
+	}
+	anchored := s.contains('/')
+	s = s.trim_left('/')
+	if s.len == 0 {
+		return none
+	}
+	return IgnoreRule{
+		pattern:  s
+		negate:   negate
+		dir_only: dir_only
+		anchored: anchored
+	}
+}
+
+// IgnoreSet is a compiled list of rules. Rules are bucketed by shape, so
+// the common ones cost a map lookup per entry rather than a glob match
+// each: literal names (`node_modules`, `target`), extension globs (`*.min`,
+// `*.pyc`) and literal anchored paths (`/build`, `docs/api`). Only the
+// remaining rules are matched as globs. As in git, the last matching rule
+// decides.
+struct IgnoreSet {
+mut:
+	rules    []IgnoreRule
+	names    map[string][]int // rule ids by literal entry name
+	suffixes map[string][]int // rule ids by extension, for `*.ext`
+	paths    map[string][]int // rule ids by literal anchored path
+	globs    []int            // everything else, in order
+}
+
+fn has_glob_meta(s string) bool {
+	for c in s {
+		if c in [`*`, `?`, `[`, `\\`] {
+			return true
+		}
+	}
+	return false
+}
+
+fn (mut s IgnoreSet) add(rule IgnoreRule) {
+	id := s.rules.len
+	s.rules << rule
+	p := rule.pattern
+	if !has_glob_meta(p) {
+		if rule.anchored {
+			s.paths[p] << id
+		} else {
+			s.names[p] << id
+		}
+		return
+	}
+	if !rule.anchored && p.len > 2 && p[0] == `*` && p[1] == `.` && !has_glob_meta(p[1..])
+		&& p[2..].index_u8(`.`) < 0 {
+		s.suffixes[p[1..]] << id
+		return
+	}
+	s.globs << id
+}
+
+fn (mut s IgnoreSet) add_lines(content string) {
+	for line in content.split_into_lines() {
+		rule := parse_ignore_rule(line) or { continue }
+		s.add(rule)
+	}
+}
+
+fn (s &IgnoreSet) is_empty() bool {
+	return s.rules.len == 0
+}
+
+// last_match returns the id of the last rule matching the entry `name`
+// at `rel` (relative to the set's base directory), or -1.
+fn (s &IgnoreSet) last_match(rel string, name string, is_dir bool) int {
+	if s.rules.len == 0 {
+		return -1
+	}
+	mut best := -1
+	if ids := s.names[name] {
+		best = s.last_applicable(ids, is_dir, best)
+	}
+	if s.suffixes.len > 0 {
+		ext := os.file_ext(name)
+		if ext.len > 0 {
+			if ids := s.suffixes[ext] {
+				best = s.last_applicable(ids, is_dir, best)
+			}
+		}
+	}
+	if ids := s.paths[rel] {
+		best = s.last_applicable(ids, is_dir, best)
+	}
+	for i := s.globs.len - 1; i >= 0; i-- {
+		id := s.globs[i]
+		if id <= best {
+			break
+		}
+		rule := s.rules[id]
+		if rule.dir_only && !is_dir {
+			continue
+		}
+		if glob_match(rule.pattern, if rule.anchored { rel } else { name }) {
+			best = id
+			break
+		}
+	}
+	return best
+}
+
+// last_applicable returns the highest id in `ids` above `best` whose rule
+// applies to the entry kind, or `best`.
+fn (s &IgnoreSet) last_applicable(ids []int, is_dir bool, best int) int {
+	for i := ids.len - 1; i >= 0; i-- {
+		id := ids[i]
+		if id <= best {
+			break
+		}
+		if s.rules[id].dir_only && !is_dir {
+			continue
+		}
+		return id
+	}
+	return best
+}
+
+// glob_match reports whether `text` matches the gitignore-style glob
+// `pattern`: `*` and `?` do not match `/`, `**` matches across
+// directories, and `[...]` is a character class (`!` or `^` negates it).
+fn glob_match(pattern string, text string) bool {
+	return glob_match_at(pattern, 0, text, 0)
+}
+
+fn glob_match_at(p string, pstart int, t string, tstart int) bool {
+	mut pi := pstart
+	mut ti := tstart
+	for pi < p.len {
+		c := p[pi]
+		if c == `*` {
+			if pi + 1 < p.len && p[pi + 1] == `*` {
+				rest := pi + 2
+				// `**/` also matches no directory at all
+				if rest < p.len && p[rest] == `/` && glob_match_at(p, rest + 1, t, ti) {
+					return true
+				}
+				for k in ti .. t.len + 1 {
+					if glob_match_at(p, rest, t, k) {
+						return true
+					}
+				}
+				return false
+			}
+			for k in ti .. t.len + 1 {
+				if glob_match_at(p, pi + 1, t, k) {
+					return true
+				}
+				if k < t.len && t[k] == `/` {
+					break
+				}
+			}
+			return false
+		}
+		if ti >= t.len {
+			return false
+		}
+		match c {
+			`?` {
+				if t[ti] == `/` {
+					return false
+				}
+				pi++
+			}
+			`[` {
+				matched, next := match_glob_class(p, pi, t[ti])
+				if next < 0 {
+					// No closing bracket: a literal `[`
+					if t[ti] != `[` {
+						return false
+					}
+					pi++
+				} else if !matched {
+					return false
+				} else {
+					pi = next
+				}
+			}
+			`\\` {
+				if pi + 1 >= p.len || t[ti] != p[pi + 1] {
+					return false
+				}
+				pi += 2
+			}
+			else {
+				if t[ti] != c {
+					return false
+				}
+				pi++
+			}
+		}
+		ti++
+	}
+	return ti == t.len
+}
+
+// match_glob_class matches `c` against the class starting at p[start] ==
+// `[`, returning the result and the index after the closing `]`, or -1 if
+// the class is not closed.
+fn match_glob_class(p string, start int, c u8) (bool, int) {
+	mut i := start + 1
+	negate := i < p.len && (p[i] == `!` || p[i] == `^`)
+	if negate {
+		i++
+	}
+	mut matched := false
+	mut first := true
+	for i < p.len && (p[i] != `]` || first) {
+		first = false
+		lo := p[i]
+		if i + 2 < p.len && p[i + 1] == `-` && p[i + 2] != `]` {
+			if c >= lo && c <= p[i + 2] {
+				matched = true
+			}
+			i += 3
+		} else {
+			if c == lo {
+				matched = true
+			}
+			i++
+		}
+	}
+	if i >= p.len {
+		return false, -1
+	}
+	return matched != negate && c != `/`, i + 1
+}
+
+// IgnoreScope holds the ignore files of one directory and links to the
+// scope of the nearest ancestor that has any. The walk passes scopes down,
+// so rules are compiled once per ignore file.
+struct IgnoreScope {
+	parent &IgnoreScope = unsafe { nil }
+	base   string // directory of the ignore files, relative to the root
+	set    IgnoreSet
+}
+
+// child_rel joins a relative directory and an entry name.
+@[inline]
+fn child_rel(rel string, name string) string {
+	return if rel.len == 0 { name } else { rel + '/' + name }
+}
+
+// enter_dir returns the scope for the directory `dir_path` (at `rel`
+// below the root), compiling its ignore files if the listing has any.
+fn (a &Analyzer) enter_dir(scope &IgnoreScope, dir_path string, rel string, entries []DirEntry) &IgnoreScope {
+	if a.no_ignore_files {
+		return scope
+	}
+	mut found := false
+	for entry in entries {
+		if entry.name in ignore_file_names {
+			found = true
+			break
+		}
+	}
+	if !found {
+		return scope
+	}
+	return load_ignore_scope(scope, dir_path, rel)
+}
+
+fn load_ignore_scope(parent &IgnoreScope, dir_path string, rel string) &IgnoreScope {
+	mut set := IgnoreSet{}
+	for name in ignore_file_names {
+		content := os.read_file(os.join_path(dir_path, name)) or { continue }
+		set.add_lines(content)
+	}
+	if set.is_empty() {
+		return parent
+	}
+	return &IgnoreScope{
+		parent: parent
+		base:   rel
+		set:    set
+	}
+}
+
+// excluded decides whether the walk leaves out the entry `name` at `rel`
+// (relative to the root): --exclude always wins, then the ignore files
+// from the deepest directory up, and files must match --include if given.
+fn (a &Analyzer) excluded(scope &IgnoreScope, rel string, name string, is_dir bool) bool {
+	exclude := a.excludes.last_match(rel, name, is_dir)
+	if exclude >= 0 && !a.excludes.rules[exclude].negate {
+		return true
+	}
+	mut s := scope
+	for !isnil(s) {
+		sub := if s.base.len == 0 { rel } else { rel[s.base.len + 1..] }
+		id := s.set.last_match(sub, name, is_dir)
+		if id >= 0 {
+			if !s.set.rules[id].negate {
+				return true
+			}
+			break
+		}
+		s = s.parent
+	}
+	return !is_dir && !a.includes.is_empty() && a.includes.last_match(rel, name, false) < 0
+}
+
+// path_excluded applies `excluded` to `path` (a directory if `is_dir`) and
+// each directory leading to it from `root`, for paths that do not come
+// from the walk (git lists and --watch). Scopes are memoized in `scopes`
+// by relative directory.
+fn (a &Analyzer) path_excluded(root string, path string, is_dir bool, mut scopes map[string]&IgnoreScope) bool {
+	rel := path_relative_to(root, path)
+	parts := rel.split('/')
+	mut dir_path := root
+	mut dir_rel := ''
+	mut scope := a.scope_of(unsafe { nil }, dir_path, dir_rel, mut scopes)
+	for i, part in parts {
+		last := i == parts.len - 1
+		entry_rel := child_rel(dir_rel, part)
+		if a.excluded(scope, entry_rel, part, !last || is_dir) {
+			return true
+		}
+		if !last {
+			dir_path = os.join_path(dir_path, part)
+			dir_rel = entry_rel
+			scope = a.scope_of(scope, dir_path, dir_rel, mut scopes)
+		}
+	}
+	return false
+}
+
+// scope_for_dir returns the scope the walk would use for the entries of
+// `dir`, a directory below `root`.
+fn (a &Analyzer) scope_for_dir(root string, dir string, mut scopes map[string]&IgnoreScope) &IgnoreScope {
+	mut dir_path := root
+	mut dir_rel := ''
+	mut scope := a.scope_of(unsafe { nil }, dir_path, dir_rel, mut scopes)
+	rel := path_relative_to(root, dir)
+	if rel.len == 0 {
+		return scope
+	}
+	for part in rel.split('/') {
+		dir_path = os.join_path(dir_path, part)
+		dir_rel = child_rel(dir_rel, part)
+		scope = a.scope_of(scope, dir_path, dir_rel, mut scopes)
+	}
+	return scope
+}
+
+fn (a &Analyzer) scope_of(parent &IgnoreScope, dir_path string, rel string, mut scopes map[string]&IgnoreScope) &IgnoreScope {
+	if a.no_ignore_files {
+		return parent
+	}
+	if scope := scopes[rel] {
+		return scope
+	}
+	scope := load_ignore_scope(parent, dir_path, rel)
+	scopes[rel] = scope
+	return scope
+}
+
+// path_relative_to returns `path` relative to `root`, with `/` separators.
+fn path_relative_to(root string, path string) string {
+	mut rel := path
+	if path.starts_with(root) {
+		rel = path[root.len..].trim_left(os.path_separator)
+	}
+	$if windows {
+		rel = rel.replace('\\', '/')
+	}
+	return rel
+}
+
+// add_ignore_globs compiles --exclude or --include globs; each argument
+// may hold several, separated by commas.
+fn add_ignore_globs(mut set IgnoreSet, globs []string) {
+	for arg in globs {
+		for glob in arg.split(',') {
+			rule := parse_ignore_rule(glob.trim_space()) or { continue }
+			set.add(rule)
+		}
+	}
+}
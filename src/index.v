@@ -0,0 +1,380 @@
+module main
+
+import os
+import flag
+import runtime
+
+// The symbol index is a binary output file (see formats.v) with the
+// binary_flag_indexed header flag and two sorted tables after the strings
+// section:
+//
+//   magic     symbol_index_magic
+//   u32       name count, u32 parent count
+//   by name   record ids of every element, ordered by name
+//   by parent record ids of the elements with a parent, ordered by parent
+//
+// Lookups binary-search these tables and read the records in place, so a
+// query never touches the sources and never decodes the whole file.
+const symbol_index_magic = 'CAINDEX1'
+const symbol_index_header_size = 16
+
+struct IndexOptions {
+mut:
+	input     string
+	output    string
+	from      string
+	lang      string
+	config    string
+	jobs      int
+	max_size  int
+	cache_dir string
+	compress  bool
+	verbose   bool
+}
+
+// run_index implements `code-analyzer index`: the tree is analyzed as for
+// `--format binary`, then the symbol tables are appended to the file.
+fn run_index(argv []string) {
+	opts := parse_index_arguments(argv)
+
+	if opts.from.len > 0 {
+		if opts.from != opts.output {
+			os.cp(opts.from, opts.output) or {
+				eprintln('Error: cannot copy ${opts.from}: ${err}')
+				exit(1)
+			}
+		}
+	} else {
+		if !os.is_dir(opts.input) {
+			eprintln('Error: Input path must be a directory: ${opts.input}')
+			exit(1)
+		}
+		mut analyzer := configure_analyzer(opts.config, opts.lang, opts.verbose)
+		if opts.max_size > 0 {
+			analyzer.max_file_size = u64(opts.max_size) * 1024
+		}
+		analyzer.jobs = if opts.jobs > 0 { opts.jobs } else { 1 }
+		analyzer.chunk_jobs = analyzer.jobs
+		analyzer.buffered = true
+		mut progress := ProgressTracker{}
+		progress.init(opts.verbose, 0)
+		if opts.cache_dir.len > 0 {
+			analyzer.cache = load_result_cache(opts.cache_dir, analyzer.rules_fingerprint())
+			analyzer.cache.compress = opts.compress
+			progress.cache_enabled = true
+		}
+
+		mut collector := ResultCollector{}
+		analyzer.analyze_directory(opts.input, mut progress, mut collector) or {
+			eprintln('Error: ${err}')
+			exit(1)
+		}
+		// Compressed, if at all, once the index is added
+		write_output(collector, opts.output, false, .binary, false) or {
+			eprintln('Error writing index: ${err}')
+			exit(1)
+		}
+		collector.free()
+		if !isnil(analyzer.cache) {
+			analyzer.cache.save() or { eprintln('Warning: failed to save cache: ${err}') }
+		}
+		progress.print_summary()
+	}
+
+	x := add_symbol_index(opts.output, opts.compress) or {
+		eprintln('Error writing index: ${err}')
+		exit(1)
+	}
+	println('Indexed ${x.header.element_count} elements from ${x.header.file_count} files into ${opts.output}')
+}
+
+fn parse_index_arguments(argv []string) IndexOptions {
+	mut fp := flag.new_flag_parser(argv)
+	fp.application('code-analyzer index')
+	fp.description('Build a symbol index for `code-analyzer query`')
+	fp.skip_executable()
+
+	mut opts := IndexOptions{}
+	opts.input = fp.string('input', `i`, '', 'Root directory path')
+	opts.output = fp.string('output', `o`, './code-index.bin', 'Index file path')
+	opts.from = fp.string('from', 0, '', 'Index an existing --format binary output instead of scanning')
+	opts.lang = fp.string('lang', `l`, '', 'Programming language filter (optional)')
+	opts.config = fp.string('config', `c`, '', 'Custom config file path')
+	opts.jobs = fp.int('jobs', `j`, runtime.nr_cpus(), 'Number of parallel worker threads')
+	opts.max_size = fp.int('max-size', 0, 0, 'Skip files larger than this many KiB (0 = no limit)')
+	opts.cache_dir = fp.string('cache-dir', 0, '', 'Directory for the incremental result cache')
+	opts.compress = fp.bool('compress', 0, false, 'Write the index and the cache compressed (gzip)')
+	opts.verbose = fp.bool('verbose', `v`, false, 'Show progress and details')
+
+	fp.finalize() or {
+		eprintln('Error parsing arguments: ${err}')
+		println(fp.usage())
+		exit(1)
+	}
+	if opts.input.len == 0 && opts.from.len == 0 {
+		eprintln('Error: --input or --from is required')
+		println(fp.usage())
+		exit(1)
+	}
+	return opts
+}
+
+// IndexKey pairs a record with the string it is ordered by.
+struct IndexKey {
+	key string
+	id  u32
+}
+
+fn compare_index_keys(a &IndexKey, b &IndexKey) int {
+	if a.key < b.key {
+		return -1
+	}
+	if a.key > b.key {
+		return 1
+	}
+	return if a.id < b.id { -1 } else if a.id > b.id { 1 } else { 0 }
+}
+
+// add_symbol_index appends the symbol tables to the binary output file at
+// `path` and marks it as indexed. An existing index is replaced. The file
+// is rewritten compressed with `compress` or when it already was.
+fn add_symbol_index(path string, compress bool) !BinaryIndex {
+	x := load_binary_index(path)!
+	count := x.header.element_count
+	mut by_name := []IndexKey{cap: int(count)}
+	mut by_parent := []IndexKey{}
+	for i in 0 .. count {
+		e := x.element(i)
+		by_name << IndexKey{
+			key: x.string_at(e.name)
+			id:  u32(i)
+		}
+		if e.parent != 0 {
+			by_parent << IndexKey{
+				key: x.string_at(e.parent)
+				id:  u32(i)
+			}
+		}
+	}
+	by_name.sort_with_compare(compare_index_keys)
+	by_parent.sort_with_compare(compare_index_keys)
+
+	mut data := []u8{cap: symbol_index_header_size + 4 * (by_name.len + by_parent.len)}
+	data << symbol_index_magic.bytes()
+	put_u32(mut data, u32(by_name.len))
+	put_u32(mut data, u32(by_parent.len))
+	for key in by_name {
+		put_u32(mut data, key.id)
+	}
+	for key in by_parent {
+		put_u32(mut data, key.id)
+	}
+
+	// Rewrite everything after the strings section, which drops a shard
+	// section, then flag the header
+	end := x.header.strings_offset + x.header.strings_size
+	mut bytes := x.data[..int(end)].clone()
+	bytes << data
+	flags := (x.header.flags | binary_flag_indexed) & ~binary_flag_sharded
+	bytes[binary_header_flags_offset] = u8(flags)
+	bytes[binary_header_flags_offset + 1] = u8(flags >> 8)
+	bytes[binary_header_flags_offset + 2] = u8(flags >> 16)
+	bytes[binary_header_flags_offset + 3] = u8(flags >> 24)
+	if compress || x.compressed {
+		write_compressed_file(path, bytes)!
+	} else {
+		os.write_file_array(path, bytes)!
+	}
+	return x
+}
+
+// SymbolIndex is a loaded symbol index.
+struct SymbolIndex {
+	BinaryIndex
+	by_name_offset   u64
+	name_count       u32
+	by_parent_offset u64
+	parent_count     u32
+}
+
+fn load_symbol_index(path string) !SymbolIndex {
+	x := load_binary_index(path)!
+	pos := x.header.strings_offset + x.header.strings_size
+	if x.header.flags & binary_flag_indexed == 0 || pos + symbol_index_header_size > u64(x.data.len)
+		|| x.data[int(pos)..int(pos) + 8].bytestr() != symbol_index_magic {
+		return error('${path} has no symbol index (build it with `code-analyzer index`)')
+	}
+	name_count := get_u32(x.data, pos + 8)
+	parent_count := get_u32(x.data, pos + 12)
+	by_name_offset := pos + symbol_index_header_size
+	by_parent_offset := by_name_offset + u64(name_count) * 4
+	if by_parent_offset + u64(parent_count) * 4 != u64(x.data.len)
+		|| u64(name_count) != x.header.element_count {
+		return error('${path}: corrupt symbol index')
+	}
+	return SymbolIndex{
+		BinaryIndex:      x
+		by_name_offset:   by_name_offset
+		name_count:       name_count
+		by_parent_offset: by_parent_offset
+		parent_count:     parent_count
+	}
+}
+
+// table_entry returns the record id at `rank` of the by-name or by-parent
+// table, and the string it is ordered by.
+fn (s &SymbolIndex) table_entry(by_parent bool, rank u32) (u32, string) {
+	table := if by_parent { s.by_parent_offset } else { s.by_name_offset }
+	id := get_u32(s.data, table + u64(rank) * 4)
+	e := s.element(id)
+	return id, s.string_at(if by_parent { e.parent } else { e.name })
+}
+
+// lookup returns the ids of the records whose name (or parent) equals
+// `key`, or starts with it when `prefix` is set, in index order.
+fn (s &SymbolIndex) lookup(by_parent bool, key string, prefix bool) []u32 {
+	count := if by_parent { s.parent_count } else { s.name_count }
+	// Lower bound: the first entry not less than `key`
+	mut lo := u32(0)
+	mut hi := count
+	for lo < hi {
+		mid := lo + (hi - lo) / 2
+		_, value := s.table_entry(by_parent, mid)
+		if value < key {
+			lo = mid + 1
+		} else {
+			hi = mid
+		}
+	}
+
+	mut ids := []u32{}
+	for rank in lo .. count {
+		id, value := s.table_entry(by_parent, rank)
+		if value != key && !(prefix && value.starts_with(key)) {
+			break
+		}
+		ids << id
+	}
+	return ids
+}
+
+// file_elements returns the record ids of the file with path `file_path`.
+fn (s &SymbolIndex) file_elements(file_path string) []u32 {
+	for file in 0 .. s.header.file_count {
+		if s.file_path(file) != file_path {
+			continue
+		}
+		entry := s.header.files_offset + u64(file) * binary_file_entry_size
+		first := get_u32(s.data, entry + 4)
+		count := get_u32(s.data, entry + 8)
+		return []u32{len: int(count), init: first + u32(index)}
+	}
+	return []u32{}
+}
+
+struct QueryOptions {
+mut:
+	index       string
+	name        string
+	prefix      string
+	children    string
+	file        string
+	kind        string
+	descendants bool
+}
+
+// run_query implements `code-analyzer query`, printing each matching
+// element as `path:line: element`. It exits with status 1 when nothing
+// matches.
+fn run_query(argv []string) {
+	opts := parse_query_arguments(argv)
+	s := load_symbol_index(opts.index) or {
+		eprintln('Error: ${err}')
+		exit(1)
+	}
+
+	mut ids := []u32{}
+	if opts.name.len > 0 {
+		ids = s.lookup(false, opts.name, false)
+	} else if opts.prefix.len > 0 {
+		ids = s.lookup(false, opts.prefix, true)
+	} else if opts.children.len > 0 {
+		ids = s.children_of(opts.children, opts.descendants)
+	} else {
+		ids = s.file_elements(opts.file)
+	}
+
+	mut b := OutputBuffer{}
+	mut matched := 0
+	for id in ids {
+		e := s.element(id)
+		kind := s.kind_name(e.kind)
+		if opts.kind.len > 0 && kind != opts.kind {
+			continue
+		}
+		b.write_string(s.file_path(e.file))
+		b.write_u8(`:`)
+		b.write_int(int(e.line))
+		b.write_string(': ')
+		write_element_parts(mut b, int(e.line), s.access_name(e.access), kind, is_type_like(kind),
+			s.string_at(e.name), s.string_at(e.parent), s.string_at(e.doc), false)
+		b.write_u8(`\n`)
+		matched++
+	}
+	print(b.data.bytestr())
+	if matched == 0 {
+		exit(1)
+	}
+}
+
+// children_of returns the elements whose parent is `parent`; with
+// `transitive`, also the elements inheriting from those, breadth first.
+fn (s &SymbolIndex) children_of(parent string, transitive bool) []u32 {
+	mut ids := s.lookup(true, parent, false)
+	if !transitive {
+		return ids
+	}
+	mut seen := {
+		parent: true
+	}
+	mut next := 0
+	for next < ids.len {
+		name := s.string_at(s.element(ids[next]).name)
+		next++
+		if name in seen {
+			continue
+		}
+		seen[name] = true
+		ids << s.lookup(true, name, false)
+	}
+	return ids
+}
+
+fn parse_query_arguments(argv []string) QueryOptions {
+	mut fp := flag.new_flag_parser(argv)
+	fp.application('code-analyzer query')
+	fp.description('Look up symbols in an index built by `code-analyzer index`')
+	fp.skip_executable()
+
+	mut opts := QueryOptions{}
+	opts.index = fp.string('index', `x`, './code-index.bin', 'Index file path')
+	opts.name = fp.string('name', 0, '', 'Elements with exactly this name')
+	opts.prefix = fp.string('prefix', 0, '', 'Elements whose name starts with this')
+	opts.children = fp.string('children', 0, '', 'Elements inheriting from this parent')
+	opts.file = fp.string('file', 0, '', 'Elements of this file, as listed in the output')
+	opts.kind = fp.string('kind', `k`, '', 'Only elements of this kind (class, method, ...)')
+	opts.descendants = fp.bool('descendants', 0, false, 'With --children, include indirect descendants')
+
+	fp.finalize() or {
+		eprintln('Error parsing arguments: ${err}')
+		println(fp.usage())
+		exit(1)
+	}
+	selectors := [opts.name, opts.prefix, opts.children, opts.file].filter(it.len > 0)
+	if selectors.len != 1 {
+		eprintln('Error: exactly one of --name, --prefix, --children or --file is required')
+		println(fp.usage())
+		exit(1)
+	}
+	return opts
+}
@@ -2,19 +2,72 @@ module main
 
 import os
 import flag
+import runtime
+import time
 
 struct Arguments {
 mut:
-	input     string
-	lang      string
-	output    string
-	config    string
-	verbose   bool
-	show_line bool
-	help      bool
+	input      string
+	lang       string
+	output     string
+	config     string
+	verbose    bool
+	show_line  bool
+	jobs       int
+	cache_dir  string
+	stream     bool
+	max_size   int
+	format     string
+	watch      bool
+	since      string
+	git_index  bool
+	exclude    []string
+	include    []string
+	no_ignore  bool
+	chunk_size int
+	chunk_jobs int
+	shard      string
+	dedup      bool
+	compress   bool
+	collapse   bool
+	stats      bool
+	stats_json string
+	help       bool
 }
 
 fn main() {
+	// Subcommands take their own flags
+	if os.args.len > 1 {
+		match os.args[1] {
+			'bench' {
+				run_bench(os.args[1..])
+				exit(0)
+			}
+			'fuzz' {
+				run_fuzz(os.args[1..])
+				exit(0)
+			}
+			'index' {
+				run_index(os.args[1..])
+				exit(0)
+			}
+			'query' {
+				run_query(os.args[1..])
+				exit(0)
+			}
+			'serve' {
+				run_serve(os.args[1..])
+				exit(0)
+			}
+			'merge' {
+				run_merge(os.args[1..])
+				exit(0)
+			}
+			else {}
+		}
+	}
+
+	wall := time.new_stopwatch()
 	args := parse_arguments()
 
 	if args.help {
@@ -39,52 +92,171 @@ fn main() {
 		exit(1)
 	}
 
-	// Load config if provided
-	if args.config.len > 0 {
-		config := load_config(args.config) or {
-			eprintln('Error loading config: ${err}')
+	format := parse_result_format(args.format) or {
+		eprintln('Error: ${err}')
+		exit(1)
+	}
+	if args.watch && args.stream {
+		eprintln('Error: --watch keeps results in memory and cannot be combined with --stream')
+		exit(1)
+	}
+	if args.collapse && (args.watch || args.shard.len > 0) {
+		eprintln('Error: --collapse-duplicates cannot be combined with --watch or --shard')
+		exit(1)
+	}
+	mut shard_index, mut shard_count := 0, 1
+	if args.shard.len > 0 {
+		shard_index, shard_count = parse_shard(args.shard) or {
+			eprintln('Error: ${err}')
 			exit(1)
 		}
-		if args.verbose {
-			eprintln('Loaded config with ${config.custom_languages.len} custom language(s)')
+		if format != .binary || args.watch {
+			eprintln('Error: --shard writes a binary output for merge; use --format binary, without --watch')
+			exit(1)
 		}
 	}
 
-	// Initialize analyzer
-	mut analyzer := new_analyzer()
-	if args.lang.len > 0 {
-		analyzer.target_lang = args.lang
+	mut analyzer := configure_analyzer(args.config, args.lang, args.verbose)
+	if args.max_size > 0 {
+		analyzer.max_file_size = u64(args.max_size) * 1024
 	}
+	analyzer.jobs = if args.jobs > 0 { args.jobs } else { 1 }
+	analyzer.chunk_size = if args.chunk_size > 0 { args.chunk_size * 1024 } else { 0 }
+	analyzer.chunk_jobs = if args.chunk_jobs > 0 { args.chunk_jobs } else { analyzer.jobs }
+	analyzer.buffered = !args.stream
+	analyzer.count_lines = args.stats || args.stats_json.len > 0
+	add_ignore_globs(mut analyzer.excludes, args.exclude)
+	add_ignore_globs(mut analyzer.includes, args.include)
+	analyzer.no_ignore_files = args.no_ignore
+	analyzer.shard_index = shard_index
+	analyzer.shard_count = shard_count
+	analyzer.shard_root = args.input
+	if args.dedup || args.collapse {
+		analyzer.contents = &ContentIndex{}
+	}
+	analyzer.collapse = args.collapse
 
 	// Initialize progress tracker
 	mut progress := ProgressTracker{}
 	progress.init(args.verbose, 0)
 
+	if args.cache_dir.len > 0 {
+		analyzer.cache = load_result_cache(args.cache_dir, analyzer.rules_fingerprint())
+		analyzer.cache.compress = args.compress
+		progress.cache_enabled = true
+	}
+	if args.git_index || args.since.len > 0 {
+		analyzer.use_git(args.input, args.since) or {
+			eprintln('Error: ${err}')
+			exit(1)
+		}
+	}
+
 	if args.verbose {
 		eprintln('Starting analysis of: ${args.input}')
 		extensions := analyzer.get_supported_extensions()
 		eprintln('Supported extensions: ${extensions.join(', ')}')
 	}
 
-	// Analyze directory
-	results := analyzer.analyze_directory(args.input, mut progress)
+	// Analyze directory and write output
+	mut collector := ResultCollector{}
+	if args.stream {
+		mut writer := new_output_writer(args.output, args.show_line, format, args.compress) or {
+			eprintln('Error writing output: ${err}')
+			exit(1)
+		}
+		analyzer.analyze_directory(args.input, mut progress, mut writer) or {
+			eprintln('Error writing output: ${err}')
+			exit(1)
+		}
+		flush := time.new_stopwatch()
+		writer.close() or {
+			eprintln('Error writing output: ${err}')
+			exit(1)
+		}
+		progress.stats.add_output(flush.elapsed())
+	} else {
+		analyzer.analyze_directory(args.input, mut progress, mut collector) or {
+			eprintln('Error writing output: ${err}')
+			exit(1)
+		}
+		write := time.new_stopwatch()
+		write_output(collector, args.output, args.show_line, format, args.compress) or {
+			eprintln('Error writing output: ${err}')
+			exit(1)
+		}
+		if !args.watch {
+			collector.free()
+		}
+		progress.stats.add_output(write.elapsed())
+	}
+	if shard_count > 1 {
+		add_shard_section(args.output, shard_index, shard_count, analyzer.shard_positions) or {
+			eprintln('Error writing output: ${err}')
+			exit(1)
+		}
+	}
 
-	// Write output
-	write_output(results, args.output, args.show_line) or {
-		eprintln('Error writing output: ${err}')
-		exit(1)
+	if !isnil(analyzer.cache) {
+		analyzer.cache.save() or { eprintln('Warning: failed to save cache: ${err}') }
 	}
 
 	// Print summary
 	progress.print_summary()
+	progress.stats.wall_ns = wall.elapsed().nanoseconds()
+	if args.stats {
+		progress.stats.print_report(progress)
+	}
+	if args.stats_json.len > 0 {
+		progress.stats.write_json(args.stats_json, progress) or {
+			eprintln('Warning: failed to write stats: ${err}')
+		}
+	}
 
 	if args.verbose {
 		eprintln('Output written to: ${args.output}')
 	}
 
+	if args.watch {
+		watch_tree(mut analyzer, args.input, mut collector, WatchOutput{
+			path:      args.output
+			show_line: args.show_line
+			format:    format
+			compress:  args.compress
+			verbose:   args.verbose
+		})
+	}
+
 	exit(0)
 }
 
+// configure_analyzer creates the analyzer with the custom languages of the
+// config file, if any, and the --lang filter. Errors are fatal.
+fn configure_analyzer(config_path string, lang string, verbose bool) Analyzer {
+	// Load config if provided
+	mut config := Config{}
+	if config_path.len > 0 {
+		config = load_config(config_path) or {
+			eprintln('Error loading config: ${err}')
+			exit(1)
+		}
+		if verbose {
+			eprintln('Loaded config with ${config.custom_languages.len} custom language(s)')
+		}
+	}
+
+	mut analyzer := new_analyzer()
+	analyzer.add_custom_languages(config.custom_languages) or {
+		eprintln('Error loading config: ${err}')
+		exit(1)
+	}
+	analyzer.set_language(lang) or {
+		eprintln('Error: ${err}')
+		exit(1)
+	}
+	return analyzer
+}
+
 fn parse_arguments() Arguments {
 	mut fp := flag.new_flag_parser(os.args)
 	fp.application('code-analyzer')
@@ -100,6 +272,25 @@ fn parse_arguments() Arguments {
 	args.config = fp.string('config', `c`, '', 'Custom config file path')
 	args.verbose = fp.bool('verbose', `v`, false, 'Show progress and details')
 	args.show_line = fp.bool('line', `n`, false, 'Show line numbers for code elements')
+	args.jobs = fp.int('jobs', `j`, runtime.nr_cpus(), 'Number of parallel worker threads')
+	args.cache_dir = fp.string('cache-dir', 0, '', 'Directory for the incremental result cache')
+	args.stream = fp.bool('stream', 0, false, 'Write each file to the output as soon as it is analyzed')
+	args.max_size = fp.int('max-size', 0, 0, 'Skip files larger than this many KiB (0 = no limit)')
+	args.chunk_size = fp.int('chunk-size', 0, default_chunk_size / 1024, 'Parse files larger than this many KiB in chunks (0 = never)')
+	args.chunk_jobs = fp.int('chunk-jobs', 0, 0, 'Threads parsing the chunks of large files, shared by all jobs (0 = as many as --jobs)')
+	args.format = fp.string('format', `f`, 'text', 'Output format: text, jsonl or binary')
+	args.watch = fp.bool('watch', `w`, false, 'Keep running and update the output when files change')
+	args.since = fp.string('since', 0, '', 'Without a cache, only analyze files changed since this git revision')
+	args.git_index = fp.bool('git-index', 0, false, 'Take the file list from git instead of walking the tree')
+	args.exclude = fp.string_multi('exclude', `x`, 'Skip files and directories matching this glob (repeatable)')
+	args.include = fp.string_multi('include', 0, 'Only analyze files matching this glob (repeatable)')
+	args.no_ignore = fp.bool('no-ignore', 0, false, 'Do not read .gitignore and .codeanalyzerignore files')
+	args.shard = fp.string('shard', 0, '', 'Analyze only shard i of N (i/N); merge the outputs with `merge`')
+	args.dedup = fp.bool('dedup', 0, false, 'Parse each distinct file content once')
+	args.collapse = fp.bool('collapse-duplicates', 0, false, 'List the elements of identical files once (implies --dedup)')
+	args.compress = fp.bool('compress', 0, false, 'Compress the output and the cache (gzip)')
+	args.stats = fp.bool('stats', 0, false, 'Print per-stage timings and counters')
+	args.stats_json = fp.string('stats-json', 0, '', 'Write per-stage timings and counters as JSON to this file')
 	args.help = fp.bool('help', `h`, false, 'Show help message')
 
 	fp.finalize() or {
@@ -117,6 +308,15 @@ Code Analyzer - Code Structure Analyzer
 
 Usage:
   code-analyzer --input <path> [options]
+  code-analyzer bench [--samples <dir>] [--size <kib>] [--iterations <n>] [--jobs <n>] [--keep]
+  code-analyzer fuzz [--samples <dir>] [--size <kib>] [--iterations <n>] [--seed <n>]
+                     [--budget-ms <ms>] [--budget-mem <mb>] [--out <dir>]
+  code-analyzer index --input <path> [--output <file>] [--lang <language>] [--config <file>] [--compress]
+  code-analyzer query [--index <file>] (--name <n> | --prefix <p> | --children <parent> | --file <path>)
+                      [--kind <kind>] [--descendants]
+  code-analyzer serve --input <path> [--listen <socket> | --listen <host:port>] [--lang <language>]
+  code-analyzer merge [--output <file>] [--format <fmt>] [--line] [--compress] <shard output>...
+  code-analyzer merge --cache-dir <dir> [--compress] <shard cache dir>...
 
 Arguments:
   -i, --input <path>      Root directory path (required)
@@ -125,6 +325,26 @@ Arguments:
   -c, --config <file>     Custom config file path (YAML or JSON)
   -v, --verbose           Show progress and details
   -n, --line              Show line numbers for code elements
+  -j, --jobs <n>          Number of parallel worker threads (default: CPU count)
+      --cache-dir <dir>   Reuse results for unchanged files from this cache
+      --stream            Write results as they are produced (constant memory)
+      --max-size <kib>    Skip files larger than this (default: 0 = no limit)
+      --chunk-size <kib>  Parse larger files in chunks of this size (default: 8192, 0 = never)
+      --chunk-jobs <n>    Threads parsing chunks of large files, in total (default: --jobs)
+  -f, --format <fmt>      Output format: text (default), jsonl or binary
+  -w, --watch             Keep running and update the output as files change
+      --git-index         Analyze the files git lists instead of walking (respects .gitignore)
+      --since <rev>       Without --cache-dir, only analyze files changed since <rev>
+  -x, --exclude <glob>    Skip matching files and directories (repeatable, comma-separated)
+      --include <glob>    Only analyze matching files (repeatable, comma-separated)
+      --no-ignore         Do not read .gitignore and .codeanalyzerignore files
+      --shard <i/N>       Analyze only shard i of N (binary format); combine them with merge
+      --dedup             Parse each distinct file content once, reusing it for identical files
+      --collapse-duplicates
+                          Write identical files as a reference to the first one (implies --dedup)
+      --compress          Write the output and the cache gzip-compressed, on separate threads
+      --stats             Print per-stage timings, counters and the slowest files
+      --stats-json <file> Write the same report as JSON
   -h, --help              Show this help message
 
 Supported Languages:
@@ -158,6 +378,25 @@ Examples:
 
   # Use custom config for additional languages
   code-analyzer --input ./src --config ./custom.yaml --verbose
+
+  # Measure parser and pipeline throughput
+  code-analyzer bench --size 4096
+
+  # Check every parser against pathological inputs (exits 1 when over budget)
+  code-analyzer fuzz --budget-ms 1000
+
+  # Index a tree, then find a class and everything inheriting from it
+  code-analyzer index --input ./src --output code-index.bin
+  code-analyzer query --index code-index.bin --name Animal --kind class
+  code-analyzer query --index code-index.bin --children Animal --descendants
+
+  # Keep a tree in memory and answer JSON queries on a Unix socket
+  code-analyzer serve --input ./src --listen /tmp/code-analyzer.sock
+
+  # Split a tree over two machines, then merge their outputs
+  code-analyzer --input ./src --git-index --format binary --shard 1/2 --output part1.bin
+  code-analyzer --input ./src --git-index --format binary --shard 2/2 --output part2.bin
+  code-analyzer merge --output output.txt --format text part1.bin part2.bin
 '
 	println(help_text)
 }
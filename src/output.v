@@ -3,90 +3,379 @@ module main
 import os
 import parsers
 
-pub fn write_output(results []parsers.ParseResult, output_path string, show_line bool) ! {
-	mut f := os.create(output_path) or { return error('Failed to create output file: ${err}') }
-	defer {
-		f.close()
+// ResultSink receives analysis results in walk order as they complete.
+pub interface ResultSink {
+mut:
+	emit(result parsers.ParseResult) !
+}
+
+// ResultCollector is the buffering sink: it keeps every result in memory
+// so `write_output` can run once the whole tree has been analyzed. Results
+// are stored as CompactResults, with kinds and access modifiers interned
+// across the run.
+pub struct ResultCollector {
+pub mut:
+	results []CompactResult
+mut:
+	kinds  Interner = new_interner(element_kinds)
+	access Interner = new_interner(element_access)
+	slots  map[string]int // path -> index in results, built by replace
+}
+
+pub fn (mut c ResultCollector) emit(result parsers.ParseResult) ! {
+	// Files without elements produce no output
+	if result.elements.len == 0 {
+		return
 	}
+	c.results << compact_result(result, mut c.kinds, mut c.access)
+}
 
-	for result in results {
-		if result.elements.len == 0 {
-			continue
+// replace swaps in the new result for its file, keeping the file's place
+// in the output, or adds it at the end for a new file. A result without
+// elements removes the file. Used by --watch.
+fn (mut c ResultCollector) replace(result parsers.ParseResult) {
+	if i := c.slot(result.file_path) {
+		c.results[i].free()
+		c.results[i] = compact_result(result, mut c.kinds, mut c.access)
+		return
+	}
+	if result.elements.len > 0 {
+		c.slots[result.file_path] = c.results.len
+		c.results << compact_result(result, mut c.kinds, mut c.access)
+	}
+}
+
+// slot returns the index in `results` of the file `path`.
+fn (mut c ResultCollector) slot(path string) ?int {
+	if c.slots.len == 0 {
+		for i, r in c.results {
+			c.slots[r.file_path] = i
 		}
+	}
+	return c.slots[path] or { return none }
+}
 
-		// Write file path
-		f.write_string('${result.file_path}\n') or {
-			return error('Failed to write to output file: ${err}')
+// remove drops the results of `path`.
+fn (mut c ResultCollector) remove(path string) {
+	c.replace(parsers.ParseResult{
+		file_path: path
+	})
+}
+
+// file_count returns the number of files write_output lists, leaving out
+// the empty slots of removed files.
+fn (c &ResultCollector) file_count() int {
+	mut count := 0
+	for result in c.results {
+		if result.elements.len > 0 || result.duplicate_of.len > 0 {
+			count++
 		}
+	}
+	return count
+}
+
+// free releases every collected result in bulk.
+pub fn (mut c ResultCollector) free() {
+	for mut result in c.results {
+		result.free()
+	}
+	unsafe { c.results.free() }
+	c.results = []CompactResult{}
+	c.slots = map[string]int{}
+}
+
+// Buffered output is handed to the file in writes of at least this size.
+const output_flush_size = 256 * 1024
+
+// OutputBuffer is a growable byte buffer that elements are formatted into
+// directly. It is reused across flushes, so steady-state formatting does
+// not allocate.
+pub struct OutputBuffer {
+mut:
+	data []u8 = []u8{cap: output_flush_size + 4096}
+}
+
+@[inline]
+fn (mut b OutputBuffer) write_string(s string) {
+	unsafe { b.data.push_many(s.str, s.len) }
+}
 
-		// Write elements
-		for element in result.elements {
-			line := format_element(element, show_line)
-			f.write_string('${line}\n') or {
-				return error('Failed to write to output file: ${err}')
-			}
+@[inline]
+fn (mut b OutputBuffer) write_u8(c u8) {
+	b.data << c
+}
+
+fn (mut b OutputBuffer) write_int(value int) {
+	mut n := i64(value)
+	if n < 0 {
+		b.write_u8(`-`)
+		n = -n
+	}
+	mut digits := [20]u8{}
+	mut count := 0
+	for {
+		digits[count] = u8(48 + n % 10) // ASCII '0' + digit
+		count++
+		n /= 10
+		if n == 0 {
+			break
 		}
+	}
+	for count > 0 {
+		count--
+		b.data << digits[count]
+	}
+}
 
-		// Add blank line between files
-		f.write_string('\n') or { return error('Failed to write to output file: ${err}') }
+// OutputWriter writes results to the output file through an OutputBuffer,
+// in the selected ResultFormat. It is also the streaming sink behind
+// --stream. With `compress`, every flush hands the buffer to a
+// BlockCompressor instead (see compression.v).
+pub struct OutputWriter {
+mut:
+	file       os.File
+	buf        OutputBuffer
+	show_line  bool
+	format     ResultFormat
+	binary     BinaryEncoder
+	file_path  string // of the result being written, for jsonl records
+	compressor &BlockCompressor = unsafe { nil }
+}
+
+pub fn new_output_writer(output_path string, show_line bool, format ResultFormat, compress bool) !OutputWriter {
+	mut f := os.create(output_path) or { return error('Failed to create output file: ${err}') }
+	if format == .binary {
+		// Placeholder, patched by close() once the section sizes are known
+		placeholder := []u8{len: binary_header_size}
+		f.write(if compress { stored_member(placeholder) } else { placeholder }) or {
+			f.close()
+			return error('Failed to write to output file: ${err}')
+		}
+	}
+	return OutputWriter{
+		file:       f
+		show_line:  show_line
+		format:     format
+		compressor: if compress { new_block_compressor(f) } else { unsafe { nil } }
 	}
 }
 
-fn format_element(element parsers.CodeElement, show_line bool) string {
-	mut parts := []string{}
+pub fn (mut w OutputWriter) emit(result parsers.ParseResult) ! {
+	if result.elements.len == 0 {
+		return
+	}
 
-	// Handle different element types
-	if element.element_type == 'module' {
-		parts << 'module ${element.name}'
-	} else if element.element_type.contains('class') || element.element_type == 'interface'
-		|| element.element_type == 'trait' || element.element_type == 'object'
-		|| element.element_type == 'data class' || element.element_type == 'abstract class' {
-		// For class-like types, add access modifier if present and not public
-		if element.access.len > 0 && element.access != 'public' {
-			parts << element.access
-		} else if element.access == 'public' {
-			parts << 'public'
+	if result.duplicate_of.len > 0 {
+		return w.write_duplicate(result.file_path, result.duplicate_of)
+	}
+
+	w.begin_file(result.file_path)!
+	for element in result.elements {
+		w.write_fields(element.line_number, element.access, element.element_type,
+			is_type_like(element.element_type), element.name, element.parent, element.doc)!
+	}
+	w.end_file()!
+}
+
+// emit_compact writes a collected result in the same format as `emit`.
+// `type_like` is indexed by the result's kind ids.
+fn (mut w OutputWriter) emit_compact(result CompactResult, c ResultCollector, type_like []bool) ! {
+	if result.duplicate_of.len > 0 {
+		return w.write_duplicate(result.file_path, result.duplicate_of)
+	}
+	w.begin_file(result.file_path)!
+	for e in result.elements {
+		w.write_fields(e.line_number, c.access.names[e.access], c.kinds.names[e.kind], type_like[e.kind],
+			result.name(e), result.parent(e), result.doc(e))!
+	}
+	w.end_file()!
+}
+
+fn (mut w OutputWriter) begin_file(file_path string) ! {
+	match w.format {
+		.text {
+			// File path, one line per element, then a blank line between files
+			w.buf.write_string(file_path)
+			w.buf.write_u8(`\n`)
 		}
-		parts << '${element.element_type} ${element.name}'
-	} else if element.element_type == 'struct' || element.element_type == 'enum'
-		|| element.element_type == 'constant' || element.element_type == 'match_expression' {
-		// For structs, enums, constants, and match expressions, add access modifier if present
-		if element.access.len > 0 && element.access != 'public' {
-			parts << element.access
-		} else if element.access == 'public' {
-			parts << 'public'
+		.jsonl {
+			w.file_path = file_path
 		}
-		parts << '${element.element_type} ${element.name}'
-	} else {
-		// For functions and methods, add access modifier if not empty
-		if element.access.len > 0 && element.access != 'public' {
-			parts << element.access
-		} else if element.access == 'public' {
-			parts << 'public'
+		.binary {
+			w.binary.begin_file(file_path)!
+		}
+	}
+}
+
+@[inline]
+fn (mut w OutputWriter) write_fields(line_number int, access string, kind string, type_like bool, name string, parent string, doc string) ! {
+	match w.format {
+		.text {
+			write_element_parts(mut w.buf, line_number, access, kind, type_like, name, parent, doc,
+				w.show_line)
+			w.buf.write_u8(`\n`)
+		}
+		.jsonl {
+			write_jsonl_element(mut w.buf, w.file_path, line_number, access, kind, name, parent, doc)
+		}
+		.binary {
+			w.binary.write_record(mut w.buf, line_number, access, kind, name, parent, doc)!
 		}
+	}
+}
 
-		// Add element type and name
-		parts << '${element.element_type} ${element.name}()'
+// write_duplicate writes a file collapsed by --collapse-duplicates: in text
+// and jsonl, its path and the earlier file with the same content instead
+// of the elements; in binary, a file entry sharing that file's records.
+fn (mut w OutputWriter) write_duplicate(file_path string, first string) ! {
+	match w.format {
+		.text {
+			w.buf.write_string(file_path)
+			w.buf.write_string('\nsame as ')
+			w.buf.write_string(first)
+			w.buf.write_string('\n\n')
+		}
+		.jsonl {
+			w.buf.write_string('{"file":')
+			write_json_string(mut w.buf, file_path)
+			w.buf.write_string(',"duplicate_of":')
+			write_json_string(mut w.buf, first)
+			w.buf.write_string('}\n')
+		}
+		.binary {
+			w.binary.write_duplicate(file_path, first)!
+		}
 	}
 
-	// Add inheritance if present
-	if element.parent.len > 0 {
-		result := parts.join(' ') + ' – inherited ${element.parent}'
-		parts = [result]
+	if w.buf.data.len >= output_flush_size {
+		w.flush()!
 	}
+}
 
-	formatted := parts.join(' ')
-	
-	// Add documentation if present
-	final_output := if element.doc.len > 0 {
-		'${formatted} – ${element.doc}'
-	} else {
-		formatted
+fn (mut w OutputWriter) end_file() ! {
+	match w.format {
+		.text { w.buf.write_u8(`\n`) }
+		.jsonl {}
+		.binary { w.binary.end_file() }
 	}
 
+	if w.buf.data.len >= output_flush_size {
+		w.flush()!
+	}
+}
+
+pub fn (mut w OutputWriter) flush() ! {
+	if w.buf.data.len == 0 {
+		return
+	}
+	if !isnil(w.compressor) {
+		// The compressor owns the buffer now
+		w.compressor.push(w.buf.data)
+		w.buf = OutputBuffer{}
+		return
+	}
+	w.file.write(w.buf.data) or { return error('Failed to write to output file: ${err}') }
+	w.buf.data.clear()
+}
+
+// close flushes any buffered output, completes the binary tables and
+// header if needed, and closes the file.
+pub fn (mut w OutputWriter) close() ! {
+	w.finish() or {
+		w.abort()
+		return err
+	}
+	w.file.close()
+}
+
+fn (mut w OutputWriter) finish() ! {
+	w.flush()!
+	if w.format != .binary {
+		if !isnil(w.compressor) {
+			w.compressor.finish()!
+		}
+		return
+	}
+	tables, header := w.binary.finish()!
+	if isnil(w.compressor) {
+		w.file.write(tables) or { return error('Failed to write to output file: ${err}') }
+		w.file.write(w.binary.strings) or { return error('Failed to write to output file: ${err}') }
+		w.file.write_to(0, header) or { return error('Failed to write to output file: ${err}') }
+		return
+	}
+	w.compressor.push_all(tables)
+	w.compressor.push_all(w.binary.strings)
+	w.compressor.finish()!
+	w.file.write_to(0, stored_member(header)) or {
+		return error('Failed to write to output file: ${err}')
+	}
+}
+
+// abort closes the output after an error, stopping the compressor, if any.
+fn (mut w OutputWriter) abort() {
+	if !isnil(w.compressor) {
+		w.compressor.finish() or {}
+		w.compressor = unsafe { nil }
+	}
+	w.file.close()
+}
+
+pub fn write_output(c ResultCollector, output_path string, show_line bool, format ResultFormat, compress bool) ! {
+	mut writer := new_output_writer(output_path, show_line, format, compress)!
+
+	type_like := c.kinds.names.map(is_type_like(it))
+	for result in c.results {
+		// Files removed under --watch keep an empty slot
+		if result.elements.len == 0 && result.duplicate_of.len == 0 {
+			continue
+		}
+		writer.emit_compact(result, c, type_like) or {
+			writer.abort()
+			return err
+		}
+	}
+	writer.close()!
+}
+
+// write_element_parts formats one element straight into `b`:
+// [line: ][access ]type name[()][ – inherited parent][ – doc]
+fn write_element_parts(mut b OutputBuffer, line_number int, access string, kind string, type_like bool, name string, parent string, doc string, show_line bool) {
 	if show_line {
-		return '${element.line_number}: ${final_output}'
+		b.write_int(line_number)
+		b.write_string(': ')
 	}
 
-	return final_output
+	if kind == 'module' {
+		b.write_string('module ')
+		b.write_string(name)
+	} else {
+		if access.len > 0 {
+			b.write_string(access)
+			b.write_u8(` `)
+		}
+		b.write_string(kind)
+		b.write_u8(` `)
+		b.write_string(name)
+		// Functions and methods get parentheses; class-like types, structs,
+		// enums, constants and match expressions do not
+		if !type_like {
+			b.write_string('()')
+		}
+	}
+
+	// Add inheritance if present
+	if parent.len > 0 {
+		b.write_string(' – inherited ')
+		b.write_string(parent)
+	}
+
+	// Add documentation if present
+	if doc.len > 0 {
+		b.write_string(' – ')
+		b.write_string(doc)
+	}
+}
+
+fn is_type_like(element_type string) bool {
+	return element_type.contains('class') || element_type in ['interface', 'trait', 'object', 'struct', 'enum', 'constant', 'match_expression']
 }
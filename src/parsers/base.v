@@ -1,5 +1,7 @@
 module parsers
 
+import regex
+
 pub struct CodeElement {
 pub mut:
 	element_type string // 'class', 'function', 'method', 'module'
@@ -12,82 +14,423 @@ pub mut:
 
 pub struct ParseResult {
 pub mut:
-	file_path string
-	elements  []CodeElement
+	file_path    string
+	elements     []CodeElement
+	duplicate_of string // set under --collapse-duplicates: an earlier file with the same content, written instead of the elements
 }
 
+// Parser is implemented by every language parser. `parse` takes a mutable
+// receiver because parsers own a PatternRegistry whose compiled programs
+// are updated while matching; use one parser instance per thread.
 pub interface Parser {
-	parse(content string, file_path string) ParseResult
 	get_extensions() []string
+mut:
+	parse(content string, file_path string) ParseResult
 }
 
-pub fn extract_doc_lines(lines []string, start_idx int, max_lines int) string {
-	mut doc_lines := []string{}
-	mut idx := start_idx - 1
+// PatternRegistry compiles each regex once, on first use, and reuses the
+// compiled program for every later match against the same pattern.
+pub struct PatternRegistry {
+mut:
+	slots    map[string]int
+	compiled []regex.RE
+}
 
-	for idx >= 0 && doc_lines.len < max_lines {
-		line := lines[idx].trim_space()
-		if line.len == 0 {
-			idx--
-			continue
+// compile compiles `pattern` ahead of its first use, so that a pattern from
+// the configuration is reported as an error instead of a panic on the first
+// match.
+pub fn (mut r PatternRegistry) compile(pattern string) ! {
+	if pattern in r.slots {
+		return
+	}
+	compiled := regex.regex_opt(pattern)!
+	r.slots[pattern] = r.compiled.len
+	r.compiled << compiled
+}
+
+// captures matches `pattern` against the start of `text` and returns the
+// capture groups in order, with an empty string for an optional group that
+// did not participate. An empty list means the pattern did not match.
+pub fn (mut r PatternRegistry) captures(pattern string, text string) []string {
+	mut slot := r.slots[pattern] or { -1 }
+	if slot < 0 {
+		r.compile(pattern) or { panic(err) }
+		slot = r.slots[pattern]
+	}
+
+	mut re := &r.compiled[slot]
+	start, _ := re.match_string(text)
+	if start < 0 {
+		return []string{}
+	}
+
+	groups := re.get_group_list()
+	mut values := []string{cap: groups.len}
+	for group in groups {
+		if group.start >= 0 && group.end > group.start {
+			values << text[group.start..group.end]
+		} else {
+			values << ''
 		}
-		// Skip attributes (especially for Rust/C#)
-		if line.starts_with('#[') || (line.starts_with('[') && line.ends_with(']')) {
-			idx--
+	}
+	return values
+}
+
+// extract_doc_lines returns up to `max_lines` comment lines directly above
+// line `start_idx`, skipping blank and attribute lines. It is a constant
+// time lookup in the comment runs SourceLines precomputes (plus the join).
+pub fn extract_doc_lines(src SourceLines, start_idx int, max_lines int) string {
+	if start_idx <= 0 || start_idx > src.len() {
+		return ''
+	}
+	first := src.doc_prefix[src.doc_run_start[start_idx]]
+	last := src.doc_prefix[start_idx]
+	from := if last - first > max_lines { last - max_lines } else { first }
+	if from >= last {
+		return ''
+	}
+	return src.doc_texts[from..last].join(' ')
+}
+
+// index_doc_comments makes one pass over the trimmed lines of a file and
+// records, for every line i:
+// - run_start[i]: the first line of the unbroken block of comment, blank
+//   and attribute lines that ends just above line i;
+// - prefix[i]: how many non-empty comment texts precede line i;
+// and in `texts`, the cleaned text of those comment lines, in order.
+// The doc of line i is then the tail of texts[prefix[run_start[i]]..prefix[i]].
+fn index_doc_comments(trimmed []string) ([]int, []int, []string) {
+	mut run_start := []int{len: trimmed.len + 1}
+	mut prefix := []int{len: trimmed.len + 1}
+	mut texts := []string{}
+	mut start := 0
+	for i, line in trimmed {
+		run_start[i] = start
+		prefix[i] = texts.len
+		if line.len == 0 || is_attribute_line(line) {
 			continue
 		}
-		if !is_comment_line(line) {
-			break
-		}
-		cleaned := clean_comment(line)
-		if cleaned.len > 0 {
-			doc_lines.insert(0, cleaned)
+		if is_comment_line(line) {
+			cleaned := clean_comment(line)
+			if cleaned.len > 0 {
+				texts << cleaned
+			}
+			continue
 		}
-		idx--
+		start = i + 1
 	}
+	run_start[trimmed.len] = start
+	prefix[trimmed.len] = texts.len
+	return run_start, prefix, texts
+}
 
-	return doc_lines.join(' ')
+// is_attribute_line matches attributes (especially for Rust/C#), which may
+// sit between a doc comment and its declaration.
+fn is_attribute_line(trimmed string) bool {
+	return trimmed.starts_with('#[') || (trimmed.starts_with('[') && trimmed.ends_with(']'))
 }
 
-fn is_comment_line(line string) bool {
-	trimmed := line.trim_space()
+// is_comment_line expects an already trimmed line.
+fn is_comment_line(trimmed string) bool {
 	return trimmed.starts_with('//') || trimmed.starts_with('#') || trimmed.starts_with('/*')
 		|| trimmed.starts_with('*') || trimmed.starts_with('---') || trimmed.starts_with('"""')
 		|| trimmed.starts_with("'''")
 }
 
+// clean_comment strips comment markers from an already trimmed line. The
+// result is a view into `line`, so cleaning allocates nothing.
 fn clean_comment(line string) string {
-	mut cleaned := line.trim_space()
+	mut cleaned := line
 
 	// Remove common comment markers
 	if cleaned.starts_with('///') {
-		cleaned = cleaned[3..].trim_space()
+		cleaned = trimmed_view(cleaned, 3, cleaned.len)
 	} else if cleaned.starts_with('//') {
-		cleaned = cleaned[2..].trim_space()
+		cleaned = trimmed_view(cleaned, 2, cleaned.len)
 	} else if cleaned.starts_with('#') {
-		cleaned = cleaned[1..].trim_space()
+		cleaned = trimmed_view(cleaned, 1, cleaned.len)
 	} else if cleaned.starts_with('/*') {
-		cleaned = cleaned[2..].trim_space()
+		cleaned = trimmed_view(cleaned, 2, cleaned.len)
 	} else if cleaned.starts_with('*/') {
-		cleaned = cleaned[2..].trim_space()
+		cleaned = trimmed_view(cleaned, 2, cleaned.len)
 	} else if cleaned.starts_with('*') {
-		cleaned = cleaned[1..].trim_space()
+		cleaned = trimmed_view(cleaned, 1, cleaned.len)
 	} else if cleaned.starts_with('---') {
-		cleaned = cleaned[3..].trim_space()
+		cleaned = trimmed_view(cleaned, 3, cleaned.len)
 	} else if cleaned.starts_with('"""') {
-		cleaned = cleaned[3..].trim_space()
+		cleaned = trimmed_view(cleaned, 3, cleaned.len)
 	} else if cleaned.starts_with("'''") {
-		cleaned = cleaned[3..].trim_space()
+		cleaned = trimmed_view(cleaned, 3, cleaned.len)
 	}
 
 	// Remove trailing comment markers
 	if cleaned.ends_with('*/') {
-		cleaned = cleaned[..cleaned.len - 2].trim_space()
+		cleaned = trimmed_view(cleaned, 0, cleaned.len - 2)
 	} else if cleaned.ends_with('"""') {
-		cleaned = cleaned[..cleaned.len - 3].trim_space()
+		cleaned = trimmed_view(cleaned, 0, cleaned.len - 3)
 	} else if cleaned.ends_with("'''") {
-		cleaned = cleaned[..cleaned.len - 3].trim_space()
+		cleaned = trimmed_view(cleaned, 0, cleaned.len - 3)
 	}
 
 	return cleaned
 }
+
+// ScopeTracker follows the nesting of a file forward and knows, at any
+// line, which class (or module, object, trait, ...) encloses it and which
+// access section is in effect. Parsers register the classes they find with
+// enter_class and call advance before each declaration they report, so
+// telling methods from functions is a constant time lookup instead of a
+// scan back over earlier lines or a guess from leading whitespace.
+//
+// Nesting follows braces, or indentation for languages without them
+// (Python, Ruby, Pascal). Every line is consumed once, in order, including
+// the lines the prefilter skips; advance never goes backwards.
+pub struct ScopeTracker {
+	indent        bool              // nesting by indentation instead of braces
+	access_labels map[string]string // access section opened by a label line, by trimmed text
+	fold_case     bool              // match labels case-insensitively (lower-case keys)
+mut:
+	line    int // the next line to consume
+	depth   int // brace depth before `line`
+	level   int // with indentation, that of the line advance stopped at
+	classes []TrackedClass
+}
+
+struct TrackedClass {
+	name  string
+	line  int
+	level int // brace depth of the body, or indentation of the class line
+mut:
+	opened bool // the body's opening brace has been seen
+	body   int = -1 // with indentation, that of the first line of the body
+	access string
+}
+
+// Access labels are short; longer lines are not looked up.
+const max_access_label_len = 20
+
+// new_scope_tracker returns a tracker nesting by braces, or by indentation
+// with `indent`. `access_labels` maps label lines (`private`) to the access
+// section they open, in lower case with `fold_case`.
+pub fn new_scope_tracker(indent bool, access_labels map[string]string, fold_case bool) ScopeTracker {
+	return ScopeTracker{
+		indent:        indent
+		access_labels: access_labels
+		fold_case:     fold_case
+	}
+}
+
+// advance consumes the lines before `idx`, so the queries describe line
+// `idx`. Earlier lines are ignored.
+pub fn (mut t ScopeTracker) advance(src SourceLines, idx int) {
+	for t.line < idx && t.line < src.len() {
+		t.consume(src, t.line)
+		t.line++
+	}
+	if t.indent {
+		t.close_indented(src, idx)
+		t.level = if idx < src.len() { indentation(src.raw[idx]) } else { 0 }
+	} else {
+		// A class whose body never opened has none (`data class P(val x: Int)`)
+		for t.classes.len > 0 && !t.classes.last().opened && t.classes.last().line < idx {
+			t.classes.pop()
+		}
+	}
+}
+
+// enter_class registers the class declared at line `idx`. Its body is the
+// next brace block, or the following lines indented deeper than it.
+pub fn (mut t ScopeTracker) enter_class(src SourceLines, idx int, name string) {
+	t.advance(src, idx)
+	t.classes << TrackedClass{
+		name:   name
+		line:   idx
+		level:  if t.indent { indentation(src.raw[idx]) } else { t.depth + 1 }
+		opened: t.indent
+	}
+}
+
+// in_class reports whether the current line is a member of a class:
+// directly in its body, at its brace depth or at the indentation of its
+// first line, not in a function nested in it.
+pub fn (t &ScopeTracker) in_class() bool {
+	if t.classes.len == 0 {
+		return false
+	}
+	top := t.classes.last()
+	if !top.opened {
+		return false
+	}
+	return if t.indent { t.level == top.body } else { t.depth == top.level }
+}
+
+// class_name returns the name of the innermost enclosing class, or ''.
+pub fn (t &ScopeTracker) class_name() string {
+	return if t.classes.len > 0 && t.classes.last().opened { t.classes.last().name } else { '' }
+}
+
+// section returns the access opened by the last label line in the
+// innermost class, or '' if there was none.
+pub fn (t &ScopeTracker) section() string {
+	return if t.in_class() { t.classes.last().access } else { '' }
+}
+
+fn (mut t ScopeTracker) consume(src SourceLines, i int) {
+	// Label lines close nothing, even where they are not indented under
+	// their class (Pascal's `private`)
+	if t.access_labels.len > 0 && t.classes.len > 0 && t.classes.last().opened
+		&& t.open_section(src.trimmed[i]) {
+		return
+	}
+	if t.indent {
+		t.close_indented(src, i)
+	} else {
+		t.count_braces(src.raw[i])
+	}
+}
+
+// close_indented leaves the classes that line `i` is not indented under.
+// Blank and comment lines do not close anything.
+fn (mut t ScopeTracker) close_indented(src SourceLines, i int) {
+	if i >= src.len() || t.classes.len == 0 {
+		return
+	}
+	trimmed := src.trimmed[i]
+	if trimmed.len == 0 || is_comment_line(trimmed) {
+		return
+	}
+	level := indentation(src.raw[i])
+	for t.classes.len > 0 && t.classes.last().line < i && level <= t.classes.last().level {
+		t.classes.pop()
+	}
+	if t.classes.len > 0 && t.classes.last().line < i && t.classes.last().body < 0 {
+		t.classes[t.classes.len - 1].body = level
+	}
+}
+
+// count_braces follows the braces of one line, outside string literals and
+// `//` comments.
+fn (mut t ScopeTracker) count_braces(line string) {
+	mut quote := u8(0)
+	mut i := 0
+	for i < line.len {
+		c := line[i]
+		if quote != 0 {
+			if c == `\\` {
+				i++
+			} else if c == quote {
+				quote = 0
+			}
+		} else if c == `"` || c == `'` || c == `\`` {
+			quote = c
+		} else if c == `/` && i + 1 < line.len && line[i + 1] == `/` {
+			return
+		} else if c == `{` {
+			t.depth++
+			if t.classes.len > 0 && !t.classes.last().opened && t.depth == t.classes.last().level {
+				t.classes[t.classes.len - 1].opened = true
+			}
+		} else if c == `}` && t.depth > 0 {
+			t.depth--
+			for t.classes.len > 0 && t.classes.last().opened && t.depth < t.classes.last().level {
+				t.classes.pop()
+			}
+		}
+		i++
+	}
+}
+
+// open_section sets the access section of the innermost class if
+// `trimmed` is a label line.
+fn (mut t ScopeTracker) open_section(trimmed string) bool {
+	if trimmed.len == 0 || trimmed.len > max_access_label_len {
+		return false
+	}
+	key := if t.fold_case { trimmed.to_lower() } else { trimmed }
+	access := t.access_labels[key] or { return false }
+	t.classes[t.classes.len - 1].access = access
+	return true
+}
+
+// indentation returns the width of the leading whitespace of `line`.
+@[inline]
+fn indentation(line string) int {
+	mut n := 0
+	for n < line.len && (line[n] == ` ` || line[n] == `\t`) {
+		n++
+	}
+	return n
+}
+
+// split_point returns the offset of the line in content[from..to] before
+// which a large file is best cut into parts that are parsed independently,
+// or -1 if there is none. A cut goes before a line that starts at column 0
+// right after a blank line, which is not preceded by a comment (so doc
+// comments stay with their declaration). Of the candidates at or after
+// `min`, the last one at the lowest brace depth wins: normally one outside
+// every block, or in the body of an unindented namespace. Braces are
+// counted as by ScopeTracker; only whole lines are looked at.
+pub fn split_point(content string, from int, min int, to int) int {
+	mut best := -1
+	mut best_depth := 0
+	mut depth := 0
+	mut after_blank := false
+	mut after_comment := false
+	mut pos := from
+	for pos < to {
+		mut end := pos
+		for end < to && content[end] != `\n` && content[end] != `\r` {
+			end++
+		}
+		if end >= to {
+			break
+		}
+		trimmed := trimmed_view(content, pos, end)
+		if trimmed.len == 0 {
+			after_blank = true
+		} else {
+			c := content[pos]
+			if after_blank && !after_comment && pos >= min && (best < 0 || depth <= best_depth)
+				&& !is_trim_space(c) && c != `}` && c != `)` && c != `]` {
+				best = pos
+				best_depth = depth
+			}
+			depth += brace_delta(str_view(content, pos, end))
+			after_blank = false
+			after_comment = is_comment_line(trimmed)
+		}
+		pos = end + 1
+		if content[end] == `\r` && pos < to && content[pos] == `\n` {
+			pos++
+		}
+	}
+	return best
+}
+
+// brace_delta returns the opening minus the closing braces of one line,
+// outside string literals and `//` comments.
+fn brace_delta(line string) int {
+	mut delta := 0
+	mut quote := u8(0)
+	mut i := 0
+	for i < line.len {
+		c := line[i]
+		if quote != 0 {
+			if c == `\\` {
+				i++
+			} else if c == quote {
+				quote = 0
+			}
+		} else if c == `"` || c == `'` || c == `\`` {
+			quote = c
+		} else if c == `/` && i + 1 < line.len && line[i + 1] == `/` {
+			break
+		} else if c == `{` {
+			delta++
+		} else if c == `}` {
+			delta--
+		}
+		i++
+	}
+	return delta
+}
@@ -0,0 +1,768 @@
+module parsers
+
+// A single-pass scanner for C-family sources, shared by CParser and
+// CppParser. The file is lexed once: comments, string and character
+// literals and preprocessor lines are skipped, and brace depth is followed,
+// so declarations are recognized from their tokens instead of line
+// heuristics. Signatures may span lines, braces and keywords inside
+// comments or strings are never mistaken for code, and function bodies are
+// skipped token by token without being examined. No regex is involved and
+// the work is linear in the size of the file.
+
+enum CTokenKind {
+	eof
+	ident
+	number
+	literal // string or character literal
+	punct   // one character, or `::`
+}
+
+struct CToken {
+	kind  CTokenKind
+	start int
+	end   int
+	line  int  // 0-based line index, as in SourceLines
+	first bool // first token on its line
+}
+
+// CLexer splits C-family source into tokens. Line breaks are counted like
+// in SourceLines: `\n`, `\r\n` and a lone `\r` each end a line.
+struct CLexer {
+	content string
+mut:
+	pos        int
+	line       int
+	line_start bool = true // nothing but blanks since the last line break
+}
+
+fn (mut l CLexer) next() CToken {
+	for l.pos < l.content.len {
+		c := l.content[l.pos]
+		if c == ` ` || c == `\t` || c == `\v` || c == `\f` {
+			l.pos++
+		} else if c == `\n` || c == `\r` {
+			l.newline()
+		} else if c == `/` && l.pos + 1 < l.content.len && l.content[l.pos + 1] == `/` {
+			l.skip_line_comment()
+		} else if c == `/` && l.pos + 1 < l.content.len && l.content[l.pos + 1] == `*` {
+			l.skip_block_comment()
+		} else if c == `#` && l.line_start {
+			l.skip_directive()
+		} else {
+			break
+		}
+	}
+	if l.pos >= l.content.len {
+		return CToken{
+			kind:  .eof
+			start: l.pos
+			end:   l.pos
+			line:  l.line
+		}
+	}
+
+	start := l.pos
+	line := l.line
+	first := l.line_start
+	c := l.content[start]
+	mut kind := CTokenKind.punct
+	if is_c_ident_start(c) {
+		kind = .ident
+		l.pos++
+		for l.pos < l.content.len && is_c_ident_char(l.content[l.pos]) {
+			l.pos++
+		}
+		if l.pos < l.content.len && l.content[l.pos] == `"` && is_raw_string_prefix(l.content, start, l.pos) {
+			kind = .literal
+			l.skip_raw_string()
+		}
+	} else if is_c_digit(c) || (c == `.` && start + 1 < l.content.len
+		&& is_c_digit(l.content[start + 1])) {
+		kind = .number
+		l.skip_number()
+	} else if c == `"` || c == `'` {
+		kind = .literal
+		l.skip_quoted(c)
+	} else if c == `:` && start + 1 < l.content.len && l.content[start + 1] == `:` {
+		l.pos += 2
+	} else {
+		l.pos++
+	}
+	l.line_start = false
+	return CToken{
+		kind:  kind
+		start: start
+		end:   l.pos
+		line:  line
+		first: first
+	}
+}
+
+// newline consumes the line break at `pos`.
+@[inline]
+fn (mut l CLexer) newline() {
+	if l.content[l.pos] == `\r` && l.pos + 1 < l.content.len && l.content[l.pos + 1] == `\n` {
+		l.pos++
+	}
+	l.pos++
+	l.line++
+	l.line_start = true
+}
+
+@[inline]
+fn (l &CLexer) is_continuation() bool {
+	return l.content[l.pos] == `\\` && l.pos + 1 < l.content.len
+		&& (l.content[l.pos + 1] == `\n` || l.content[l.pos + 1] == `\r`)
+}
+
+// skip_line_comment stops at the line break ending the comment; a
+// backslash before the break continues it on the next line.
+fn (mut l CLexer) skip_line_comment() {
+	for l.pos < l.content.len {
+		c := l.content[l.pos]
+		if c == `\n` || c == `\r` {
+			return
+		}
+		if l.is_continuation() {
+			l.pos++
+			l.newline()
+			continue
+		}
+		l.pos++
+	}
+}
+
+fn (mut l CLexer) skip_block_comment() {
+	l.pos += 2
+	for l.pos < l.content.len {
+		c := l.content[l.pos]
+		if c == `*` && l.pos + 1 < l.content.len && l.content[l.pos + 1] == `/` {
+			l.pos += 2
+			return
+		}
+		if c == `\n` || c == `\r` {
+			l.newline()
+		} else {
+			l.pos++
+		}
+	}
+}
+
+// skip_directive skips a preprocessor line, with its continuations and any
+// comment or literal in it.
+fn (mut l CLexer) skip_directive() {
+	l.pos++
+	for l.pos < l.content.len {
+		c := l.content[l.pos]
+		if c == `\n` || c == `\r` {
+			return
+		}
+		if l.is_continuation() {
+			l.pos++
+			l.newline()
+		} else if c == `/` && l.pos + 1 < l.content.len && l.content[l.pos + 1] == `/` {
+			l.skip_line_comment()
+		} else if c == `/` && l.pos + 1 < l.content.len && l.content[l.pos + 1] == `*` {
+			l.skip_block_comment()
+		} else if c == `"` || c == `'` {
+			l.skip_quoted(c)
+		} else {
+			l.pos++
+		}
+	}
+}
+
+// skip_quoted skips a string or character literal. An unterminated one
+// ends at the line break, so a stray quote (`#error don't`) cannot swallow
+// the rest of the file.
+fn (mut l CLexer) skip_quoted(quote u8) {
+	l.pos++
+	for l.pos < l.content.len {
+		c := l.content[l.pos]
+		if c == quote {
+			l.pos++
+			return
+		}
+		if c == `\n` || c == `\r` {
+			return
+		}
+		if c == `\\` {
+			if l.is_continuation() {
+				l.pos++
+				l.newline()
+				continue
+			}
+			l.pos++
+		}
+		l.pos++
+	}
+}
+
+// skip_raw_string skips a C++ raw string literal, `R"delim(...)delim"`,
+// with `pos` at its opening quote.
+fn (mut l CLexer) skip_raw_string() {
+	quote := l.pos
+	mut open := quote + 1
+	for open < l.content.len && open - quote <= 17 && l.content[open] != `(` {
+		open++
+	}
+	if open >= l.content.len || l.content[open] != `(` {
+		l.skip_quoted(`"`)
+		return
+	}
+	delim_len := open - quote - 1
+	l.pos = open + 1
+	for l.pos < l.content.len {
+		c := l.content[l.pos]
+		if c == `)` && l.closes_raw_string(quote + 1, delim_len) {
+			l.pos += delim_len + 2
+			return
+		}
+		if c == `\n` || c == `\r` {
+			l.newline()
+		} else {
+			l.pos++
+		}
+	}
+}
+
+fn (l &CLexer) closes_raw_string(delim int, delim_len int) bool {
+	end := l.pos + 1 + delim_len
+	if end >= l.content.len || l.content[end] != `"` {
+		return false
+	}
+	for k in 0 .. delim_len {
+		if l.content[l.pos + 1 + k] != l.content[delim + k] {
+			return false
+		}
+	}
+	return true
+}
+
+// skip_number skips a preprocessing number: digits, letters, `.`, digit
+// separators (`1'000`) and exponent signs.
+fn (mut l CLexer) skip_number() {
+	l.pos++
+	for l.pos < l.content.len {
+		c := l.content[l.pos]
+		if is_c_ident_char(c) || c == `.` {
+			l.pos++
+		} else if c == `'` && l.pos + 1 < l.content.len && is_c_ident_char(l.content[l.pos + 1]) {
+			l.pos += 2
+		} else if (c == `+` || c == `-`) && l.content[l.pos - 1] in [`e`, `E`, `p`, `P`] {
+			l.pos++
+		} else {
+			return
+		}
+	}
+}
+
+@[inline]
+fn is_c_digit(c u8) bool {
+	return c >= `0` && c <= `9`
+}
+
+@[inline]
+fn is_c_ident_start(c u8) bool {
+	return (c >= `a` && c <= `z`) || (c >= `A` && c <= `Z`) || c == `_` || c == `$` || c >= 0x80
+}
+
+@[inline]
+fn is_c_ident_char(c u8) bool {
+	return is_c_ident_start(c) || is_c_digit(c)
+}
+
+fn is_raw_string_prefix(content string, start int, end int) bool {
+	if content[end - 1] != `R` {
+		return false
+	}
+	n := end - start
+	return n == 1 || (n == 2 && content[start] in [`L`, `u`, `U`])
+		|| (n == 3 && content[start] == `u` && content[start + 1] == `8`)
+}
+
+// Words that end a declaration candidate when they precede its first
+// parenthesis: control flow inside a macro, or a function pointer.
+const c_not_function_names = ['if', 'for', 'while', 'switch', 'catch', 'else', 'do', 'return',
+	'void', 'char', 'short', 'int', 'long', 'float', 'double', 'signed', 'unsigned', 'bool', '_Bool']
+
+// Words followed by a parenthesized argument that is not a parameter list.
+const c_attribute_words = ['__attribute__', '__declspec', 'alignas', '_Alignas', 'decltype',
+	'typeof', '__typeof__', 'sizeof', 'alignof', 'noexcept', 'throw', 'requires']
+
+// Specifiers that may come before `struct` or `class` in a definition.
+const c_class_specifiers = ['typedef', 'export', 'extern', 'static', 'const', 'volatile', 'inline']
+
+const c_access_words = ['public', 'private', 'protected']
+
+// Words that may continue a signature on the line after its parameters.
+const c_signature_continuations = ['const', 'volatile', 'noexcept', 'override', 'final', 'throw',
+	'requires', 'try', '__attribute__']
+
+enum CScopeKind {
+	namespace  // namespace or extern "C" block: declarations continue inside
+	class_body // class or struct body
+	body       // function body, initializer, enum, ...: skipped
+	nested     // braces inside a declaration's parentheses
+}
+
+struct CScope {
+	kind       CScopeKind
+	element    int = -1 // index of the class it belongs to
+	is_typedef bool // `typedef struct { ... } name;`
+mut:
+	access string // access of the members that follow, in a class body
+}
+
+struct CClassDecl {
+	name       string
+	parent     string
+	line       int
+	is_class   bool // `class` rather than `struct`
+	is_typedef bool
+}
+
+struct CFunctionDecl {
+	name string
+	line int
+}
+
+// CFamilyScanner reads the declarations out of the token stream. Tokens
+// at declaration level (file, namespace and class scope) are collected
+// until the `;`, `{` or `}` ending the declaration; at a `{` they decide
+// whether a class or a function is being defined.
+struct CFamilyScanner {
+	cpp bool
+mut:
+	lex      CLexer
+	scopes   []CScope
+	stmt     []CToken // the declaration read so far
+	parens   int      // open parentheses in `stmt`
+	pending  int = -1 // anonymous typedef'd struct waiting for its name
+	elements []CodeElement
+}
+
+// scan_c_family returns the classes and the function definitions of a C
+// (`cpp` false) or C++ source in `src`, in source order.
+fn scan_c_family(src SourceLines, cpp bool) []CodeElement {
+	mut s := CFamilyScanner{
+		cpp: cpp
+		lex: CLexer{
+			content: src.content
+		}
+	}
+	for {
+		t := s.lex.next()
+		if t.kind == .eof {
+			break
+		}
+		s.feed(src, t)
+	}
+	return s.elements.filter(it.name.len > 0)
+}
+
+fn (mut s CFamilyScanner) feed(src SourceLines, t CToken) {
+	at_decls := s.at_declaration_level()
+	if s.is_punct(t, `{`) {
+		if !at_decls {
+			s.scopes << CScope{
+				kind: .body
+			}
+		} else if s.parens > 0 {
+			s.scopes << CScope{
+				kind: .nested
+			}
+		} else {
+			s.open_declaration(src)
+		}
+		return
+	}
+	if s.is_punct(t, `}`) {
+		// Unbalanced, e.g. after both branches of an #if opened a brace
+		if s.scopes.len == 0 {
+			return
+		}
+		scope := s.scopes.pop()
+		if scope.kind == .nested {
+			return
+		}
+		s.reset()
+		if scope.is_typedef && s.elements[scope.element].name.len == 0 {
+			s.pending = scope.element
+		}
+		return
+	}
+	if !at_decls {
+		return
+	}
+
+	if s.is_punct(t, `;`) {
+		s.reset()
+		s.pending = -1
+		return
+	}
+	if s.is_punct(t, `:`) && s.parens == 0 && s.is_access_label() {
+		s.scopes[s.scopes.len - 1].access = s.text(s.stmt[s.stmt.len - 1])
+		s.reset()
+		return
+	}
+	if t.kind == .ident {
+		if s.pending >= 0 {
+			s.elements[s.pending].name = s.text(t)
+			s.pending = -1
+		}
+		// A macro invocation without a semicolon (`DECLARE_THING(x)`) ends
+		// at its line; a signature rarely continues on the next one
+		if t.first && s.parens == 0 && s.stmt.len > 0 && s.is_punct(s.stmt[s.stmt.len - 1], `)`)
+			&& !s.word_in(t, c_signature_continuations) {
+			s.reset()
+		}
+	} else if s.is_punct(t, `(`) {
+		s.parens++
+	} else if s.is_punct(t, `)`) && s.parens > 0 {
+		s.parens--
+	}
+	s.stmt << t
+}
+
+// open_declaration handles a `{` at declaration level: it opens a
+// namespace, a class body or a function body, or some other block.
+fn (mut s CFamilyScanner) open_declaration(src SourceLines) {
+	if s.is_namespace() {
+		s.scopes << CScope{
+			kind: .namespace
+		}
+	} else if decl := s.class_decl() {
+		s.scopes << CScope{
+			kind:       .class_body
+			element:    s.elements.len
+			is_typedef: decl.is_typedef
+			access:     if decl.is_class { 'private' } else { 'public' }
+		}
+		s.elements << CodeElement{
+			element_type: 'class'
+			name:         decl.name
+			parent:       decl.parent
+			doc:          extract_doc_lines(src, s.stmt[0].line, 5)
+			line_number:  decl.line + 1
+		}
+	} else if decl := s.function_decl() {
+		in_class := s.scopes.len > 0 && s.scopes.last().kind == .class_body
+		s.elements << CodeElement{
+			element_type: if s.cpp && in_class { 'method' } else { 'function' }
+			name:         decl.name
+			access:       if in_class { s.scopes.last().access } else { 'public' }
+			doc:          extract_doc_lines(src, s.stmt[0].line, 2)
+			line_number:  decl.line + 1
+		}
+		s.scopes << CScope{
+			kind: .body
+		}
+	} else {
+		s.scopes << CScope{
+			kind: .body
+		}
+	}
+	s.reset()
+}
+
+// class_decl recognizes `[typedef] [template<...>] struct|class [attrs]
+// [Name] [final] [: [access] Base, ...]`, the head of a class definition.
+fn (s &CFamilyScanner) class_decl() ?CClassDecl {
+	stmt := s.stmt
+	mut i := 0
+	mut is_typedef := false
+	for i < stmt.len {
+		t := stmt[i]
+		if s.is_word(t, 'template') {
+			i = s.skip_angles(i + 1)
+			continue
+		}
+		if !s.word_in(t, c_class_specifiers) {
+			break
+		}
+		if s.is_word(t, 'typedef') {
+			is_typedef = true
+		}
+		i++
+	}
+	if i >= stmt.len {
+		return none
+	}
+	keyword := stmt[i]
+	is_class := s.cpp && s.is_word(keyword, 'class')
+	if !is_class && !s.is_word(keyword, 'struct') {
+		return none
+	}
+
+	mut name_first := -1
+	mut name_last := -1
+	mut j := i + 1
+	for j < stmt.len {
+		t := stmt[j]
+		if t.kind == .ident {
+			// Attribute macros: DECLSPEC(dllexport), alignas(16)
+			if j + 1 < stmt.len && s.is_punct(stmt[j + 1], `(`) {
+				j = s.skip_group(j + 1, `(`, `)`)
+				continue
+			}
+			if !s.is_word(t, 'final') {
+				if name_last < 0 || !s.is_scope_op(stmt[j - 1]) {
+					name_first = j
+				}
+				name_last = j
+			}
+		} else if s.is_punct(t, `<`) {
+			j = s.skip_angles(j)
+			continue
+		} else if s.is_punct(t, `[`) {
+			j = s.skip_group(j, `[`, `]`)
+			continue
+		} else if s.cpp && s.is_punct(t, `:`) {
+			break
+		} else if !s.is_scope_op(t) {
+			// `struct stat *f(...)`, `struct point p = ...`: not a definition
+			return none
+		}
+		j++
+	}
+
+	mut parent := ''
+	if j < stmt.len {
+		j++
+		for j < stmt.len && (s.word_in(stmt[j], c_access_words) || s.is_word(stmt[j], 'virtual')) {
+			j++
+		}
+		if j < stmt.len && stmt[j].kind == .ident {
+			last := s.qualified_end(j)
+			parent = s.lex.content[stmt[j].start..stmt[last].end]
+		}
+	}
+	return CClassDecl{
+		name:       if name_first >= 0 {
+			s.lex.content[stmt[name_first].start..stmt[name_last].end]
+		} else {
+			''
+		}
+		parent:     parent
+		line:       keyword.line
+		is_class:   is_class
+		is_typedef: is_typedef
+	}
+}
+
+// function_decl recognizes a function definition head: the name is the
+// (possibly qualified) identifier before the first parenthesis that is
+// not an attribute's, and no `=` may come before it.
+fn (s &CFamilyScanner) function_decl() ?CFunctionDecl {
+	stmt := s.stmt
+	mut depth := 0
+	mut k := 0
+	for k < stmt.len {
+		t := stmt[k]
+		if depth == 0 && s.is_word(t, 'template') {
+			// Default template arguments hold an `=`
+			k = s.skip_angles(k + 1)
+			continue
+		}
+		if depth == 0 {
+			if s.is_punct(t, `=`) {
+				return none
+			}
+			if s.is_word(t, 'operator') {
+				return s.operator_decl(k)
+			}
+		}
+		if s.is_punct(t, `(`) {
+			if depth == 0 {
+				if k == 0 || stmt[k - 1].kind != .ident
+					|| s.word_in(stmt[k - 1], c_not_function_names) {
+					return none
+				}
+				if !s.word_in(stmt[k - 1], c_attribute_words) {
+					return s.named_decl(k - 1)
+				}
+			}
+			depth++
+		} else if s.is_punct(t, `)`) {
+			depth--
+		}
+		k++
+	}
+	return none
+}
+
+// named_decl returns the function named by the identifier stmt[last],
+// with its qualification: `ns::Type::name`, `Type::~Type`.
+fn (s &CFamilyScanner) named_decl(last int) CFunctionDecl {
+	mut first := last
+	if first > 0 && s.is_punct(s.stmt[first - 1], `~`) {
+		first--
+	}
+	first = s.qualified_start(first)
+	return CFunctionDecl{
+		name: s.lex.content[s.stmt[first].start..s.stmt[last].end]
+		line: s.stmt[last].line
+	}
+}
+
+// operator_decl returns the operator function whose `operator` keyword is
+// stmt[k]: `operator==`, `operator()`, `operator bool`.
+fn (s &CFamilyScanner) operator_decl(k int) ?CFunctionDecl {
+	stmt := s.stmt
+	mut name := 'operator'
+	mut j := k + 1
+	if j + 1 < stmt.len && s.is_punct(stmt[j], `(`) && s.is_punct(stmt[j + 1], `)`) {
+		name += '()'
+		j += 2
+	}
+	for j < stmt.len && !s.is_punct(stmt[j], `(`) {
+		name += if stmt[j].kind == .ident { ' ' + s.text(stmt[j]) } else { s.text(stmt[j]) }
+		j++
+	}
+	if j >= stmt.len {
+		return none
+	}
+	first := s.qualified_start(k)
+	return CFunctionDecl{
+		name: s.lex.content[stmt[first].start..stmt[k].start] + name
+		line: stmt[k].line
+	}
+}
+
+// qualified_start returns the index of the first token of the qualified
+// name ending with stmt[last]: `a` in `a::b::c`.
+fn (s &CFamilyScanner) qualified_start(last int) int {
+	mut first := last
+	for first >= 2 && s.is_scope_op(s.stmt[first - 1]) && s.stmt[first - 2].kind == .ident {
+		first -= 2
+	}
+	return first
+}
+
+// qualified_end returns the index of the last token of the qualified name
+// starting with stmt[first].
+fn (s &CFamilyScanner) qualified_end(first int) int {
+	mut last := first
+	for last + 2 < s.stmt.len && s.is_scope_op(s.stmt[last + 1]) && s.stmt[last + 2].kind == .ident {
+		last += 2
+	}
+	return last
+}
+
+// skip_group returns the index after the group opened by stmt[start].
+fn (s &CFamilyScanner) skip_group(start int, open u8, close u8) int {
+	mut depth := 0
+	for j in start .. s.stmt.len {
+		if s.is_punct(s.stmt[j], open) {
+			depth++
+		} else if s.is_punct(s.stmt[j], close) {
+			depth--
+			if depth == 0 {
+				return j + 1
+			}
+		}
+	}
+	return s.stmt.len
+}
+
+// skip_angles returns the index after the template argument list opened
+// by stmt[start], or `start` if there is none.
+fn (s &CFamilyScanner) skip_angles(start int) int {
+	if start >= s.stmt.len || !s.is_punct(s.stmt[start], `<`) {
+		return start
+	}
+	mut depth := 0
+	mut parens := 0
+	for j in start .. s.stmt.len {
+		t := s.stmt[j]
+		if s.is_punct(t, `(`) {
+			parens++
+		} else if s.is_punct(t, `)`) {
+			parens--
+		} else if parens == 0 && s.is_punct(t, `<`) {
+			depth++
+		} else if parens == 0 && s.is_punct(t, `>`) {
+			depth--
+			if depth == 0 {
+				return j + 1
+			}
+		}
+	}
+	return s.stmt.len
+}
+
+// is_namespace matches `namespace x`, `inline namespace x` and
+// `extern "C"`.
+fn (s &CFamilyScanner) is_namespace() bool {
+	stmt := s.stmt
+	if stmt.len == 0 {
+		return false
+	}
+	if s.is_word(stmt[0], 'namespace') || (stmt.len > 1 && s.is_word(stmt[1], 'namespace')) {
+		return true
+	}
+	return stmt.len == 2 && s.is_word(stmt[0], 'extern') && stmt[1].kind == .literal
+}
+
+// is_access_label reports whether a `:` now ends an access label, like
+// `public:` or Qt's `private slots:`.
+fn (s &CFamilyScanner) is_access_label() bool {
+	if s.scopes.len == 0 || s.scopes.last().kind != .class_body || s.stmt.len == 0 || !s.cpp {
+		return false
+	}
+	n := s.stmt.len
+	if s.word_in(s.stmt[n - 1], c_access_words) {
+		return true
+	}
+	return n >= 2 && s.stmt[n - 1].kind == .ident && s.word_in(s.stmt[n - 2], c_access_words)
+		&& s.is_word(s.stmt[n - 1], 'slots')
+}
+
+@[inline]
+fn (s &CFamilyScanner) at_declaration_level() bool {
+	return s.scopes.len == 0 || s.scopes.last().kind in [.namespace, .class_body]
+}
+
+@[inline]
+fn (mut s CFamilyScanner) reset() {
+	s.stmt.clear()
+	s.parens = 0
+}
+
+// text returns an owned copy of the token's text.
+fn (s &CFamilyScanner) text(t CToken) string {
+	return s.lex.content[t.start..t.end]
+}
+
+@[inline]
+fn (s &CFamilyScanner) is_punct(t CToken, c u8) bool {
+	return t.kind == .punct && t.end - t.start == 1 && s.lex.content[t.start] == c
+}
+
+@[inline]
+fn (s &CFamilyScanner) is_scope_op(t CToken) bool {
+	return t.kind == .punct && t.end - t.start == 2
+}
+
+// is_word compares an identifier with `word` without copying it.
+fn (s &CFamilyScanner) is_word(t CToken, word string) bool {
+	if t.kind != .ident || t.end - t.start != word.len {
+		return false
+	}
+	for k in 0 .. word.len {
+		if s.lex.content[t.start + k] != word[k] {
+			return false
+		}
+	}
+	return true
+}
+
+fn (s &CFamilyScanner) word_in(t CToken, words []string) bool {
+	for word in words {
+		if s.is_word(t, word) {
+			return true
+		}
+	}
+	return false
+}
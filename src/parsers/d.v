@@ -1,23 +1,30 @@
 module parsers
 
-import regex
+pub struct DParser {
+mut:
+    patterns PatternRegistry
+}
 
-pub struct DParser {}
+// Lines that can start a declaration, see LinePrefilter.
+const d_prefilter = new_line_prefilter(['module ', 'class ', 'struct ', '('], false)
 
 pub fn (p DParser) get_extensions() []string {
     return ['.d']
 }
 
-pub fn (p DParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p DParser) parse(content string, file_path string) ParseResult {
     mut result := ParseResult{
         file_path: file_path
         elements:  []CodeElement{}
     }
 
-    lines := content.split_into_lines()
+    src := new_filtered_source_lines(content, d_prefilter)
+    mut scopes := new_scope_tracker(false, map[string]string{}, false)
 
-    for i, line in lines {
-        trimmed := line.trim_space()
+    for i, trimmed in src.trimmed {
+        if !src.is_candidate(i) {
+            continue
+        }
 
         // Skip comments
         if trimmed.starts_with('//') || trimmed.starts_with('/*') {
@@ -26,15 +33,15 @@ pub fn (p DParser) parse(content string, file_path string) ParseResult {
 
         // Parse module definitions
         if trimmed.starts_with('module ') {
-            result.elements << p.parse_module(lines, i)
+            result.elements << p.parse_module(src, i)
         }
         // Parse class/struct definitions
         else if trimmed.starts_with('class ') || trimmed.starts_with('struct ') {
-            result.elements << p.parse_class(lines, i)
+            result.elements << p.parse_class(src, i, mut scopes)
         }
         // Parse function definitions
         else if p.is_function_line(trimmed) {
-            element := p.parse_function(lines, i)
+            element := p.parse_function(src, i, mut scopes)
             if element.name != '' {
                 result.elements << element
             }
@@ -59,23 +66,18 @@ fn (p DParser) is_function_line(line string) bool {
         || line.contains('string '))
 }
 
-fn (p DParser) parse_module(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p DParser) parse_module(src SourceLines, idx int) CodeElement {
+    line := src.trimmed[idx]
 
     mut mod_name := ''
 
     // Extract module name
-    mut re := regex.regex_opt(r'module\s+([\w.]+)') or { panic(err) }
-    start, _ := re.match_string(line)
-
-    if start >= 0 {
-        groups := re.get_group_list()
-        if groups.len > 0 {
-            mod_name = line[groups[0].start..groups[0].end]
-        }
+    groups := p.patterns.captures(r'module\s+([\w.]+)', line)
+    if groups.len > 0 {
+        mod_name = groups[0]
     }
 
-    doc := extract_doc_lines(lines, idx, 5)
+    doc := extract_doc_lines(src, idx, 5)
 
     return CodeElement{
         element_type: 'module'
@@ -85,8 +87,8 @@ fn (p DParser) parse_module(lines []string, idx int) CodeElement {
     }
 }
 
-fn (p DParser) parse_class(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p DParser) parse_class(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+    line := src.trimmed[idx]
 
     mut class_name := ''
     mut parent := ''
@@ -98,20 +100,16 @@ fn (p DParser) parse_class(lines []string, idx int) CodeElement {
     relevant_line := if start_pos != -1 { line[start_pos..] } else { line }
 
     // Extract class name and inheritance
-    mut re := regex.regex_opt(r'\w+\s+(\w+)(?:\s*:\s*(\w+))?') or { panic(err) }
-    start, _ := re.match_string(relevant_line)
-
-    if start >= 0 {
-        groups := re.get_group_list()
-        if groups.len > 0 {
-            class_name = relevant_line[groups[0].start..groups[0].end]
-        }
-        if groups.len > 1 && groups[1].start >= 0 {
-            parent = relevant_line[groups[1].start..groups[1].end]
-        }
+    groups := p.patterns.captures(r'\w+\s+(\w+)(?:\s*:\s*(\w+))?', relevant_line)
+    if groups.len > 0 {
+        class_name = groups[0]
+    }
+    if groups.len > 1 && groups[1].len > 0 {
+        parent = groups[1]
     }
 
-    doc := extract_doc_lines(lines, idx, 5)
+    doc := extract_doc_lines(src, idx, 5)
+    scopes.enter_class(src, idx, class_name)
 
     return CodeElement{
         element_type: 'class'
@@ -122,8 +120,9 @@ fn (p DParser) parse_class(lines []string, idx int) CodeElement {
     }
 }
 
-fn (p DParser) parse_function(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p DParser) parse_function(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+    scopes.advance(src, idx)
+    line := src.trimmed[idx]
 
     mut func_name := ''
     mut access := 'public'
@@ -145,14 +144,10 @@ fn (p DParser) parse_function(lines []string, idx int) CodeElement {
         }
     }
 
-    doc := extract_doc_lines(lines, idx, 2)
+    doc := extract_doc_lines(src, idx, 2)
 
-    // Determine if it's a method based on indentation
-    element_type := if lines[idx].starts_with(' ') || lines[idx].starts_with('\t') {
-        'method'
-    } else {
-        'function'
-    }
+    // Functions declared in a class body are methods
+    element_type := if scopes.in_class() { 'method' } else { 'function' }
 
     return CodeElement{
         element_type: element_type
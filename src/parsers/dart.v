@@ -1,23 +1,30 @@
 module parsers
 
-import regex
+pub struct DartParser {
+mut:
+	patterns PatternRegistry
+}
 
-pub struct DartParser {}
+// Lines that can start a declaration, see LinePrefilter.
+const dart_prefilter = new_line_prefilter(['class ', '('], false)
 
 pub fn (p DartParser) get_extensions() []string {
 	return ['.dart']
 }
 
-pub fn (p DartParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p DartParser) parse(content string, file_path string) ParseResult {
 	mut result := ParseResult{
 		file_path: file_path
 		elements:  []CodeElement{}
 	}
 
-	lines := content.split_into_lines()
+	src := new_filtered_source_lines(content, dart_prefilter)
+	mut scopes := new_scope_tracker(false, map[string]string{}, false)
 
-	for i, line in lines {
-		trimmed := line.trim_space()
+	for i, trimmed in src.trimmed {
+		if !src.is_candidate(i) {
+			continue
+		}
 
 		// Skip comments
 		if trimmed.starts_with('//') || trimmed.starts_with('/*') {
@@ -26,11 +33,11 @@ pub fn (p DartParser) parse(content string, file_path string) ParseResult {
 
 		// Parse class definitions
 		if trimmed.contains('class ') {
-			result.elements << p.parse_class(lines, i)
+			result.elements << p.parse_class(src, i, mut scopes)
 		}
 		// Parse function/method definitions
 		else if p.is_function_line(trimmed) {
-			element := p.parse_function(lines, i)
+			element := p.parse_function(src, i, mut scopes)
 			if element.name != '' {
 				result.elements << element
 			}
@@ -56,27 +63,23 @@ fn (p DartParser) is_function_line(line string) bool {
 		|| line.contains('Stream') || line.ends_with('{') || line.ends_with('=>'))
 }
 
-fn (p DartParser) parse_class(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p DartParser) parse_class(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+	line := src.trimmed[idx]
 
 	mut class_name := ''
 	mut parent := ''
 
 	// Extract class name and inheritance
-	mut re := regex.regex_opt(r'class\s+(\w+)(?:\s+extends\s+(\w+))?') or { panic(err) }
-	start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 {
-			class_name = line[groups[0].start..groups[0].end]
-		}
-		if groups.len > 1 && groups[1].start >= 0 {
-			parent = line[groups[1].start..groups[1].end]
-		}
+	groups := p.patterns.captures(r'class\s+(\w+)(?:\s+extends\s+(\w+))?', line)
+	if groups.len > 0 {
+		class_name = groups[0]
+	}
+	if groups.len > 1 && groups[1].len > 0 {
+		parent = groups[1]
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
+	scopes.enter_class(src, idx, class_name)
 
 	return CodeElement{
 		element_type: 'class'
@@ -87,8 +90,9 @@ fn (p DartParser) parse_class(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p DartParser) parse_function(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p DartParser) parse_function(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+	scopes.advance(src, idx)
+	line := src.trimmed[idx]
 
 	mut func_name := ''
 	mut access := 'public'
@@ -99,27 +103,18 @@ fn (p DartParser) parse_function(lines []string, idx int) CodeElement {
 	}
 
 	// Extract function name
-	mut re := regex.regex_opt(r'(\w+)\s*\(') or { panic(err) }
-	start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 {
-			potential_name := line[groups[0].start..groups[0].end]
-			if potential_name !in ['if', 'for', 'while', 'switch', 'catch', 'else'] {
-				func_name = potential_name
-			}
+	groups := p.patterns.captures(r'(\w+)\s*\(', line)
+	if groups.len > 0 {
+		potential_name := groups[0]
+		if potential_name !in ['if', 'for', 'while', 'switch', 'catch', 'else'] {
+			func_name = potential_name
 		}
 	}
 
-	doc := extract_doc_lines(lines, idx, 2)
+	doc := extract_doc_lines(src, idx, 2)
 
-	// Determine if it's a method based on indentation
-	element_type := if lines[idx].starts_with(' ') || lines[idx].starts_with('\t') {
-		'method'
-	} else {
-		'function'
-	}
+	// Functions declared in a class body are methods
+	element_type := if scopes.in_class() { 'method' } else { 'function' }
 
 	return CodeElement{
 		element_type: element_type
@@ -1,23 +1,29 @@
 module parsers
 
-import regex
+pub struct GoParser {
+mut:
+    patterns PatternRegistry
+}
 
-pub struct GoParser {}
+// Lines that can start a declaration, see LinePrefilter.
+const go_prefilter = new_line_prefilter(['type ', 'func '], false)
 
 pub fn (p GoParser) get_extensions() []string {
     return ['.go']
 }
 
-pub fn (p GoParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p GoParser) parse(content string, file_path string) ParseResult {
     mut result := ParseResult{
         file_path: file_path
         elements:  []CodeElement{}
     }
 
-    lines := content.split_into_lines()
+    src := new_filtered_source_lines(content, go_prefilter)
 
-    for i, line in lines {
-        trimmed := line.trim_space()
+    for i, trimmed in src.trimmed {
+        if !src.is_candidate(i) {
+            continue
+        }
 
         // Skip comments
         if trimmed.starts_with('//') || trimmed.starts_with('/*') {
@@ -26,11 +32,11 @@ pub fn (p GoParser) parse(content string, file_path string) ParseResult {
 
         // Parse type definitions (structs, interfaces)
         if trimmed.starts_with('type ') {
-            result.elements << p.parse_type(lines, i)
+            result.elements << p.parse_type(src, i)
         }
         // Parse function definitions
         else if trimmed.starts_with('func ') {
-            element := p.parse_function(lines, i)
+            element := p.parse_function(src, i)
             if element.name != '' {
                 result.elements << element
             }
@@ -40,23 +46,18 @@ pub fn (p GoParser) parse(content string, file_path string) ParseResult {
     return result
 }
 
-fn (p GoParser) parse_type(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p GoParser) parse_type(src SourceLines, idx int) CodeElement {
+    line := src.trimmed[idx]
 
     mut type_name := ''
 
     // Extract type name
-    mut re := regex.regex_opt(r'type\s+(\w+)') or { panic(err) }
-    start, _ := re.match_string(line)
-
-    if start >= 0 {
-        groups := re.get_group_list()
-        if groups.len > 0 {
-            type_name = line[groups[0].start..groups[0].end]
-        }
+    groups := p.patterns.captures(r'type\s+(\w+)', line)
+    if groups.len > 0 {
+        type_name = groups[0]
     }
 
-    doc := extract_doc_lines(lines, idx, 5)
+    doc := extract_doc_lines(src, idx, 5)
 
     return CodeElement{
         element_type: 'class'
@@ -66,8 +67,8 @@ fn (p GoParser) parse_type(lines []string, idx int) CodeElement {
     }
 }
 
-fn (p GoParser) parse_function(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p GoParser) parse_function(src SourceLines, idx int) CodeElement {
+    line := src.trimmed[idx]
 
     mut func_name := ''
     mut access := 'private'
@@ -98,7 +99,7 @@ fn (p GoParser) parse_function(lines []string, idx int) CodeElement {
         }
     }
 
-    doc := extract_doc_lines(lines, idx, 2)
+    doc := extract_doc_lines(src, idx, 2)
 
     // Check if it's a method (has receiver)
     element_type := if line.contains('func (') {
@@ -1,23 +1,29 @@
 module parsers
 
-import regex
+pub struct JavaParser {
+mut:
+    patterns PatternRegistry
+}
 
-pub struct JavaParser {}
+// Lines that can start a declaration, see LinePrefilter.
+const java_prefilter = new_line_prefilter(['class ', 'interface ', 'enum ', '('], false)
 
 pub fn (p JavaParser) get_extensions() []string {
     return ['.java']
 }
 
-pub fn (p JavaParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p JavaParser) parse(content string, file_path string) ParseResult {
     mut result := ParseResult{
         file_path: file_path
         elements:  []CodeElement{}
     }
 
-    lines := content.split_into_lines()
+    src := new_filtered_source_lines(content, java_prefilter)
 
-    for i, line in lines {
-        trimmed := line.trim_space()
+    for i, trimmed in src.trimmed {
+        if !src.is_candidate(i) {
+            continue
+        }
 
         // Skip comments
         if trimmed.starts_with('//') || trimmed.starts_with('/*') {
@@ -27,12 +33,12 @@ pub fn (p JavaParser) parse(content string, file_path string) ParseResult {
         // Parse class/interface definitions
         if trimmed.contains('class ') || trimmed.contains('interface ') || trimmed.contains('enum ') {
             if !trimmed.ends_with(';') { // Skip forward declarations
-                result.elements << p.parse_class(lines, i)
+                result.elements << p.parse_class(src, i)
             }
         }
         // Parse method definitions
         else if p.is_method_line(trimmed) {
-            element := p.parse_method(lines, i)
+            element := p.parse_method(src, i)
             if element.name != '' {
                 result.elements << element
             }
@@ -59,8 +65,8 @@ fn (p JavaParser) is_method_line(line string) bool {
         || line.contains('private ') || line.contains('protected '))
 }
 
-fn (p JavaParser) parse_class(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p JavaParser) parse_class(src SourceLines, idx int) CodeElement {
+    line := src.trimmed[idx]
 
     mut class_name := ''
     mut parent := ''
@@ -73,22 +79,15 @@ fn (p JavaParser) parse_class(lines []string, idx int) CodeElement {
     relevant_line := if start_pos != -1 { line[start_pos..] } else { line }
 
     // Extract class name and inheritance
-    mut re := regex.regex_opt(r'\w+\s+(\w+)(?:\s+extends\s+(\w+))?') or {
-        panic(err)
+    groups := p.patterns.captures(r'\w+\s+(\w+)(?:\s+extends\s+(\w+))?', relevant_line)
+    if groups.len > 0 {
+        class_name = groups[0]
     }
-    start, _ := re.match_string(relevant_line)
-
-    if start >= 0 {
-        groups := re.get_group_list()
-        if groups.len > 0 {
-            class_name = relevant_line[groups[0].start..groups[0].end]
-        }
-        if groups.len > 1 && groups[1].start >= 0 {
-            parent = relevant_line[groups[1].start..groups[1].end]
-        }
+    if groups.len > 1 && groups[1].len > 0 {
+        parent = groups[1]
     }
 
-    doc := extract_doc_lines(lines, idx, 5)
+    doc := extract_doc_lines(src, idx, 5)
 
     return CodeElement{
         element_type: 'class'
@@ -99,8 +98,8 @@ fn (p JavaParser) parse_class(lines []string, idx int) CodeElement {
     }
 }
 
-fn (p JavaParser) parse_method(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p JavaParser) parse_method(src SourceLines, idx int) CodeElement {
+    line := src.trimmed[idx]
 
     mut method_name := ''
     mut access := 'public'
@@ -123,7 +122,7 @@ fn (p JavaParser) parse_method(lines []string, idx int) CodeElement {
         }
     }
 
-    doc := extract_doc_lines(lines, idx, 2)
+    doc := extract_doc_lines(src, idx, 2)
 
     return CodeElement{
         element_type: 'method'
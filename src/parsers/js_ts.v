@@ -1,23 +1,31 @@
 module parsers
 
-import regex
+pub struct JsTsParser {
+mut:
+	patterns PatternRegistry
+}
 
-pub struct JsTsParser {}
+// Lines that can start a declaration, see LinePrefilter.
+// Every function form needs `function `, `=>` or a parenthesis.
+const js_ts_prefilter = new_line_prefilter(['interface ', 'class ', 'function ', '=>', '('], false)
 
 pub fn (p JsTsParser) get_extensions() []string {
 	return ['.js', '.ts', '.jsx', '.tsx']
 }
 
-pub fn (p JsTsParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p JsTsParser) parse(content string, file_path string) ParseResult {
 	mut result := ParseResult{
 		file_path: file_path
 		elements:  []CodeElement{}
 	}
 
-	lines := content.split_into_lines()
+	src := new_filtered_source_lines(content, js_ts_prefilter)
+	mut scopes := new_scope_tracker(false, map[string]string{}, false)
 
-	for i, line in lines {
-		trimmed := line.trim_space()
+	for i, trimmed in src.trimmed {
+		if !src.is_candidate(i) {
+			continue
+		}
 
 		// Skip comments
 		if trimmed.starts_with('//') || trimmed.starts_with('/*') {
@@ -26,21 +34,21 @@ pub fn (p JsTsParser) parse(content string, file_path string) ParseResult {
 
 		// Parse interface definitions
 		if trimmed.contains('interface ') {
-			element := p.parse_interface(lines, i)
+			element := p.parse_interface(src, i)
 			if element.name != '' {
 				result.elements << element
 			}
 		}
 		// Parse class definitions
 		else if trimmed.contains('class ') {
-			element := p.parse_class(lines, i)
+			element := p.parse_class(src, i, mut scopes)
 			if element.name != '' {
 				result.elements << element
 			}
 		}
 		// Parse function/method definitions
 		else if p.is_function_line(trimmed) {
-			element := p.parse_function(lines, i)
+			element := p.parse_function(src, i, mut scopes)
 			if element.name != '' {
 				result.elements << element
 			}
@@ -88,40 +96,27 @@ pub fn (p JsTsParser) is_function_line(line string) bool {
 		|| (test_line.contains('(') && test_line.ends_with('{') && !test_line.starts_with('if') && !test_line.starts_with('for') && !test_line.starts_with('while') && !test_line.starts_with('switch') && !test_line.starts_with('catch'))
 }
 
-fn (p JsTsParser) parse_interface(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p JsTsParser) parse_interface(src SourceLines, idx int) CodeElement {
+	line := src.trimmed[idx]
 
 	mut interface_name := ''
 	mut parent := ''
 
 	// Extract interface name and inheritance
-	mut re := regex.regex_opt(r'export\s+interface\s+(\w+)(?:\s+extends\s+([\w\s,]+))?') or { panic(err) }
-	mut start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 {
-			interface_name = line[groups[0].start..groups[0].end]
-		}
-		if groups.len > 1 && groups[1].start >= 0 {
-			parent = line[groups[1].start..groups[1].end].trim_space()
-		}
-	} else {
+	mut groups := p.patterns.captures(r'export\s+interface\s+(\w+)(?:\s+extends\s+([\w\s,]+))?', line)
+	if groups.len == 0 {
 		// Try without export keyword
-		re = regex.regex_opt(r'interface\s+(\w+)(?:\s+extends\s+([\w\s,]+))?') or { panic(err) }
-		start, _ = re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				interface_name = line[groups[0].start..groups[0].end]
-			}
-			if groups.len > 1 && groups[1].start >= 0 {
-				parent = line[groups[1].start..groups[1].end].trim_space()
-			}
-		}
+		groups = p.patterns.captures(r'interface\s+(\w+)(?:\s+extends\s+([\w\s,]+))?', line)
+	}
+
+	if groups.len > 0 {
+		interface_name = groups[0]
+	}
+	if groups.len > 1 && groups[1].len > 0 {
+		parent = groups[1].trim_space()
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
 
 	return CodeElement{
 		element_type: 'interface'
@@ -132,40 +127,28 @@ fn (p JsTsParser) parse_interface(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p JsTsParser) parse_class(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p JsTsParser) parse_class(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+	line := src.trimmed[idx]
 
 	mut class_name := ''
 	mut parent := ''
 
 	// Extract class name and inheritance - handle export class and regular class
-	mut re := regex.regex_opt(r'export\s+class\s+(\w+)(?:\s+extends\s+(\w+))?') or { panic(err) }
-	mut start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 {
-			class_name = line[groups[0].start..groups[0].end]
-		}
-		if groups.len > 1 && groups[1].start >= 0 {
-			parent = line[groups[1].start..groups[1].end]
-		}
-	} else {
+	mut groups := p.patterns.captures(r'export\s+class\s+(\w+)(?:\s+extends\s+(\w+))?', line)
+	if groups.len == 0 {
 		// Try without export keyword
-		re = regex.regex_opt(r'class\s+(\w+)(?:\s+extends\s+(\w+))?') or { panic(err) }
-		start, _ = re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				class_name = line[groups[0].start..groups[0].end]
-			}
-			if groups.len > 1 && groups[1].start >= 0 {
-				parent = line[groups[1].start..groups[1].end]
-			}
-		}
+		groups = p.patterns.captures(r'class\s+(\w+)(?:\s+extends\s+(\w+))?', line)
+	}
+
+	if groups.len > 0 {
+		class_name = groups[0]
+	}
+	if groups.len > 1 && groups[1].len > 0 {
+		parent = groups[1]
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
+	scopes.enter_class(src, idx, class_name)
 
 	return CodeElement{
 		element_type: 'class'
@@ -176,8 +159,9 @@ fn (p JsTsParser) parse_class(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p JsTsParser) parse_function(lines []string, idx int) CodeElement {
-	mut line := lines[idx].trim_space()
+fn (mut p JsTsParser) parse_function(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+	scopes.advance(src, idx)
+	mut line := src.trimmed[idx]
 
 	mut func_name := ''
 	mut access := 'public'
@@ -204,34 +188,25 @@ fn (p JsTsParser) parse_function(lines []string, idx int) CodeElement {
 
 	// Try different function patterns
 	// Traditional function
-	mut re := regex.regex_opt(r'function\s+(\w+)\s*\(') or { panic(err) }
-	mut start, _ := re.match_string(line)
+	groups := p.patterns.captures(r'function\s+(\w+)\s*\(', line)
 
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 {
-			func_name = line[groups[0].start..groups[0].end]
-		}
+	if groups.len > 0 {
+		func_name = groups[0]
 	} else {
 		// Method or arrow function pattern: name(...) { or name = (...) =>
-		re = regex.regex_opt(r'(\w+)\s*\(') or { panic(err) }
-		start, _ = re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				potential_name := line[groups[0].start..groups[0].end]
-				if potential_name !in ['if', 'for', 'while', 'switch', 'catch', 'else'] {
-					func_name = potential_name
-				}
+		call_groups := p.patterns.captures(r'(\w+)\s*\(', line)
+		if call_groups.len > 0 {
+			potential_name := call_groups[0]
+			if potential_name !in ['if', 'for', 'while', 'switch', 'catch', 'else'] {
+				func_name = potential_name
 			}
 		}
 	}
 
-	doc := extract_doc_lines(lines, idx, 2)
+	doc := extract_doc_lines(src, idx, 2)
 
-	// Determine if it's a method based on indentation or context
-	// Methods are typically indented within a class
-	if lines[idx].starts_with(' ') || lines[idx].starts_with('\t') {
+	// Functions declared in a class body are methods
+	if scopes.in_class() {
 		element_type = 'method'
 	}
 
@@ -1,23 +1,30 @@
 module parsers
 
-import regex
+pub struct KotlinParser {
+mut:
+	patterns PatternRegistry
+}
 
-pub struct KotlinParser {}
+// Lines that can start a declaration, see LinePrefilter.
+const kotlin_prefilter = new_line_prefilter(['class ', 'object ', 'interface ', 'fun '], false)
 
 pub fn (p KotlinParser) get_extensions() []string {
 	return ['.kt', '.kts']
 }
 
-pub fn (p KotlinParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p KotlinParser) parse(content string, file_path string) ParseResult {
 	mut result := ParseResult{
 		file_path: file_path
 		elements:  []CodeElement{}
 	}
 
-	lines := content.split_into_lines()
+	src := new_filtered_source_lines(content, kotlin_prefilter)
+	mut scopes := new_scope_tracker(false, map[string]string{}, false)
 
-	for i, line in lines {
-		trimmed := line.trim_space()
+	for i, trimmed in src.trimmed {
+		if !src.is_candidate(i) {
+			continue
+		}
 
 		// Skip empty lines
 		if trimmed.len == 0 {
@@ -27,11 +34,11 @@ pub fn (p KotlinParser) parse(content string, file_path string) ParseResult {
 		// Parse class definitions
 		if trimmed.starts_with('class ') || trimmed.starts_with('data class ')
 			|| trimmed.starts_with('object ') || trimmed.starts_with('interface ') {
-			result.elements << p.parse_class(lines, i)
+			result.elements << p.parse_class(src, i, mut scopes)
 		}
 		// Parse function/method definitions
 		else if trimmed.starts_with('fun ') {
-			element := p.parse_function(lines, i)
+			element := p.parse_function(src, i, mut scopes)
 			if element.name != '' {
 				result.elements << element
 			}
@@ -41,8 +48,8 @@ pub fn (p KotlinParser) parse(content string, file_path string) ParseResult {
 	return result
 }
 
-fn (p KotlinParser) parse_class(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p KotlinParser) parse_class(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+	line := src.trimmed[idx]
 
 	mut class_name := ''
 	mut parent := ''
@@ -51,57 +58,38 @@ fn (p KotlinParser) parse_class(lines []string, idx int) CodeElement {
 	// Determine element type and extract class name
 	if line.starts_with('data class ') {
 		element_type = 'data class'
-		mut re := regex.regex_opt(r'data\s+class\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				class_name = line[groups[0].start..groups[0].end]
-			}
+		groups := p.patterns.captures(r'data\s+class\s+(\w+)', line)
+		if groups.len > 0 {
+			class_name = groups[0]
 		}
 	} else if line.starts_with('interface ') {
 		element_type = 'interface'
-		mut re := regex.regex_opt(r'interface\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				class_name = line[groups[0].start..groups[0].end]
-			}
+		groups := p.patterns.captures(r'interface\s+(\w+)', line)
+		if groups.len > 0 {
+			class_name = groups[0]
 		}
 	} else if line.starts_with('object ') {
 		element_type = 'object'
-		mut re := regex.regex_opt(r'object\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				class_name = line[groups[0].start..groups[0].end]
-			}
+		groups := p.patterns.captures(r'object\s+(\w+)', line)
+		if groups.len > 0 {
+			class_name = groups[0]
 		}
 	} else {
 		// Regular class
-		mut re := regex.regex_opt(r'class\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				class_name = line[groups[0].start..groups[0].end]
-			}
+		groups := p.patterns.captures(r'class\s+(\w+)', line)
+		if groups.len > 0 {
+			class_name = groups[0]
 		}
 	}
 
 	// Extract parent class from inheritance (after colon)
-	mut extends_re := regex.regex_opt(r':\s*([\w\s,]+)') or { panic(err) }
-	extends_start, _ := extends_re.match_string(line)
-	if extends_start >= 0 {
-		extends_groups := extends_re.get_group_list()
-		if extends_groups.len > 0 {
-			parent = line[extends_groups[0].start..extends_groups[0].end].split(',')[0].trim_space()
-		}
+	extends_groups := p.patterns.captures(r':\s*([\w\s,]+)', line)
+	if extends_groups.len > 0 {
+		parent = extends_groups[0].split(',')[0].trim_space()
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
+	scopes.enter_class(src, idx, class_name)
 
 	return CodeElement{
 		element_type: element_type
@@ -112,8 +100,9 @@ fn (p KotlinParser) parse_class(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p KotlinParser) parse_function(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p KotlinParser) parse_function(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+	scopes.advance(src, idx)
+	line := src.trimmed[idx]
 
 	mut func_name := ''
 	mut access := 'public'
@@ -128,24 +117,15 @@ fn (p KotlinParser) parse_function(lines []string, idx int) CodeElement {
 	}
 
 	// Extract function name
-	mut re := regex.regex_opt(r'fun\s+(\w+)\s*\(') or { panic(err) }
-	start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 {
-			func_name = line[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'fun\s+(\w+)\s*\(', line)
+	if groups.len > 0 {
+		func_name = groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 2)
+	doc := extract_doc_lines(src, idx, 2)
 
-	// Determine if it's a method or function based on indentation
-	element_type := if lines[idx].starts_with(' ') || lines[idx].starts_with('\t') {
-		'method'
-	} else {
-		'function'
-	}
+	// Functions declared in a class body are methods
+	element_type := if scopes.in_class() { 'method' } else { 'function' }
 
 	return CodeElement{
 		element_type: element_type
@@ -1,23 +1,29 @@
 module parsers
 
-import regex
+pub struct LuaParser {
+mut:
+	patterns PatternRegistry
+}
 
-pub struct LuaParser {}
+// Lines that can start a declaration, see LinePrefilter.
+const lua_prefilter = new_line_prefilter(['function '], false)
 
 pub fn (p LuaParser) get_extensions() []string {
 	return ['.lua']
 }
 
-pub fn (p LuaParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p LuaParser) parse(content string, file_path string) ParseResult {
 	mut result := ParseResult{
 		file_path: file_path
 		elements:  []CodeElement{}
 	}
 
-	lines := content.split_into_lines()
+	src := new_filtered_source_lines(content, lua_prefilter)
 
-	for i, line in lines {
-		trimmed := line.trim_space()
+	for i, trimmed in src.trimmed {
+		if !src.is_candidate(i) {
+			continue
+		}
 
 		// Skip comments
 		if trimmed.starts_with('--') {
@@ -26,15 +32,15 @@ pub fn (p LuaParser) parse(content string, file_path string) ParseResult {
 
 		// Parse function definitions
 		if trimmed.starts_with('function ') || trimmed.starts_with('local function ') {
-			result.elements << p.parse_function(lines, i)
+			result.elements << p.parse_function(src, i)
 		}
 	}
 
 	return result
 }
 
-fn (p LuaParser) parse_function(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p LuaParser) parse_function(src SourceLines, idx int) CodeElement {
+	line := src.trimmed[idx]
 
 	mut func_name := ''
 	mut access := 'public'
@@ -46,14 +52,9 @@ fn (p LuaParser) parse_function(lines []string, idx int) CodeElement {
 	}
 
 	// Extract function name (handle both function name() and function obj:method())
-	mut re := regex.regex_opt(r'function\s+(?:[\w.]+[.:])?(\w+)\s*\(') or { panic(err) }
-	start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 {
-			func_name = line[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'function\s+(?:[\w.]+[.:])?(\w+)\s*\(', line)
+	if groups.len > 0 {
+		func_name = groups[0]
 	}
 
 	// Check if it's a method (uses : syntax)
@@ -61,7 +62,7 @@ fn (p LuaParser) parse_function(lines []string, idx int) CodeElement {
 		element_type = 'method'
 	}
 
-	doc := extract_doc_lines(lines, idx, 2)
+	doc := extract_doc_lines(src, idx, 2)
 
 	return CodeElement{
 		element_type: element_type
@@ -1,23 +1,42 @@
 module parsers
 
-import regex
+pub struct PascalParser {
+mut:
+    patterns PatternRegistry
+}
 
-pub struct PascalParser {}
+// Lines that can start a declaration, see LinePrefilter.
+// Pascal keywords are case-insensitive.
+const pascal_prefilter = new_line_prefilter(['class', 'function ', 'procedure '], true)
+
+// Visibility sections of a class declaration, see ScopeTracker.
+const pascal_access_labels = {
+    'private':          'private'
+    'strict private':   'private'
+    'protected':        'protected'
+    'strict protected': 'protected'
+    'public':           'public'
+    'published':        'public'
+}
 
 pub fn (p PascalParser) get_extensions() []string {
     return ['.pas', '.pp', '.inc']
 }
 
-pub fn (p PascalParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p PascalParser) parse(content string, file_path string) ParseResult {
     mut result := ParseResult{
         file_path: file_path
         elements:  []CodeElement{}
     }
 
-    lines := content.split_into_lines()
+    src := new_filtered_source_lines(content, pascal_prefilter)
+    mut scopes := new_scope_tracker(true, pascal_access_labels, true)
+
+    for i, trimmed in src.trimmed {
+        if !src.is_candidate(i) {
+            continue
+        }
 
-    for i, line in lines {
-        trimmed := line.trim_space()
         lower := trimmed.to_lower()
 
         // Skip comments
@@ -26,55 +45,42 @@ pub fn (p PascalParser) parse(content string, file_path string) ParseResult {
         }
 
         // Parse class definitions
-        if lower.starts_with('type') {
-            // Look ahead for class definitions
-            for j := i + 1; j < lines.len && j < i + 10; j++ {
-                line_lower := lines[j].trim_space().to_lower()
-                if line_lower.contains('= class') {
-                    result.elements << p.parse_class(lines, j)
-                }
-            }
+        if lower.contains('= class') {
+            result.elements << p.parse_class(src, i, mut scopes)
         }
         // Parse function/procedure definitions
         else if lower.starts_with('function ') || lower.starts_with('procedure ') {
-            result.elements << p.parse_function(lines, i)
+            result.elements << p.parse_function(src, i, mut scopes)
         }
     }
 
     return result
 }
 
-fn (p PascalParser) parse_class(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p PascalParser) parse_class(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+    line := src.trimmed[idx]
 
     mut class_name := ''
     mut parent := ''
 
     // Extract class name and inheritance
-    mut re := regex.regex_opt(r'(\w+)\s*=\s*class\s*\((\w+)\)?') or { panic(err) }
-    mut start, _ := re.match_string(line)
+    groups := p.patterns.captures(r'(\w+)\s*=\s*class\s*\((\w+)\)?', line)
 
-    if start >= 0 {
-        groups := re.get_group_list()
-        if groups.len > 0 {
-            class_name = line[groups[0].start..groups[0].end]
-        }
-        if groups.len > 1 && groups[1].start >= 0 {
-            parent = line[groups[1].start..groups[1].end]
+    if groups.len > 0 {
+        class_name = groups[0]
+        if groups.len > 1 && groups[1].len > 0 {
+            parent = groups[1]
         }
     } else {
         // Try without inheritance
-        re = regex.regex_opt(r'(\w+)\s*=\s*class') or { panic(err) }
-        start, _ = re.match_string(line)
-        if start >= 0 {
-            groups := re.get_group_list()
-            if groups.len > 0 {
-                class_name = line[groups[0].start..groups[0].end]
-            }
+        plain := p.patterns.captures(r'(\w+)\s*=\s*class', line)
+        if plain.len > 0 {
+            class_name = plain[0]
         }
     }
 
-    doc := extract_doc_lines(lines, idx, 5)
+    doc := extract_doc_lines(src, idx, 5)
+    scopes.enter_class(src, idx, class_name)
 
     return CodeElement{
         element_type: 'class'
@@ -85,48 +91,26 @@ fn (p PascalParser) parse_class(lines []string, idx int) CodeElement {
     }
 }
 
-fn (p PascalParser) parse_function(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p PascalParser) parse_function(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+    scopes.advance(src, idx)
+    line := src.trimmed[idx]
     lower := line.to_lower()
 
     mut func_name := ''
-    mut access := 'public'
-
-    // Check for private/protected
-    if idx > 0 {
-        for j := idx - 1; j >= 0 && j > idx - 5; j-- {
-            prev_lower := lines[j].trim_space().to_lower()
-            if prev_lower == 'private' {
-                access = 'private'
-                break
-            } else if prev_lower == 'protected' {
-                access = 'protected'
-                break
-            } else if prev_lower == 'public' {
-                break
-            }
-        }
-    }
+    // The last visibility section of the class declaration
+    section := scopes.section()
+    access := if section.len > 0 { section } else { 'public' }
 
     // Extract function/procedure name
-    mut re := regex.regex_opt(r'\w+\s+(\w+)') or { panic(err) }
-    start, _ := re.match_string(lower)
-
-    if start >= 0 {
-        groups := re.get_group_list()
-        if groups.len > 0 {
-            func_name = lower[groups[0].start..groups[0].end]
-        }
+    groups := p.patterns.captures(r'\w+\s+(\w+)', lower)
+    if groups.len > 0 {
+        func_name = groups[0]
     }
 
-    doc := extract_doc_lines(lines, idx, 2)
+    doc := extract_doc_lines(src, idx, 2)
 
-    // Determine if it's a method based on indentation
-    element_type := if lines[idx].starts_with(' ') || lines[idx].starts_with('\t') {
-        'method'
-    } else {
-        'function'
-    }
+    // Functions declared in a class body are methods
+    element_type := if scopes.in_class() { 'method' } else { 'function' }
 
     return CodeElement{
         element_type: element_type
@@ -1,23 +1,30 @@
 module parsers
 
-import regex
+pub struct PhpParser {
+mut:
+	patterns PatternRegistry
+}
 
-pub struct PhpParser {}
+// Lines that can start a declaration, see LinePrefilter.
+const php_prefilter = new_line_prefilter(['class ', 'interface ', 'trait ', 'function '], false)
 
 pub fn (p PhpParser) get_extensions() []string {
 	return ['.php']
 }
 
-pub fn (p PhpParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p PhpParser) parse(content string, file_path string) ParseResult {
 	mut result := ParseResult{
 		file_path: file_path
 		elements:  []CodeElement{}
 	}
 
-	lines := content.split_into_lines()
+	src := new_filtered_source_lines(content, php_prefilter)
+	mut scopes := new_scope_tracker(false, map[string]string{}, false)
 
-	for i, line in lines {
-		trimmed := line.trim_space()
+	for i, trimmed in src.trimmed {
+		if !src.is_candidate(i) {
+			continue
+		}
 
 		// Skip empty lines and PHP opening/closing tags
 		if trimmed.len == 0 || trimmed == '<?php' || trimmed == '?>' || trimmed.starts_with('<?') {
@@ -27,11 +34,11 @@ pub fn (p PhpParser) parse(content string, file_path string) ParseResult {
 		// Parse class definitions
 		if trimmed.starts_with('class ') || trimmed.starts_with('interface ')
 			|| trimmed.starts_with('trait ') || trimmed.starts_with('abstract class ') {
-			result.elements << p.parse_class(lines, i)
+			result.elements << p.parse_class(src, i, mut scopes)
 		}
 		// Parse function/method definitions
 		else if trimmed.contains('function ') {
-			element := p.parse_function(lines, i)
+			element := p.parse_function(src, i, mut scopes)
 			if element.name != '' {
 				result.elements << element
 			}
@@ -41,8 +48,8 @@ pub fn (p PhpParser) parse(content string, file_path string) ParseResult {
 	return result
 }
 
-fn (p PhpParser) parse_class(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p PhpParser) parse_class(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+	line := src.trimmed[idx]
 
 	mut class_name := ''
 	mut parent := ''
@@ -52,60 +59,41 @@ fn (p PhpParser) parse_class(lines []string, idx int) CodeElement {
 	if line.starts_with('interface ') {
 		element_type = 'interface'
 		// Extract interface name
-		mut re := regex.regex_opt(r'interface\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				class_name = line[groups[0].start..groups[0].end]
-			}
+		groups := p.patterns.captures(r'interface\s+(\w+)', line)
+		if groups.len > 0 {
+			class_name = groups[0]
 		}
 	} else if line.starts_with('trait ') {
 		element_type = 'trait'
 		// Extract trait name
-		mut re := regex.regex_opt(r'trait\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				class_name = line[groups[0].start..groups[0].end]
-			}
+		groups := p.patterns.captures(r'trait\s+(\w+)', line)
+		if groups.len > 0 {
+			class_name = groups[0]
 		}
 	} else if line.starts_with('abstract class ') {
 		element_type = 'abstract class'
 		// Extract abstract class name
-		mut re := regex.regex_opt(r'abstract\s+class\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				class_name = line[groups[0].start..groups[0].end]
-			}
+		groups := p.patterns.captures(r'abstract\s+class\s+(\w+)', line)
+		if groups.len > 0 {
+			class_name = groups[0]
 		}
 	} else {
 		// Regular class
 		// Extract class name
-		mut re := regex.regex_opt(r'class\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				class_name = line[groups[0].start..groups[0].end]
-			}
+		groups := p.patterns.captures(r'class\s+(\w+)', line)
+		if groups.len > 0 {
+			class_name = groups[0]
 		}
 	}
 
 	// Extract parent class from extends
-	mut extends_re := regex.regex_opt(r'extends\s+(\w+)') or { panic(err) }
-	extends_start, _ := extends_re.match_string(line)
-	if extends_start >= 0 {
-		extends_groups := extends_re.get_group_list()
-		if extends_groups.len > 0 {
-			parent = line[extends_groups[0].start..extends_groups[0].end]
-		}
+	extends_groups := p.patterns.captures(r'extends\s+(\w+)', line)
+	if extends_groups.len > 0 {
+		parent = extends_groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
+	scopes.enter_class(src, idx, class_name)
 
 	return CodeElement{
 		element_type: element_type
@@ -116,8 +104,9 @@ fn (p PhpParser) parse_class(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p PhpParser) parse_function(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p PhpParser) parse_function(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+	scopes.advance(src, idx)
+	line := src.trimmed[idx]
 
 	mut func_name := ''
 	mut access := 'public'
@@ -143,24 +132,15 @@ fn (p PhpParser) parse_function(lines []string, idx int) CodeElement {
 	}
 
 	// Extract function name
-	mut re := regex.regex_opt(r'function\s+(\w+)\s*\(') or { panic(err) }
-	start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 {
-			func_name = line[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'function\s+(\w+)\s*\(', line)
+	if groups.len > 0 {
+		func_name = groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 2)
+	doc := extract_doc_lines(src, idx, 2)
 
-	// Determine if it's a method or function based on indentation
-	element_type := if lines[idx].starts_with(' ') || lines[idx].starts_with('\t') {
-		'method'
-	} else {
-		'function'
-	}
+	// Functions declared in a class body are methods
+	element_type := if scopes.in_class() { 'method' } else { 'function' }
 
 	return CodeElement{
 		element_type: element_type
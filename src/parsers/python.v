@@ -1,31 +1,38 @@
 module parsers
 
-import regex
+pub struct PythonParser {
+mut:
+	patterns PatternRegistry
+}
 
-pub struct PythonParser {}
+// Lines that can start a declaration, see LinePrefilter.
+const python_prefilter = new_line_prefilter(['class ', 'def '], false)
 
 pub fn (p PythonParser) get_extensions() []string {
 	return ['.py']
 }
 
-pub fn (p PythonParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p PythonParser) parse(content string, file_path string) ParseResult {
 	mut result := ParseResult{
 		file_path: file_path
 		elements:  []CodeElement{}
 	}
 
-	lines := content.split_into_lines()
+	src := new_filtered_source_lines(content, python_prefilter)
+	mut scopes := new_scope_tracker(true, map[string]string{}, false)
 
-	for i, line in lines {
-		trimmed := line.trim_space()
+	for i, trimmed in src.trimmed {
+		if !src.is_candidate(i) {
+			continue
+		}
 
 		// Parse class definitions
 		if trimmed.starts_with('class ') {
-			result.elements << p.parse_class(lines, i)
+			result.elements << p.parse_class(src, i, mut scopes)
 		}
 		// Parse function/method definitions
 		else if trimmed.starts_with('def ') {
-			element := p.parse_function(lines, i)
+			element := p.parse_function(src, i, mut scopes)
 			if element.name != '' {
 				result.elements << element
 			}
@@ -35,27 +42,23 @@ pub fn (p PythonParser) parse(content string, file_path string) ParseResult {
 	return result
 }
 
-fn (p PythonParser) parse_class(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p PythonParser) parse_class(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+	line := src.trimmed[idx]
 
 	mut class_name := ''
 	mut parent := ''
 
 	// Extract class name and inheritance
-	mut re := regex.regex_opt(r'class\s+(\w+)(?:\(([\w\s,]+)\))?') or { panic(err) }
-	start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 {
-			class_name = line[groups[0].start..groups[0].end]
-		}
-		if groups.len > 1 && groups[1].start >= 0 {
-			parent = line[groups[1].start..groups[1].end].split(',')[0].trim_space()
-		}
+	groups := p.patterns.captures(r'class\s+(\w+)(?:\(([\w\s,]+)\))?', line)
+	if groups.len > 0 {
+		class_name = groups[0]
+	}
+	if groups.len > 1 && groups[1].len > 0 {
+		parent = groups[1].split(',')[0].trim_space()
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
+	scopes.enter_class(src, idx, class_name)
 
 	return CodeElement{
 		element_type: 'class'
@@ -66,21 +69,17 @@ fn (p PythonParser) parse_class(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p PythonParser) parse_function(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p PythonParser) parse_function(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+	scopes.advance(src, idx)
+	line := src.trimmed[idx]
 
 	mut func_name := ''
 	mut access := 'public'
 
 	// Extract function name
-	mut re := regex.regex_opt(r'def\s+(\w+)\s*\(') or { panic(err) }
-	start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 {
-			func_name = line[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'def\s+(\w+)\s*\(', line)
+	if groups.len > 0 {
+		func_name = groups[0]
 	}
 
 	// Determine if it's private (starts with _)
@@ -88,14 +87,10 @@ fn (p PythonParser) parse_function(lines []string, idx int) CodeElement {
 		access = 'private'
 	}
 
-	doc := extract_doc_lines(lines, idx, 2)
+	doc := extract_doc_lines(src, idx, 2)
 
-	// Determine if it's a method or function based on indentation
-	element_type := if lines[idx].starts_with(' ') || lines[idx].starts_with('\t') {
-		'method'
-	} else {
-		'function'
-	}
+	// Functions declared in a class body are methods
+	element_type := if scopes.in_class() { 'method' } else { 'function' }
 
 	return CodeElement{
 		element_type: element_type
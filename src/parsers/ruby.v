@@ -1,23 +1,37 @@
 module parsers
 
-import regex
+pub struct RubyParser {
+mut:
+    patterns PatternRegistry
+}
+
+// Lines that can start a declaration, see LinePrefilter.
+const ruby_prefilter = new_line_prefilter(['module ', 'class ', 'def '], false)
 
-pub struct RubyParser {}
+// Lines opening an access section, see ScopeTracker.
+const ruby_access_labels = {
+    'private':   'private'
+    'protected': 'protected'
+    'public':    'public'
+}
 
 pub fn (p RubyParser) get_extensions() []string {
     return ['.rb']
 }
 
-pub fn (p RubyParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p RubyParser) parse(content string, file_path string) ParseResult {
     mut result := ParseResult{
         file_path: file_path
         elements:  []CodeElement{}
     }
 
-    lines := content.split_into_lines()
+    src := new_filtered_source_lines(content, ruby_prefilter)
+    mut scopes := new_scope_tracker(true, ruby_access_labels, false)
 
-    for i, line in lines {
-        trimmed := line.trim_space()
+    for i, trimmed in src.trimmed {
+        if !src.is_candidate(i) {
+            continue
+        }
 
         // Skip comments
         if trimmed.starts_with('#') {
@@ -26,38 +40,35 @@ pub fn (p RubyParser) parse(content string, file_path string) ParseResult {
 
         // Parse module definitions
         if trimmed.starts_with('module ') {
-            result.elements << p.parse_module(lines, i)
+            result.elements << p.parse_module(src, i, mut scopes)
         }
         // Parse class definitions
         else if trimmed.starts_with('class ') {
-            result.elements << p.parse_class(lines, i)
+            result.elements << p.parse_class(src, i, mut scopes)
         }
         // Parse method/function definitions
         else if trimmed.starts_with('def ') {
-            result.elements << p.parse_function(lines, i)
+            result.elements << p.parse_function(src, i, mut scopes)
         }
     }
 
     return result
 }
 
-fn (p RubyParser) parse_module(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p RubyParser) parse_module(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+    line := src.trimmed[idx]
 
     mut mod_name := ''
 
     // Extract module name
-    mut re := regex.regex_opt(r'module\s+(\w+)') or { panic(err) }
-    start, _ := re.match_string(line)
-
-    if start >= 0 {
-        groups := re.get_group_list()
-        if groups.len > 0 {
-            mod_name = line[groups[0].start..groups[0].end]
-        }
+    groups := p.patterns.captures(r'module\s+(\w+)', line)
+    if groups.len > 0 {
+        mod_name = groups[0]
     }
 
-    doc := extract_doc_lines(lines, idx, 5)
+    doc := extract_doc_lines(src, idx, 5)
+    // Module functions are methods too, like those of a class
+    scopes.enter_class(src, idx, mod_name)
 
     return CodeElement{
         element_type: 'module'
@@ -67,8 +78,8 @@ fn (p RubyParser) parse_module(lines []string, idx int) CodeElement {
     }
 }
 
-fn (p RubyParser) parse_class(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p RubyParser) parse_class(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+    line := src.trimmed[idx]
 
     mut class_name := ''
     mut parent := ''
@@ -77,21 +88,17 @@ fn (p RubyParser) parse_class(lines []string, idx int) CodeElement {
         class_name = '<< self'
     } else {
         // Extract class name and inheritance
-        mut re := regex.regex_opt(r'class\s+([\w:]+)(?:\s*<\s*([\w:]+))?') or { panic(err) }
-        start, _ := re.match_string(line)
-
-        if start >= 0 {
-            groups := re.get_group_list()
-            if groups.len > 0 {
-                class_name = line[groups[0].start..groups[0].end]
-            }
-            if groups.len > 1 && groups[1].start >= 0 {
-                parent = line[groups[1].start..groups[1].end]
-            }
+        groups := p.patterns.captures(r'class\s+([\w:]+)(?:\s*<\s*([\w:]+))?', line)
+        if groups.len > 0 {
+            class_name = groups[0]
+        }
+        if groups.len > 1 && groups[1].len > 0 {
+            parent = groups[1]
         }
     }
 
-    doc := extract_doc_lines(lines, idx, 5)
+    doc := extract_doc_lines(src, idx, 5)
+    scopes.enter_class(src, idx, class_name)
 
     return CodeElement{
         element_type: 'class'
@@ -102,47 +109,25 @@ fn (p RubyParser) parse_class(lines []string, idx int) CodeElement {
     }
 }
 
-fn (p RubyParser) parse_function(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p RubyParser) parse_function(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+    scopes.advance(src, idx)
+    line := src.trimmed[idx]
 
     mut func_name := ''
-    mut access := 'public'
-
-    // Check previous lines for access modifiers
-    if idx > 0 {
-        for j := idx - 1; j >= 0 && j > idx - 5; j-- {
-            prev := lines[j].trim_space()
-            if prev == 'private' {
-                access = 'private'
-                break
-            } else if prev == 'protected' {
-                access = 'protected'
-                break
-            } else if prev == 'public' {
-                break
-            }
-        }
-    }
+    // The last `private`, `protected` or `public` line in the class
+    section := scopes.section()
+    access := if section.len > 0 { section } else { 'public' }
 
     // Extract function name
-    mut re := regex.regex_opt(r'def\s+(?:self\.)?(\w+[?!]?)') or { panic(err) }
-    start, _ := re.match_string(line)
-
-    if start >= 0 {
-        groups := re.get_group_list()
-        if groups.len > 0 {
-            func_name = line[groups[0].start..groups[0].end]
-        }
+    groups := p.patterns.captures(r'def\s+(?:self\.)?(\w+[?!]?)', line)
+    if groups.len > 0 {
+        func_name = groups[0]
     }
 
-    doc := extract_doc_lines(lines, idx, 2)
+    doc := extract_doc_lines(src, idx, 2)
 
-    // Determine if it's a method based on indentation
-    element_type := if lines[idx].starts_with(' ') || lines[idx].starts_with('\t') {
-        'method'
-    } else {
-        'function'
-    }
+    // Functions declared in a class body are methods
+    element_type := if scopes.in_class() { 'method' } else { 'function' }
 
     return CodeElement{
         element_type: element_type
@@ -0,0 +1,272 @@
+module parsers
+
+// Maximum number of comment lines joined into one element's doc.
+const rule_doc_max_lines = 5
+
+// RuleSet describes a custom language from the config file. Patterns use
+// capture groups for the names they extract:
+// - class_pattern: group 1 is the name, an optional group 2 the parent;
+// - method_pattern: the last group is the name, and when there is more
+//   than one group the first is the access modifier;
+// - function_pattern, module_pattern: the last group is the name.
+pub struct RuleSet {
+pub:
+	extension          string
+	class_pattern      string
+	function_pattern   string
+	method_pattern     string
+	module_pattern     string
+	doc_comment_marker string
+	doc_before_element bool
+}
+
+struct RulePattern {
+	element_type string
+	pattern      string
+}
+
+// RuleParser is the Parser built from a RuleSet. All patterns are compiled
+// once, when the parser is created, and are tried in a fixed order on each
+// line: module, class, method, function. A LinePrefilter built from the
+// literal text every pattern requires skips the lines none of them can
+// match before any regex runs.
+pub struct RuleParser {
+	rules     RuleSet
+	order     []RulePattern
+	prefilter LinePrefilter
+mut:
+	patterns PatternRegistry
+}
+
+// new_rule_parser compiles the patterns of `rules`, failing on the first
+// pattern that is not a valid regex.
+pub fn new_rule_parser(rules RuleSet) !&RuleParser {
+	candidates := [
+		RulePattern{
+			element_type: 'module'
+			pattern:      rules.module_pattern
+		},
+		RulePattern{
+			element_type: 'class'
+			pattern:      rules.class_pattern
+		},
+		RulePattern{
+			element_type: 'method'
+			pattern:      rules.method_pattern
+		},
+		RulePattern{
+			element_type: 'function'
+			pattern:      rules.function_pattern
+		},
+	]
+
+	mut patterns := PatternRegistry{}
+	mut order := []RulePattern{}
+	mut triggers := []string{}
+	mut filterable := true
+	for candidate in candidates {
+		if candidate.pattern.len == 0 {
+			continue
+		}
+		patterns.compile(candidate.pattern) or {
+			return error('invalid ${candidate.element_type}_pattern: ${err}')
+		}
+		order << candidate
+
+		literal := required_literal(candidate.pattern)
+		if literal.len == 0 {
+			filterable = false
+		} else if literal !in triggers {
+			triggers << literal
+		}
+	}
+	if order.len == 0 {
+		return error('no patterns defined')
+	}
+
+	return &RuleParser{
+		rules:     rules
+		order:     order
+		prefilter: if filterable { new_line_prefilter(triggers, false) } else { LinePrefilter{} }
+		patterns:  patterns
+	}
+}
+
+pub fn (p RuleParser) get_extensions() []string {
+	return [p.rules.extension]
+}
+
+pub fn (mut p RuleParser) parse(content string, file_path string) ParseResult {
+	mut result := ParseResult{
+		file_path: file_path
+		elements:  []CodeElement{}
+	}
+
+	src := new_filtered_source_lines(content, p.prefilter)
+	marker := p.rules.doc_comment_marker
+
+	for i, trimmed in src.trimmed {
+		if !src.is_candidate(i) || trimmed.len == 0 {
+			continue
+		}
+		// Skip comments
+		if marker.len > 0 && trimmed.starts_with(marker) {
+			continue
+		}
+
+		for rule in p.order {
+			// Patterns usually start at the keyword, but may also expect
+			// the indentation (e.g. to tell methods from functions)
+			mut groups := p.patterns.captures(rule.pattern, trimmed)
+			if groups.len == 0 && src.raw[i].len != trimmed.len {
+				groups = p.patterns.captures(rule.pattern, src.raw[i])
+			}
+			if groups.len == 0 {
+				continue
+			}
+
+			element := p.element_from(rule.element_type, groups, src, i)
+			if element.name.len > 0 {
+				result.elements << element
+				break
+			}
+		}
+	}
+
+	return result
+}
+
+fn (p &RuleParser) element_from(element_type string, groups []string, src SourceLines, idx int) CodeElement {
+	mut name := ''
+	mut parent := ''
+	mut access := ''
+
+	if element_type == 'class' {
+		name = groups[0]
+		if groups.len > 1 {
+			parent = groups[1]
+		}
+	} else {
+		name = groups[groups.len - 1]
+		if element_type == 'method' && groups.len > 1 {
+			access = groups[0]
+		}
+	}
+
+	return CodeElement{
+		element_type: element_type
+		name:         name.trim_space()
+		access:       access.trim_space()
+		parent:       parent.trim_space()
+		doc:          p.doc_for(src, idx)
+		line_number:  idx + 1
+	}
+}
+
+// doc_for collects the marker comment lines directly before the element,
+// or directly after it when doc_before_element is false.
+fn (p &RuleParser) doc_for(src SourceLines, idx int) string {
+	marker := p.rules.doc_comment_marker
+	if marker.len == 0 {
+		return ''
+	}
+
+	mut doc_lines := []string{}
+	step := if p.rules.doc_before_element { -1 } else { 1 }
+	mut j := idx + step
+	for j >= 0 && j < src.len() && doc_lines.len < rule_doc_max_lines {
+		line := src.trimmed[j]
+		if !line.starts_with(marker) {
+			break
+		}
+		cleaned := line[marker.len..].trim_space()
+		if cleaned.len > 0 {
+			if step < 0 {
+				doc_lines.insert(0, cleaned)
+			} else {
+				doc_lines << cleaned
+			}
+		}
+		j += step
+	}
+	return doc_lines.join(' ')
+}
+
+// required_literal returns the longest run of literal text that every match
+// of `pattern` must contain, or '' if none can be determined (for example
+// with top-level alternation). Text inside groups and character classes,
+// escapes, and characters made optional by `?`, `*` or `{` are left out.
+fn required_literal(pattern string) string {
+	mut best := ''
+	mut run := []u8{}
+	mut depth := 0
+	mut i := 0
+	for i < pattern.len {
+		c := pattern[i]
+		match c {
+			`\\` {
+				best = longer_run(best, mut run)
+				i += 2
+				continue
+			}
+			`[` {
+				best = longer_run(best, mut run)
+				// Skip the class, including a leading `]` or `^]`
+				i++
+				if i < pattern.len && pattern[i] == `^` {
+					i++
+				}
+				if i < pattern.len && pattern[i] == `]` {
+					i++
+				}
+				for i < pattern.len && pattern[i] != `]` {
+					if pattern[i] == `\\` {
+						i++
+					}
+					i++
+				}
+			}
+			`(` {
+				best = longer_run(best, mut run)
+				depth++
+			}
+			`)` {
+				depth--
+			}
+			`|` {
+				if depth == 0 {
+					return ''
+				}
+			}
+			`?`, `*`, `{` {
+				// The previous character is optional
+				if depth == 0 && run.len > 0 {
+					run.delete_last()
+				}
+				best = longer_run(best, mut run)
+				if c == `{` {
+					for i < pattern.len && pattern[i] != `}` {
+						i++
+					}
+				}
+			}
+			`+`, `.`, `^`, `$` {
+				best = longer_run(best, mut run)
+			}
+			else {
+				if depth == 0 {
+					run << c
+				}
+			}
+		}
+		i++
+	}
+	return longer_run(best, mut run)
+}
+
+// longer_run ends the current literal run, returning it if it beats `best`.
+fn longer_run(best string, mut run []u8) string {
+	candidate := run.bytestr()
+	run.clear()
+	return if candidate.len > best.len { candidate } else { best }
+}
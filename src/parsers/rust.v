@@ -1,24 +1,31 @@
 module parsers
 
-import regex
+pub struct RustParser {
+mut:
+	patterns PatternRegistry
+}
 
-pub struct RustParser {}
+// Lines that can start a declaration, see LinePrefilter.
+// `}` is included because a lone closing brace ends an impl block.
+const rust_prefilter = new_line_prefilter(['impl ', '}', 'mod ', 'struct ', 'enum ', 'fn '], false)
 
 pub fn (p RustParser) get_extensions() []string {
 	return ['.rs']
 }
 
-pub fn (p RustParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p RustParser) parse(content string, file_path string) ParseResult {
 	mut result := ParseResult{
 		file_path: file_path
 		elements:  []CodeElement{}
 	}
 
-	lines := content.split_into_lines()
+	src := new_filtered_source_lines(content, rust_prefilter)
 	mut in_impl_block := false
 
-	for i, line in lines {
-		trimmed := line.trim_space()
+	for i, trimmed in src.trimmed {
+		if !src.is_candidate(i) {
+			continue
+		}
 
 		// Skip comments and empty lines
 		if trimmed.starts_with('//') || trimmed.starts_with('/*') || trimmed == '' {
@@ -39,21 +46,21 @@ pub fn (p RustParser) parse(content string, file_path string) ParseResult {
 
 		// Parse module definitions
 		if (trimmed.starts_with('mod ') || trimmed.contains(' mod ')) && !trimmed.contains('use ') {
-			element := p.parse_module(lines, i)
+			element := p.parse_module(src, i)
 			if element.name != '' {
 				result.elements << element
 			}
 		}
 		// Parse struct/enum definitions
 		else if (trimmed.contains('struct ') || trimmed.contains('enum ')) && !trimmed.contains('impl ') {
-			element := p.parse_struct(lines, i)
+			element := p.parse_struct(src, i)
 			if element.name != '' {
 				result.elements << element
 			}
 		}
 		// Parse function/method definitions
 		else if trimmed.contains('fn ') {
-			element := p.parse_function(lines, i, in_impl_block)
+			element := p.parse_function(src, i, in_impl_block)
 			if element.name != '' {
 				result.elements << element
 			}
@@ -63,21 +70,20 @@ pub fn (p RustParser) parse(content string, file_path string) ParseResult {
 	return result
 }
 
-fn (p RustParser) parse_module(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p RustParser) parse_module(src SourceLines, idx int) CodeElement {
+	line := src.trimmed[idx]
 	mut mod_name := ''
 
 	// Find the start of the module declaration
 	if pos := line.index('mod ') {
 		content := line[pos..]
-		mut re := regex.regex_opt(r'mod\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(content)
-		if start >= 0 {
-			mod_name = re.get_group_by_id(content, 0)
+		groups := p.patterns.captures(r'mod\s+(\w+)', content)
+		if groups.len > 0 {
+			mod_name = groups[0]
 		}
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
 
 	return CodeElement{
 		element_type: 'module'
@@ -87,8 +93,8 @@ fn (p RustParser) parse_module(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p RustParser) parse_struct(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p RustParser) parse_struct(src SourceLines, idx int) CodeElement {
+	line := src.trimmed[idx]
 
 	mut name := ''
 	mut element_type := 'struct'
@@ -101,19 +107,14 @@ fn (p RustParser) parse_struct(lines []string, idx int) CodeElement {
 	keyword := if element_type == 'enum' { 'enum ' } else { 'struct ' }
 	if pos := line.index(keyword) {
 		content := line[pos..]
-		mut re := if element_type == 'enum' {
-			regex.regex_opt(r'enum\s+(\w+)') or { panic(err) }
-		} else {
-			regex.regex_opt(r'struct\s+(\w+)') or { panic(err) }
-		}
-		
-		start, _ := re.match_string(content)
-		if start >= 0 {
-			name = re.get_group_by_id(content, 0)
+		pattern := if element_type == 'enum' { r'enum\s+(\w+)' } else { r'struct\s+(\w+)' }
+		groups := p.patterns.captures(pattern, content)
+		if groups.len > 0 {
+			name = groups[0]
 		}
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
 
 	return CodeElement{
 		element_type: element_type
@@ -123,8 +124,8 @@ fn (p RustParser) parse_struct(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p RustParser) parse_function(lines []string, idx int, in_impl bool) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p RustParser) parse_function(src SourceLines, idx int, in_impl bool) CodeElement {
+	line := src.trimmed[idx]
 
 	mut func_name := ''
 	mut access := 'private'
@@ -137,14 +138,13 @@ fn (p RustParser) parse_function(lines []string, idx int, in_impl bool) CodeElem
 	// Extract function name
 	if pos := line.index('fn ') {
 		content := line[pos..]
-		mut re := regex.regex_opt(r'fn\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(content)
-		if start >= 0 {
-			func_name = re.get_group_by_id(content, 0)
+		groups := p.patterns.captures(r'fn\s+(\w+)', content)
+		if groups.len > 0 {
+			func_name = groups[0]
 		}
 	}
 
-	doc := extract_doc_lines(lines, idx, 2)
+	doc := extract_doc_lines(src, idx, 2)
 
 	// Determine if it's a method
 	element_type := if in_impl {
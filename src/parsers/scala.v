@@ -1,23 +1,30 @@
 module parsers
 
-import regex
+pub struct ScalaParser {
+mut:
+	patterns PatternRegistry
+}
 
-pub struct ScalaParser {}
+// Lines that can start a declaration, see LinePrefilter.
+const scala_prefilter = new_line_prefilter(['class ', 'object ', 'trait ', 'def '], false)
 
 pub fn (p ScalaParser) get_extensions() []string {
 	return ['.scala']
 }
 
-pub fn (p ScalaParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p ScalaParser) parse(content string, file_path string) ParseResult {
 	mut result := ParseResult{
 		file_path: file_path
 		elements:  []CodeElement{}
 	}
 
-	lines := content.split_into_lines()
+	src := new_filtered_source_lines(content, scala_prefilter)
+	mut scopes := new_scope_tracker(false, map[string]string{}, false)
 
-	for i, line in lines {
-		trimmed := line.trim_space()
+	for i, trimmed in src.trimmed {
+		if !src.is_candidate(i) {
+			continue
+		}
 
 		// Skip empty lines
 		if trimmed.len == 0 {
@@ -27,19 +34,19 @@ pub fn (p ScalaParser) parse(content string, file_path string) ParseResult {
 		// Parse class, object, trait definitions
 		if trimmed.starts_with('class ') || trimmed.starts_with('object ')
 			|| trimmed.starts_with('trait ') {
-			result.elements << p.parse_class(lines, i)
+			result.elements << p.parse_class(src, i, mut scopes)
 		}
 		// Parse function/method definitions
 		else if trimmed.starts_with('def ') {
-			result.elements << p.parse_function(lines, i)
+			result.elements << p.parse_function(src, i, mut scopes)
 		}
 	}
 
 	return result
 }
 
-fn (p ScalaParser) parse_class(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p ScalaParser) parse_class(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+	line := src.trimmed[idx]
 
 	mut class_name := ''
 	mut parent := ''
@@ -48,48 +55,33 @@ fn (p ScalaParser) parse_class(lines []string, idx int) CodeElement {
 	// Extract class/object/trait name and determine element type
 	if line.starts_with('trait ') {
 		element_type = 'trait'
-		mut re := regex.regex_opt(r'trait\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				class_name = line[groups[0].start..groups[0].end]
-			}
+		groups := p.patterns.captures(r'trait\s+(\w+)', line)
+		if groups.len > 0 {
+			class_name = groups[0]
 		}
 	} else if line.starts_with('object ') {
 		element_type = 'object'
-		mut re := regex.regex_opt(r'object\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				class_name = line[groups[0].start..groups[0].end]
-			}
+		groups := p.patterns.captures(r'object\s+(\w+)', line)
+		if groups.len > 0 {
+			class_name = groups[0]
 		}
 	} else {
 		// Regular class
 		element_type = 'class'
-		mut re := regex.regex_opt(r'class\s+(\w+)') or { panic(err) }
-		start, _ := re.match_string(line)
-		if start >= 0 {
-			groups := re.get_group_list()
-			if groups.len > 0 {
-				class_name = line[groups[0].start..groups[0].end]
-			}
+		groups := p.patterns.captures(r'class\s+(\w+)', line)
+		if groups.len > 0 {
+			class_name = groups[0]
 		}
 	}
 
 	// Check for extends
-	extends_re := regex.regex_opt(r'extends\s+(\w+)') or { panic(err) }
-	extends_start, _ := extends_re.match_string(line)
-	if extends_start >= 0 {
-		extends_groups := extends_re.get_group_list()
-		if extends_groups.len > 0 {
-			parent = line[extends_groups[0].start..extends_groups[0].end]
-		}
+	extends_groups := p.patterns.captures(r'extends\s+(\w+)', line)
+	if extends_groups.len > 0 {
+		parent = extends_groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
+	scopes.enter_class(src, idx, class_name)
 
 	return CodeElement{
 		element_type: element_type
@@ -100,8 +92,9 @@ fn (p ScalaParser) parse_class(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p ScalaParser) parse_function(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p ScalaParser) parse_function(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+	scopes.advance(src, idx)
+	line := src.trimmed[idx]
 
 	mut func_name := ''
 	mut access := 'public'
@@ -114,24 +107,15 @@ fn (p ScalaParser) parse_function(lines []string, idx int) CodeElement {
 	}
 
 	// Extract function name (including any type parameters)
-	mut re := regex.regex_opt(r'def\s+(\w+)\s*\(') or { panic(err) }
-	start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 {
-			func_name = line[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'def\s+(\w+)\s*\(', line)
+	if groups.len > 0 {
+		func_name = groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 2)
+	doc := extract_doc_lines(src, idx, 2)
 
-	// Determine if it's a method or function based on indentation
-	element_type := if lines[idx].starts_with(' ') || lines[idx].starts_with('\t') {
-		'method'
-	} else {
-		'function'
-	}
+	// Functions declared in a class body are methods
+	element_type := if scopes.in_class() { 'method' } else { 'function' }
 
 	return CodeElement{
 		element_type: element_type
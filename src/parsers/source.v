@@ -0,0 +1,233 @@
+module parsers
+
+// SourceLines is the line index of one file. `raw` and `trimmed` hold every
+// line as a view into `content`, without and with surrounding whitespace,
+// so building the index copies no text. The views are only valid while
+// `content` is; anything stored in a ParseResult must be an owned string
+// (matching, slicing and splitting all produce copies).
+pub struct SourceLines {
+pub:
+	content    string
+	raw        []string
+	trimmed    []string
+	candidates []bool // lines passing the prefilter; empty when unfiltered
+	// Comment runs for extract_doc_lines, see index_doc_comments
+	doc_run_start []int
+	doc_prefix    []int
+	doc_texts     []string
+}
+
+// new_source_lines indexes `content` in a single pass. Line breaks are
+// `\n`, `\r\n` and a lone `\r`, exactly as with split_into_lines, and
+// trimming follows trim_space.
+pub fn new_source_lines(content string) SourceLines {
+	return build_source_lines(content, LinePrefilter{})
+}
+
+// new_filtered_source_lines indexes `content` like new_source_lines and, in
+// the same pass, marks the lines `filter` selects as candidates.
+pub fn new_filtered_source_lines(content string, filter LinePrefilter) SourceLines {
+	return build_source_lines(content, filter)
+}
+
+fn build_source_lines(content string, filter LinePrefilter) SourceLines {
+	estimate := content.len / 32 + 1
+	filtered := filter.triggers.len > 0
+	mut raw := []string{cap: estimate}
+	mut trimmed := []string{cap: estimate}
+	mut candidates := []bool{cap: if filtered { estimate } else { 0 }}
+
+	mut line_start := 0
+	mut i := 0
+	for i < content.len {
+		// Skip a word at a time while it holds no line break
+		if i + 8 <= content.len {
+			word := load_word(content, i)
+			if !swar_has_byte(word, swar_lf) && !swar_has_byte(word, swar_cr) {
+				i += 8
+				continue
+			}
+		}
+		c := content[i]
+		if c != `\n` && c != `\r` {
+			i++
+			continue
+		}
+		raw << str_view(content, line_start, i)
+		trimmed << trimmed_view(content, line_start, i)
+		if filtered {
+			candidates << filter.matches(content, line_start, i)
+		}
+		if c == `\r` && i + 1 < content.len && content[i + 1] == `\n` {
+			i++
+		}
+		i++
+		line_start = i
+	}
+	if line_start < content.len {
+		raw << str_view(content, line_start, content.len)
+		trimmed << trimmed_view(content, line_start, content.len)
+		if filtered {
+			candidates << filter.matches(content, line_start, content.len)
+		}
+	}
+
+	doc_run_start, doc_prefix, doc_texts := index_doc_comments(trimmed)
+	return SourceLines{
+		content:       content
+		raw:           raw
+		trimmed:       trimmed
+		candidates:    candidates
+		doc_run_start: doc_run_start
+		doc_prefix:    doc_prefix
+		doc_texts:     doc_texts
+	}
+}
+
+// len returns the number of lines.
+@[inline]
+pub fn (src SourceLines) len() int {
+	return src.raw.len
+}
+
+// is_candidate reports whether line `idx` passed the prefilter, i.e. might
+// hold a declaration. Every line is a candidate when no filter was used.
+@[inline]
+pub fn (src SourceLines) is_candidate(idx int) bool {
+	return src.candidates.len == 0 || src.candidates[idx]
+}
+
+// LinePrefilter selects the lines containing at least one of a parser's
+// trigger strings. A parser's triggers must be implied by each of its
+// declaration checks (and by any line that changes its state), so that
+// skipping non-candidate lines never changes the result. Lines are scanned
+// eight bytes at a time for the first bytes of the triggers; V has no
+// portable SIMD, so this is done with SWAR arithmetic on u64 words.
+pub struct LinePrefilter {
+	triggers  []string
+	fold_case bool // match ASCII letters case-insensitively (Pascal)
+mut:
+	first  [256]bool // bytes that can start a trigger
+	probes []u64     // those bytes broadcast to all eight lanes of a word
+}
+
+// new_line_prefilter builds a filter for `triggers`. With `fold_case` the
+// triggers must be given in lower case.
+pub fn new_line_prefilter(triggers []string, fold_case bool) LinePrefilter {
+	mut f := LinePrefilter{
+		triggers:  triggers
+		fold_case: fold_case
+	}
+	for trigger in triggers {
+		if trigger.len == 0 {
+			continue
+		}
+		f.add_first(trigger[0])
+		if fold_case && trigger[0] >= `a` && trigger[0] <= `z` {
+			f.add_first(trigger[0] - 32)
+		}
+	}
+	return f
+}
+
+fn (mut f LinePrefilter) add_first(c u8) {
+	if f.first[c] {
+		return
+	}
+	f.first[c] = true
+	f.probes << swar_ones * u64(c)
+}
+
+// matches reports whether content[start..end] contains any trigger.
+fn (f &LinePrefilter) matches(content string, start int, end int) bool {
+	mut i := start
+	for i < end {
+		if i + 8 <= end {
+			word := load_word(content, i)
+			mut hit := false
+			for probe in f.probes {
+				if swar_has_byte(word, probe) {
+					hit = true
+					break
+				}
+			}
+			if !hit {
+				i += 8
+				continue
+			}
+		}
+		if f.first[content[i]] {
+			for trigger in f.triggers {
+				if f.matches_at(content, i, end, trigger) {
+					return true
+				}
+			}
+		}
+		i++
+	}
+	return false
+}
+
+fn (f &LinePrefilter) matches_at(content string, pos int, end int, trigger string) bool {
+	if pos + trigger.len > end {
+		return false
+	}
+	for k in 0 .. trigger.len {
+		mut c := content[pos + k]
+		if f.fold_case && c >= `A` && c <= `Z` {
+			c += 32
+		}
+		if c != trigger[k] {
+			return false
+		}
+	}
+	return true
+}
+
+const swar_ones = u64(0x0101010101010101)
+const swar_highs = u64(0x8080808080808080)
+const swar_lf = swar_ones * u64(`\n`)
+const swar_cr = swar_ones * u64(`\r`)
+
+// load_word reads the eight bytes at content[pos..pos + 8] as one word;
+// the copy compiles to a single unaligned load.
+@[inline]
+fn load_word(content string, pos int) u64 {
+	mut word := u64(0)
+	unsafe { vmemcpy(&word, content.str + pos, 8) }
+	return word
+}
+
+// swar_has_byte reports whether any byte of `word` equals the byte that
+// `pattern` repeats in every lane.
+@[inline]
+fn swar_has_byte(word u64, pattern u64) bool {
+	x := word ^ pattern
+	return ((x - swar_ones) & ~x & swar_highs) != 0
+}
+
+@[inline]
+fn is_trim_space(c u8) bool {
+	return c == ` ` || c == `\t` || c == `\n` || c == `\r` || c == `\v` || c == `\f`
+}
+
+// str_view returns content[start..end] without copying.
+@[inline]
+fn str_view(content string, start int, end int) string {
+	if end <= start {
+		return ''
+	}
+	return unsafe { tos(content.str + start, end - start) }
+}
+
+fn trimmed_view(content string, start int, end int) string {
+	mut s := start
+	mut e := end
+	for s < e && is_trim_space(content[s]) {
+		s++
+	}
+	for e > s && is_trim_space(content[e - 1]) {
+		e--
+	}
+	return str_view(content, s, e)
+}
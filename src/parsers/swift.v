@@ -1,23 +1,31 @@
 module parsers
 
-import regex
+pub struct SwiftParser {
+mut:
+    patterns PatternRegistry
+}
 
-pub struct SwiftParser {}
+// Lines that can start a declaration, see LinePrefilter.
+const swift_prefilter = new_line_prefilter(['class ', 'struct ', 'protocol ', 'enum ', 'extension ',
+    'func '], false)
 
 pub fn (p SwiftParser) get_extensions() []string {
     return ['.swift']
 }
 
-pub fn (p SwiftParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p SwiftParser) parse(content string, file_path string) ParseResult {
     mut result := ParseResult{
         file_path: file_path
         elements:  []CodeElement{}
     }
 
-    lines := content.split_into_lines()
+    src := new_filtered_source_lines(content, swift_prefilter)
+    mut scopes := new_scope_tracker(false, map[string]string{}, false)
 
-    for i, line in lines {
-        trimmed := line.trim_space()
+    for i, trimmed in src.trimmed {
+        if !src.is_candidate(i) {
+            continue
+        }
 
         // Skip comments
         if trimmed.starts_with('//') || trimmed.starts_with('/*') {
@@ -28,19 +36,19 @@ pub fn (p SwiftParser) parse(content string, file_path string) ParseResult {
         if trimmed.contains('class ') || trimmed.contains('struct ')
             || trimmed.contains('protocol ') || trimmed.contains('enum ')
             || trimmed.contains('extension ') {
-            result.elements << p.parse_class(lines, i)
+            result.elements << p.parse_class(src, i, mut scopes)
         }
         // Parse function definitions
         else if trimmed.contains('func ') {
-            result.elements << p.parse_function(lines, i)
+            result.elements << p.parse_function(src, i, mut scopes)
         }
     }
 
     return result
 }
 
-fn (p SwiftParser) parse_class(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p SwiftParser) parse_class(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+    line := src.trimmed[idx]
 
     mut class_name := ''
     mut parent := ''
@@ -55,22 +63,16 @@ fn (p SwiftParser) parse_class(lines []string, idx int) CodeElement {
     relevant_line := if start_pos != -1 { line[start_pos..] } else { line }
 
     // Extract class name and inheritance
-    mut re := regex.regex_opt(r'\w+\s+(\w+)(?:\s*:\s*(\w+))?') or {
-        panic(err)
+    groups := p.patterns.captures(r'\w+\s+(\w+)(?:\s*:\s*(\w+))?', relevant_line)
+    if groups.len > 0 {
+        class_name = groups[0]
     }
-    start, _ := re.match_string(relevant_line)
-
-    if start >= 0 {
-        groups := re.get_group_list()
-        if groups.len > 0 {
-            class_name = relevant_line[groups[0].start..groups[0].end]
-        }
-        if groups.len > 1 && groups[1].start >= 0 {
-            parent = relevant_line[groups[1].start..groups[1].end]
-        }
+    if groups.len > 1 && groups[1].len > 0 {
+        parent = groups[1]
     }
 
-    doc := extract_doc_lines(lines, idx, 5)
+    doc := extract_doc_lines(src, idx, 5)
+    scopes.enter_class(src, idx, class_name)
 
     return CodeElement{
         element_type: 'class'
@@ -81,8 +83,9 @@ fn (p SwiftParser) parse_class(lines []string, idx int) CodeElement {
     }
 }
 
-fn (p SwiftParser) parse_function(lines []string, idx int) CodeElement {
-    line := lines[idx].trim_space()
+fn (mut p SwiftParser) parse_function(src SourceLines, idx int, mut scopes ScopeTracker) CodeElement {
+    scopes.advance(src, idx)
+    line := src.trimmed[idx]
 
     mut func_name := ''
     mut access := 'internal'
@@ -103,24 +106,15 @@ fn (p SwiftParser) parse_function(lines []string, idx int) CodeElement {
     relevant_line := if start_pos != -1 { line[start_pos..] } else { line }
 
     // Extract function name
-    mut re := regex.regex_opt(r'func\s+(\w+)\s*[<(]') or { panic(err) }
-    start, _ := re.match_string(relevant_line)
-
-    if start >= 0 {
-        groups := re.get_group_list()
-        if groups.len > 0 {
-            func_name = relevant_line[groups[0].start..groups[0].end]
-        }
+    groups := p.patterns.captures(r'func\s+(\w+)\s*[<(]', relevant_line)
+    if groups.len > 0 {
+        func_name = groups[0]
     }
 
-    doc := extract_doc_lines(lines, idx, 2)
+    doc := extract_doc_lines(src, idx, 2)
 
-    // Determine if it's a method based on indentation
-    element_type := if lines[idx].starts_with(' ') || lines[idx].starts_with('\t') {
-        'method'
-    } else {
-        'function'
-    }
+    // Functions declared in a class body are methods
+    element_type := if scopes.in_class() { 'method' } else { 'function' }
 
     return CodeElement{
         element_type: element_type
@@ -1,23 +1,30 @@
 module parsers
 
-import regex
+pub struct VlangParser {
+mut:
+	patterns PatternRegistry
+}
 
-pub struct VlangParser {}
+// Lines that can start a declaration, see LinePrefilter.
+const vlang_prefilter = new_line_prefilter(['const ', 'module ', 'enum ', 'struct ', 'interface ', 'fn ',
+	'match '], false)
 
 pub fn (p VlangParser) get_extensions() []string {
 	return ['.v', '.vv']
 }
 
-pub fn (p VlangParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p VlangParser) parse(content string, file_path string) ParseResult {
 	mut result := ParseResult{
 		file_path: file_path
 		elements:  []CodeElement{}
 	}
 
-	lines := content.split_into_lines()
+	src := new_filtered_source_lines(content, vlang_prefilter)
 
-	for i, line in lines {
-		trimmed := line.trim_space()
+	for i, trimmed in src.trimmed {
+		if !src.is_candidate(i) {
+			continue
+		}
 
 		// Skip comments
 		if trimmed.starts_with('//') || trimmed.starts_with('/*') {
@@ -29,34 +36,34 @@ pub fn (p VlangParser) parse(content string, file_path string) ParseResult {
 
 		// Parse const declarations (pub const)
 		if p.is_const_declaration(clean_line) {
-			result.elements << p.parse_const(lines, i)
+			result.elements << p.parse_const(src, i)
 		}
 		// Parse module definitions
 		else if clean_line.starts_with('module ') {
-			result.elements << p.parse_module(lines, i)
+			result.elements << p.parse_module(src, i)
 		}
 		// Parse enum definitions
 		else if p.is_enum_declaration(clean_line) {
-			result.elements << p.parse_enum(lines, i)
+			result.elements << p.parse_enum(src, i)
 		}
 		// Parse struct definitions (including pub struct)
 		else if p.is_struct_declaration(clean_line) {
-			result.elements << p.parse_struct(lines, i)
+			result.elements << p.parse_struct(src, i)
 		}
 		// Parse interface definitions (including pub interface)
 		else if p.is_interface_declaration(clean_line) {
-			result.elements << p.parse_interface(lines, i)
+			result.elements << p.parse_interface(src, i)
 		}
 		// Parse function/method definitions (including pub fn)
 		else if p.is_function_declaration(clean_line) {
-			element := p.parse_function(lines, i)
+			element := p.parse_function(src, i)
 			if element.name != '' {
 				result.elements << element
 			}
 		}
 		// Parse match expressions
 		else if p.is_match_expression(clean_line) {
-			result.elements << p.parse_match(lines, i)
+			result.elements << p.parse_match(src, i)
 		}
 	}
 
@@ -103,23 +110,18 @@ fn (p VlangParser) is_match_expression(line string) bool {
 
 // Parse functions for each declaration type
 
-fn (p VlangParser) parse_module(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p VlangParser) parse_module(src SourceLines, idx int) CodeElement {
+	line := src.trimmed[idx]
 
 	mut mod_name := ''
 
 	// Extract module name
-	mut re := regex.regex_opt(r'module\s+(\w+)') or { panic(err) }
-	start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 && groups[0].start >= 0 && groups[0].end > groups[0].start {
-			mod_name = line[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'module\s+(\w+)', line)
+	if groups.len > 0 {
+		mod_name = groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
 
 	return CodeElement{
 		element_type: 'module'
@@ -129,8 +131,8 @@ fn (p VlangParser) parse_module(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p VlangParser) parse_const(lines []string, idx int) CodeElement {
-	line := p.strip_attributes(lines[idx].trim_space())
+fn (mut p VlangParser) parse_const(src SourceLines, idx int) CodeElement {
+	line := p.strip_attributes(src.trimmed[idx])
 
 	mut const_name := ''
 	mut access := 'private'
@@ -145,17 +147,12 @@ fn (p VlangParser) parse_const(lines []string, idx int) CodeElement {
 	// Extract const name - handle various const patterns:
 	// pub const NAME = value
 	// pub const (NAME1 = value1, NAME2 = value2)
-	mut re := regex.regex_opt(r'const\s+(\w+)') or { panic(err) }
-	start, _ := re.match_string(line_for_regex)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 && groups[0].start >= 0 && groups[0].end > groups[0].start {
-			const_name = line_for_regex[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'const\s+(\w+)', line_for_regex)
+	if groups.len > 0 {
+		const_name = groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 3)
+	doc := extract_doc_lines(src, idx, 3)
 
 	return CodeElement{
 		element_type: 'constant'
@@ -166,8 +163,8 @@ fn (p VlangParser) parse_const(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p VlangParser) parse_struct(lines []string, idx int) CodeElement {
-	line := p.strip_attributes(lines[idx].trim_space())
+fn (mut p VlangParser) parse_struct(src SourceLines, idx int) CodeElement {
+	line := p.strip_attributes(src.trimmed[idx])
 
 	mut struct_name := ''
 	mut access := 'private'
@@ -186,17 +183,12 @@ fn (p VlangParser) parse_struct(lines []string, idx int) CodeElement {
 	// pub struct Name
 	// struct Name
 	// pub mut struct Name
-	mut re := regex.regex_opt(r'struct\s+(\w+)') or { panic(err) }
-	start, _ := re.match_string(line_for_regex)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 && groups[0].start >= 0 && groups[0].end > groups[0].start {
-			struct_name = line_for_regex[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'struct\s+(\w+)', line_for_regex)
+	if groups.len > 0 {
+		struct_name = groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
 
 	return CodeElement{
 		element_type: 'struct'
@@ -207,8 +199,8 @@ fn (p VlangParser) parse_struct(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p VlangParser) parse_enum(lines []string, idx int) CodeElement {
-	line := p.strip_attributes(lines[idx].trim_space())
+fn (mut p VlangParser) parse_enum(src SourceLines, idx int) CodeElement {
+	line := p.strip_attributes(src.trimmed[idx])
 
 	mut enum_name := ''
 	mut access := 'private'
@@ -223,17 +215,12 @@ fn (p VlangParser) parse_enum(lines []string, idx int) CodeElement {
 	// Extract enum name - handle:
 	// pub enum Name
 	// enum Name
-	mut re := regex.regex_opt(r'enum\s+(\w+)') or { panic(err) }
-	start, _ := re.match_string(line_for_regex)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 && groups[0].start >= 0 && groups[0].end > groups[0].start {
-			enum_name = line_for_regex[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'enum\s+(\w+)', line_for_regex)
+	if groups.len > 0 {
+		enum_name = groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
 
 	return CodeElement{
 		element_type: 'enum'
@@ -244,8 +231,8 @@ fn (p VlangParser) parse_enum(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p VlangParser) parse_interface(lines []string, idx int) CodeElement {
-	line := p.strip_attributes(lines[idx].trim_space())
+fn (mut p VlangParser) parse_interface(src SourceLines, idx int) CodeElement {
+	line := p.strip_attributes(src.trimmed[idx])
 
 	mut interface_name := ''
 	mut parent := ''
@@ -260,14 +247,9 @@ fn (p VlangParser) parse_interface(lines []string, idx int) CodeElement {
 	// Extract interface name - handle:
 	// pub interface Name
 	// pub interface Name [implements Interface1, Interface2]
-	mut re := regex.regex_opt(r'interface\s+(\w+)') or { panic(err) }
-	start, _ := re.match_string(line_for_regex)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 && groups[0].start >= 0 && groups[0].end > groups[0].start {
-			interface_name = line_for_regex[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'interface\s+(\w+)', line_for_regex)
+	if groups.len > 0 {
+		interface_name = groups[0]
 	}
 
 	// Check for implements clause separately
@@ -282,7 +264,7 @@ fn (p VlangParser) parse_interface(lines []string, idx int) CodeElement {
 		}
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
 
 	return CodeElement{
 		element_type: 'interface'
@@ -294,8 +276,8 @@ fn (p VlangParser) parse_interface(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p VlangParser) parse_function(lines []string, idx int) CodeElement {
-	line := p.strip_attributes(lines[idx].trim_space())
+fn (mut p VlangParser) parse_function(src SourceLines, idx int) CodeElement {
+	line := p.strip_attributes(src.trimmed[idx])
 
 	mut func_name := ''
 	mut access := 'private'
@@ -312,17 +294,12 @@ fn (p VlangParser) parse_function(lines []string, idx int) CodeElement {
 	// fn name()
 	// pub fn (receiver &Type) name()
 	// pub fn (mut receiver Type) name()
-	mut re := regex.regex_opt(r'fn\s+(?:\([^)]+\)\s+)?(\w+)\s*\(') or { panic(err) }
-	start, _ := re.match_string(line_for_regex)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 && groups[0].start >= 0 && groups[0].end > groups[0].start {
-			func_name = line_for_regex[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'fn\s+(?:\([^)]+\)\s+)?(\w+)\s*\(', line_for_regex)
+	if groups.len > 0 {
+		func_name = groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 2)
+	doc := extract_doc_lines(src, idx, 2)
 
 	// Check if it's a method (has receiver in parentheses)
 	// Pattern: fn (receiver Type) or fn (mut receiver Type)
@@ -339,25 +316,20 @@ fn (p VlangParser) parse_function(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p VlangParser) parse_match(lines []string, idx int) CodeElement {
-	line := p.strip_attributes(lines[idx].trim_space())
+fn (mut p VlangParser) parse_match(src SourceLines, idx int) CodeElement {
+	line := p.strip_attributes(src.trimmed[idx])
 
 	mut match_var := ''
 
 	// Extract match variable - handle:
 	// match variable
 	// match expr {
-	mut re := regex.regex_opt(r'match\s+(\w+)') or { panic(err) }
-	start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 && groups[0].start >= 0 && groups[0].end > groups[0].start {
-			match_var = line[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'match\s+(\w+)', line)
+	if groups.len > 0 {
+		match_var = groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 3)
+	doc := extract_doc_lines(src, idx, 3)
 
 	return CodeElement{
 		element_type: 'match_expression'
@@ -1,23 +1,29 @@
 module parsers
 
-import regex
+pub struct ZigParser {
+mut:
+	patterns PatternRegistry
+}
 
-pub struct ZigParser {}
+// Lines that can start a declaration, see LinePrefilter.
+const zig_prefilter = new_line_prefilter(['= struct', 'fn '], false)
 
 pub fn (p ZigParser) get_extensions() []string {
 	return ['.zig']
 }
 
-pub fn (p ZigParser) parse(content string, file_path string) ParseResult {
+pub fn (mut p ZigParser) parse(content string, file_path string) ParseResult {
 	mut result := ParseResult{
 		file_path: file_path
 		elements:  []CodeElement{}
 	}
 
-	lines := content.split_into_lines()
+	src := new_filtered_source_lines(content, zig_prefilter)
 
-	for i, line in lines {
-		trimmed := line.trim_space()
+	for i, trimmed in src.trimmed {
+		if !src.is_candidate(i) {
+			continue
+		}
 
 		// Skip empty lines
 		if trimmed.len == 0 {
@@ -27,19 +33,19 @@ pub fn (p ZigParser) parse(content string, file_path string) ParseResult {
 		// Parse struct definitions
 		if (trimmed.starts_with('const ') && trimmed.contains('= struct'))
 			|| (trimmed.starts_with('pub const ') && trimmed.contains('= struct')) {
-			result.elements << p.parse_struct(lines, i)
+			result.elements << p.parse_struct(src, i)
 		}
 		// Parse function definitions
 		else if trimmed.starts_with('fn ') || trimmed.starts_with('pub fn ') {
-			result.elements << p.parse_function(lines, i)
+			result.elements << p.parse_function(src, i)
 		}
 	}
 
 	return result
 }
 
-fn (p ZigParser) parse_struct(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p ZigParser) parse_struct(src SourceLines, idx int) CodeElement {
+	line := src.trimmed[idx]
 
 	mut struct_name := ''
 	mut access := ''
@@ -50,17 +56,12 @@ fn (p ZigParser) parse_struct(lines []string, idx int) CodeElement {
 	}
 
 	// Extract struct name
-	mut re := regex.regex_opt(r'(?:pub )?const\s+(\w+)\s*=\s*struct') or { panic(err) }
-	start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 && groups[0].start >= 0 {
-			struct_name = line[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'(?:pub )?const\s+(\w+)\s*=\s*struct', line)
+	if groups.len > 0 && groups[0].len > 0 {
+		struct_name = groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 5)
+	doc := extract_doc_lines(src, idx, 5)
 
 	return CodeElement{
 		element_type: 'struct'
@@ -71,8 +72,8 @@ fn (p ZigParser) parse_struct(lines []string, idx int) CodeElement {
 	}
 }
 
-fn (p ZigParser) parse_function(lines []string, idx int) CodeElement {
-	line := lines[idx].trim_space()
+fn (mut p ZigParser) parse_function(src SourceLines, idx int) CodeElement {
+	line := src.trimmed[idx]
 
 	mut func_name := ''
 	mut access := ''
@@ -83,17 +84,12 @@ fn (p ZigParser) parse_function(lines []string, idx int) CodeElement {
 	}
 
 	// Extract function name
-	mut re := regex.regex_opt(r'(?:pub )?fn\s+(\w+)\s*\(') or { panic(err) }
-	start, _ := re.match_string(line)
-
-	if start >= 0 {
-		groups := re.get_group_list()
-		if groups.len > 0 && groups[0].start >= 0 {
-			func_name = line[groups[0].start..groups[0].end]
-		}
+	groups := p.patterns.captures(r'(?:pub )?fn\s+(\w+)\s*\(', line)
+	if groups.len > 0 && groups[0].len > 0 {
+		func_name = groups[0]
 	}
 
-	doc := extract_doc_lines(lines, idx, 2)
+	doc := extract_doc_lines(src, idx, 2)
 
 	return CodeElement{
 		element_type: 'function'
@@ -5,7 +5,12 @@ pub mut:
 	verbose         bool
 	files_processed int
 	files_failed    int
+	files_skipped   int
 	total_files     int
+	cache_enabled   bool
+	cache_hits      int
+	cache_misses    int
+	stats           RunStats // per-stage instrumentation, see stats.v
 }
 
 pub fn (mut p ProgressTracker) init(verbose bool, total int) {
@@ -13,6 +18,7 @@ pub fn (mut p ProgressTracker) init(verbose bool, total int) {
 	p.total_files = total
 	p.files_processed = 0
 	p.files_failed = 0
+	p.files_skipped = 0
 }
 
 pub fn (mut p ProgressTracker) report_file(file_path string) {
@@ -27,11 +33,36 @@ pub fn (mut p ProgressTracker) report_error(file_path string, err string) {
 	eprintln('Error processing ${file_path}: ${err}')
 }
 
+// report_skip records a file that was deliberately not analyzed (too big,
+// binary, minified). Skips are only listed with --verbose.
+pub fn (mut p ProgressTracker) report_skip(file_path string, reason string) {
+	p.files_skipped++
+	if p.verbose {
+		eprintln('Skipping ${file_path}: ${reason}')
+	}
+}
+
+pub fn (mut p ProgressTracker) report_cache(hit bool) {
+	if hit {
+		p.cache_hits++
+	} else {
+		p.cache_misses++
+	}
+}
+
 pub fn (p ProgressTracker) print_summary() {
 	if p.verbose {
 		eprintln('\n--- Summary ---')
 		eprintln('Total files processed: ${p.files_processed}')
 		eprintln('Files with errors: ${p.files_failed}')
-		eprintln('Successfully analyzed: ${p.files_processed - p.files_failed}')
+		eprintln('Files skipped: ${p.files_skipped}')
+		eprintln('Successfully analyzed: ${p.files_processed - p.files_failed - p.files_skipped}')
+	}
+	// The hit rate is always reported when caching, so CI logs show it
+	// without the per-file noise of --verbose.
+	if p.cache_enabled {
+		lookups := p.cache_hits + p.cache_misses
+		rate := if lookups > 0 { f64(p.cache_hits) * 100.0 / f64(lookups) } else { 0.0 }
+		eprintln('Cache hits: ${p.cache_hits}/${lookups} (${rate:.1f}%)')
 	}
 }
@@ -0,0 +1,324 @@
+module main
+
+import os
+import parsers
+
+// Files up to this size are read into the reader's reusable buffer; bigger
+// ones get their own allocation so one huge file does not pin that much
+// memory in every worker for the rest of the run.
+const reuse_buffer_limit = 8 * 1024 * 1024
+
+// Bytes inspected before the rest of a file is read, to reject binaries
+// and minified or generated blobs cheaply.
+const sniff_size = 8 * 1024
+
+// SkippedFile is returned by FileReader.read for files that are left out on
+// purpose. Skips are reported separately and do not count as failures.
+struct SkippedFile {
+	Error
+	reason string
+}
+
+fn (e SkippedFile) msg() string {
+	return e.reason
+}
+
+// FileReader reads files into one buffer that is reused from file to file,
+// so reading a tree of sources does not allocate per file. Each analyzer
+// (and so each worker thread) owns its reader.
+struct FileReader {
+mut:
+	buf []u8
+}
+
+// read returns the content of `path`, or a SkippedFile error for files over
+// `max_size` bytes (0 means no limit) and for binary or minified content,
+// which is detected from the first sniff_size bytes before the remainder is
+// read. For files that fit the reuse limit the returned string is a view
+// into the reader's buffer and is only valid until the next call to read.
+fn (mut r FileReader) read(path string, max_size u64) !string {
+	size := os.file_size(path)
+	if max_size > 0 && size > max_size {
+		return SkippedFile{
+			reason: 'larger than ${max_size} bytes'
+		}
+	}
+	if size == 0 {
+		return ''
+	}
+
+	mut f := os.open(path)!
+	defer {
+		f.close()
+	}
+
+	wanted := int(size)
+	mut data := unsafe { &u8(nil) }
+	if wanted > reuse_buffer_limit {
+		own := []u8{len: wanted}
+		data = &u8(own.data)
+	} else {
+		if r.buf.len < wanted {
+			r.buf = []u8{len: wanted + wanted / 4}
+		}
+		data = &u8(r.buf.data)
+	}
+
+	head := read_up_to(mut f, data, 0, if wanted < sniff_size { wanted } else { sniff_size })
+	if reason := sniff_skip_reason(data, head) {
+		return SkippedFile{
+			reason: reason
+		}
+	}
+	total := read_up_to(mut f, data, head, wanted)
+	return unsafe { tos(data, total) }
+}
+
+// read_head returns up to the first `n` bytes of `path`.
+fn read_head(path string, n int) !string {
+	mut f := os.open(path)!
+	defer {
+		f.close()
+	}
+	mut buf := []u8{len: n}
+	got := read_up_to(mut f, &u8(buf.data), 0, n)
+	return buf[..got].bytestr()
+}
+
+// read_up_to fills data[from..to] from `f` and returns the offset reached,
+// which is short of `to` only if the file ended early or a read failed.
+fn read_up_to(mut f os.File, data &u8, from int, to int) int {
+	mut pos := from
+	for pos < to {
+		n := f.read_into_ptr(unsafe { data + pos }, to - pos) or { break }
+		if n <= 0 {
+			break
+		}
+		pos += n
+	}
+	return pos
+}
+
+// sniff_skip_reason classifies the first `len` bytes of a file: a NUL byte
+// means binary content, and a full sniff window without a line break means
+// a minified or generated blob that no line-based parser can use.
+fn sniff_skip_reason(data &u8, len int) ?string {
+	mut has_newline := false
+	for i in 0 .. len {
+		c := unsafe { data[i] }
+		if c == 0 {
+			return 'binary content'
+		}
+		if c == `\n` || c == `\r` {
+			has_newline = true
+		}
+	}
+	if len >= sniff_size && !has_newline {
+		return 'no line breaks in the first ${sniff_size} bytes (minified or generated)'
+	}
+	return none
+}
+
+// Files larger than this are parsed in chunks of this size (--chunk-size).
+const default_chunk_size = 8 * 1024 * 1024
+
+// Chunks end between top-level declarations when next_chunk finds such a
+// place (see parsers.split_point). Otherwise they end at a line break, and
+// this many lines of the chunk are handed to the parser again with the
+// next one, so doc comments and attributes are still visible across the
+// boundary. The lookbehind is also capped in bytes, to keep memory per
+// file bounded even with very long lines.
+const chunk_lookbehind_lines = 64
+const chunk_lookbehind_bytes = 64 * 1024
+
+// ChunkCursor is an open file being read in chunks by next_chunk.
+struct ChunkCursor {
+	chunk_size int
+mut:
+	file       os.File
+	done       bool
+	carry_len  int // bytes kept at the start of the buffer: lookbehind + partial line
+	lookbehind int // complete lines at the start of the carry that were already parsed
+	behind_len int // bytes of those lines
+	lines_done int // lines of the file fully handed out so far
+}
+
+// SourceChunk is one window of a file, ending at a line break. Element
+// line numbers parsed from `text` are offset by `first_line`, and
+// elements on the first `lookbehind` lines belong to the previous chunk.
+struct SourceChunk {
+	text       string
+	first_line int
+	lookbehind int
+	lines      int // lines of the file covered for the first time
+}
+
+// open_chunks opens `path` for next_chunk, applying the checks of read:
+// the size limit and the binary / minified sniff test.
+fn (mut r FileReader) open_chunks(path string, max_size u64, chunk_size int) !ChunkCursor {
+	size := os.file_size(path)
+	if max_size > 0 && size > max_size {
+		return SkippedFile{
+			reason: 'larger than ${max_size} bytes'
+		}
+	}
+	// A full chunk plus the carry: at most the lookbehind and a line that
+	// did not fit in the previous chunk
+	wanted := 2 * chunk_size + chunk_lookbehind_bytes
+	if r.buf.len < wanted {
+		r.buf = []u8{len: wanted}
+	}
+	mut f := os.open(path)!
+	data := &u8(r.buf.data)
+	head := read_up_to(mut f, data, 0, if chunk_size < sniff_size { chunk_size } else { sniff_size })
+	if reason := sniff_skip_reason(data, head) {
+		f.close()
+		return SkippedFile{
+			reason: reason
+		}
+	}
+	return ChunkCursor{
+		chunk_size: chunk_size
+		file:       f
+		carry_len:  head
+	}
+}
+
+// next_chunk returns the next window of the file, or none at its end. The
+// text is a view into the reader's buffer, valid until the next call.
+fn (mut r FileReader) next_chunk(mut c ChunkCursor) ?SourceChunk {
+	if c.done {
+		return none
+	}
+	data := &u8(r.buf.data)
+	limit := c.carry_len + c.chunk_size
+	end := read_up_to(mut c.file, data, c.carry_len, limit)
+	if end < limit {
+		c.done = true
+	}
+	// Prefer a cut between top-level declarations, where the next chunk
+	// needs no lookbehind; the second half of the chunk is searched
+	mut cut := end
+	mut clean := false
+	if !c.done {
+		text := unsafe { tos(data, end) }
+		point := parsers.split_point(text, 0, c.behind_len + (end - c.behind_len) / 2, end)
+		clean = point > c.behind_len
+		cut = if clean { point } else { last_line_end(data, c.behind_len, end) }
+	}
+	mut total := count_line_breaks(data, 0, cut)
+	if c.done && cut > 0 && !is_line_break(data, cut - 1) {
+		total++
+	}
+	if total <= c.lookbehind {
+		return none
+	}
+
+	chunk := SourceChunk{
+		text:       unsafe { tos(data, cut) }
+		first_line: c.lines_done - c.lookbehind
+		lookbehind: c.lookbehind
+		lines:      total - c.lookbehind
+	}
+	c.lines_done += chunk.lines
+	if c.done {
+		return chunk
+	}
+
+	// Keep the last lines as the next lookbehind, unless the cut is clean,
+	// and the text after the cut at the start of the buffer
+	start := if clean { cut } else { lookbehind_start(data, cut) }
+	c.lookbehind = count_line_breaks(data, start, cut)
+	c.behind_len = cut - start
+	c.carry_len = end - start
+	unsafe { vmemmove(data, data + start, c.carry_len) }
+	return chunk
+}
+
+fn (mut c ChunkCursor) close() {
+	c.file.close()
+}
+
+@[inline]
+fn is_line_break(data &u8, i int) bool {
+	c := unsafe { data[i] }
+	return c == `\n` || c == `\r`
+}
+
+// count_line_breaks counts the line breaks in data[from..to], taking `\r\n`
+// as one, like SourceLines.
+fn count_line_breaks(data &u8, from int, to int) int {
+	mut n := 0
+	for i in from .. to {
+		c := unsafe { data[i] }
+		if c == `\n` || (c == `\r` && (i + 1 >= to || unsafe { data[i + 1] } != `\n`)) {
+			n++
+		}
+	}
+	return n
+}
+
+// last_line_end returns the offset just past the last line break in
+// data[from..end], or `end` if there is none (a line longer than the chunk
+// is split). A `\r` only counts when the next byte is known not to be `\n`.
+fn last_line_end(data &u8, from int, end int) int {
+	for i := end - 1; i >= from; i-- {
+		c := unsafe { data[i] }
+		if c == `\n` || (c == `\r` && i + 1 < end && unsafe { data[i + 1] } != `\n`) {
+			return i + 1
+		}
+	}
+	return end
+}
+
+// lookbehind_start returns the start of the lines kept as lookbehind before
+// `cut`: at most chunk_lookbehind_lines lines and chunk_lookbehind_bytes
+// bytes, beginning at a line start.
+fn lookbehind_start(data &u8, cut int) int {
+	floor := if cut > chunk_lookbehind_bytes { cut - chunk_lookbehind_bytes } else { 0 }
+	mut lines := 0
+	mut i := cut - 1
+	for i > floor {
+		if is_line_break(data, i - 1) && !(unsafe { data[i - 1] } == `\r` && unsafe { data[i] } == `\n`) {
+			lines++
+			if lines == chunk_lookbehind_lines {
+				return i
+			}
+		}
+		i--
+	}
+	if floor == 0 {
+		return 0
+	}
+	// Round the byte cap up to the next line start
+	for i < cut && !is_line_break(data, i - 1) {
+		i++
+	}
+	return i
+}
+
+// owned returns `s` itself, or a copy of it when it points into the reuse
+// buffer and would be overwritten by the next read.
+fn (r &FileReader) owned(s string) string {
+	if s.len == 0 || r.buf.len == 0 {
+		return s
+	}
+	start := usize(r.buf.data)
+	ptr := usize(s.str)
+	if ptr >= start && ptr < start + usize(r.buf.len) {
+		return s.clone()
+	}
+	return s
+}
+
+// detach makes every string in `result` independent of the reuse buffer.
+// Parsers normally return copies already; this guards results that outlive
+// the read (the reorder window, the cache, the collector) against any
+// element that kept a view of the content.
+fn (r &FileReader) detach(mut result parsers.ParseResult) {
+	for mut element in result.elements {
+		element.name = r.owned(element.name)
+		element.parent = r.owned(element.parent)
+		element.doc = r.owned(element.doc)
+	}
+}
@@ -0,0 +1,181 @@
+module main
+
+import sync
+import sync.stdatomic
+
+// WorkQueue is one worker's share of the files to analyze. The owner takes
+// from the front, where each batch puts its largest files; other workers
+// steal from the back, so a thief takes small files and leaves the big
+// ones already running.
+@[heap]
+struct WorkQueue {
+mut:
+	mu   &sync.Mutex = sync.new_mutex()
+	jobs []FileJob
+	head int // jobs before this index were taken by the owner
+}
+
+fn (mut w WorkQueue) push(job FileJob) {
+	w.mu.@lock()
+	w.jobs << job
+	w.mu.unlock()
+}
+
+fn (mut w WorkQueue) pop_front() ?FileJob {
+	w.mu.@lock()
+	defer {
+		w.mu.unlock()
+	}
+	if w.head == w.jobs.len {
+		return none
+	}
+	job := w.jobs[w.head]
+	w.head++
+	if w.head == w.jobs.len {
+		w.jobs.clear()
+		w.head = 0
+	}
+	return job
+}
+
+fn (mut w WorkQueue) pop_back() ?FileJob {
+	w.mu.@lock()
+	defer {
+		w.mu.unlock()
+	}
+	if w.head == w.jobs.len {
+		return none
+	}
+	return w.jobs.pop()
+}
+
+fn (mut w WorkQueue) drop() {
+	w.mu.@lock()
+	w.jobs.clear()
+	w.head = 0
+	w.mu.unlock()
+}
+
+// WorkQueues schedules the files of analyze_parallel over its workers:
+// one queue per worker, seeded largest first, with idle workers stealing
+// from the others. `ready` is posted once per queued job, and once per
+// worker when the queues are closed.
+@[heap]
+struct WorkQueues {
+mut:
+	queues []&WorkQueue
+	ready  &sync.Semaphore = sync.new_semaphore()
+	closed u64 // no more jobs are coming
+	seeded u64 // jobs queued so far, for progress
+	next   int // queue that gets the next job; touched by the seeding thread only
+}
+
+fn new_work_queues(workers int) &WorkQueues {
+	mut q := &WorkQueues{}
+	for _ in 0 .. workers {
+		q.queues << &WorkQueue{}
+	}
+	return q
+}
+
+fn (q &WorkQueues) is_closed() bool {
+	return stdatomic.load_u64(&q.closed) != 0
+}
+
+fn (q &WorkQueues) seeded_count() int {
+	return int(stdatomic.load_u64(&q.seeded))
+}
+
+// seed deals a batch of files to the queues, largest first and round
+// robin, so the biggest files start early and on different workers.
+fn (mut q WorkQueues) seed(mut batch []FileJob) {
+	if q.is_closed() {
+		return
+	}
+	batch.sort(a.size > b.size)
+	for job in batch {
+		q.queues[q.next].push(job)
+		q.next = (q.next + 1) % q.queues.len
+		stdatomic.add_u64(&q.seeded, 1)
+		q.ready.post()
+	}
+}
+
+// take returns the next file for worker `id` and whether it was stolen.
+// It returns none once the queues are closed and empty.
+fn (mut q WorkQueues) take(id int) ?(FileJob, bool) {
+	q.ready.wait()
+	for {
+		if job := q.queues[id].pop_front() {
+			return job, false
+		}
+		for k in 1 .. q.queues.len {
+			if job := q.queues[(id + k) % q.queues.len].pop_back() {
+				return job, true
+			}
+		}
+		if q.is_closed() {
+			return none
+		}
+		// Another worker took the job this wake-up was posted for, while
+		// the one it was woken for is not visible yet; look again
+	}
+	return none
+}
+
+// close tells the workers no more jobs are coming; with `drop`, the jobs
+// still queued are discarded too.
+fn (mut q WorkQueues) close(drop bool) {
+	if drop {
+		for mut queue in q.queues {
+			queue.drop()
+		}
+	}
+	stdatomic.store_u64(&q.closed, 1)
+	for _ in q.queues {
+		q.ready.post()
+	}
+}
+
+// seed_queues feeds the files arriving on `found` to the queues until the
+// walk ends. Everything the walk has found so far is seeded as one batch,
+// and it only waits when there is nothing, so batches grow as the walk
+// runs ahead of analysis. With `slots`, each file also needs a slot, which
+// the collecting thread frees once the file is emitted; files already
+// batched are seeded before waiting for one, so the file holding up the
+// output is never the one kept back.
+fn seed_queues(found chan FoundFile, mut q WorkQueues, slots &sync.Semaphore) {
+	mut index := 0
+	mut walking := true
+	for walking {
+		mut batch := []FileJob{}
+		for {
+			mut file := FoundFile{}
+			if batch.len == 0 {
+				file = <-found or {
+					walking = false
+					break
+				}
+			} else if found.try_pop(mut file) != .success {
+				break
+			}
+			if q.is_closed() {
+				// Analysis stopped: keep draining so the walk can finish
+				continue
+			}
+			if !isnil(slots) && !slots.try_wait() {
+				q.seed(mut batch)
+				batch.clear()
+				slots.wait()
+			}
+			batch << FileJob{
+				index: index
+				path:  file.path
+				size:  file.size
+			}
+			index++
+		}
+		q.seed(mut batch)
+	}
+	q.close(false)
+}
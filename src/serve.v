@@ -0,0 +1,453 @@
+module main
+
+import os
+import io
+import flag
+import json
+import net
+import net.unix
+import runtime
+import time
+
+// Protocol of `code-analyzer serve`: clients send one JSON object per
+// line and get one JSON object per line back, in order.
+//
+//   {"op":"analyze","path":"src"}      re-analyze what changed below a path
+//                                      (the whole tree without a path)
+//   {"op":"file","path":"src/a.py"}    the elements of one file
+//   {"op":"symbol","name":"Parser"}    elements with this name; add
+//                                      "prefix":true for a name prefix and
+//                                      "kind":"class" to filter by kind
+//   {"op":"stats"}                     files and elements held
+//
+// Replies are {"ok":true,...} with "elements" (a list of objects shaped
+// like --format jsonl records) or "files", or {"ok":false,"error":".."}.
+// Relative paths are resolved against the served root.
+
+struct ServeOptions {
+mut:
+	input     string
+	listen    string
+	lang      string
+	config    string
+	jobs      int
+	max_size  int
+	cache_dir string
+	verbose   bool
+}
+
+// ServerQuery is one decoded request line.
+struct ServerQuery {
+	op     string
+	path   string
+	name   string
+	prefix bool
+	kind   string
+}
+
+// ServerRequest carries a request line from a connection thread to the
+// model thread, which answers on `reply`; like DirRequest, `reply` is
+// buffered for exactly one answer.
+struct ServerRequest {
+	line  string
+	reply chan string
+}
+
+// SymbolRef locates one element: its file in the collector's results and
+// its position among that file's elements.
+struct SymbolRef {
+	file    int
+	element int
+}
+
+// ServerModel is the resident state of the server. It is only touched by
+// the model thread, so requests are answered one at a time without
+// locking.
+struct ServerModel {
+	root    string
+	verbose bool
+mut:
+	analyzer  Analyzer
+	collector ResultCollector
+	stamps    map[string]FileStamp    // every file analyzed, to skip unchanged ones
+	scopes    map[string]&IgnoreScope // ignore files by directory, see ignore.v
+	symbols   map[string][]SymbolRef  // elements by name, rebuilt when stale
+	names     []string                // keys of `symbols`, sorted, for prefix lookups
+	stale     bool = true
+}
+
+// run_serve implements `code-analyzer serve`: the tree is analyzed once,
+// then queries are answered from memory until the process is stopped.
+fn run_serve(argv []string) {
+	opts := parse_serve_arguments(argv)
+	if !os.is_dir(opts.input) {
+		eprintln('Error: Input path must be a directory: ${opts.input}')
+		exit(1)
+	}
+
+	mut analyzer := configure_analyzer(opts.config, opts.lang, opts.verbose)
+	if opts.max_size > 0 {
+		analyzer.max_file_size = u64(opts.max_size) * 1024
+	}
+	analyzer.jobs = if opts.jobs > 0 { opts.jobs } else { 1 }
+	analyzer.chunk_jobs = analyzer.jobs
+	analyzer.buffered = true
+	mut progress := ProgressTracker{}
+	progress.init(opts.verbose, 0)
+	if opts.cache_dir.len > 0 {
+		analyzer.cache = load_result_cache(opts.cache_dir, analyzer.rules_fingerprint())
+		progress.cache_enabled = true
+	}
+
+	mut model := &ServerModel{
+		root:     os.real_path(opts.input)
+		verbose:  opts.verbose
+		analyzer: analyzer
+	}
+	sw := time.new_stopwatch()
+	// The analysis stats every file anyway, so it records their stamps
+	// instead of a second walk
+	model.analyzer.record_stamps = true
+	model.analyzer.analyze_directory(model.root, mut progress, mut model.collector) or {
+		eprintln('Error: ${err}')
+		exit(1)
+	}
+	model.stamps = model.analyzer.stamps.move()
+	model.analyzer.record_stamps = false
+	if !isnil(model.analyzer.cache) {
+		model.analyzer.cache.save() or { eprintln('Warning: failed to save cache: ${err}') }
+	}
+	progress.print_summary()
+	// Files analyzed from here on are read one at a time by the model thread
+	model.analyzer.jobs = 1
+
+	requests := chan ServerRequest{cap: 64}
+	if opts.listen.contains(':') {
+		mut listener := net.listen_tcp(.ip, opts.listen) or {
+			eprintln('Error: cannot listen on ${opts.listen}: ${err}')
+			exit(1)
+		}
+		spawn accept_tcp(mut listener, requests)
+	} else {
+		remove_stale_socket(opts.listen) or {
+			eprintln('Error: ${err}')
+			exit(1)
+		}
+		mut listener := unix.listen_stream(opts.listen) or {
+			eprintln('Error: cannot listen on ${opts.listen}: ${err}')
+			exit(1)
+		}
+		spawn accept_unix(mut listener, requests)
+	}
+	eprintln('Serving ${model.collector.file_count()} files from ${model.root} on ${opts.listen} (loaded in ${ms(sw.elapsed().nanoseconds()):.1f} ms)')
+	model.run(requests)
+}
+
+fn parse_serve_arguments(argv []string) ServeOptions {
+	mut fp := flag.new_flag_parser(argv)
+	fp.application('code-analyzer serve')
+	fp.description('Keep a tree analyzed in memory and answer JSON queries about it')
+	fp.skip_executable()
+
+	mut opts := ServeOptions{}
+	opts.input = fp.string('input', `i`, '', 'Root directory path')
+	opts.listen = fp.string('listen', 0, './code-analyzer.sock', 'Unix socket path, or host:port for TCP')
+	opts.lang = fp.string('lang', `l`, '', 'Programming language filter (optional)')
+	opts.config = fp.string('config', `c`, '', 'Custom config file path')
+	opts.jobs = fp.int('jobs', `j`, runtime.nr_cpus(), 'Worker threads for the initial analysis')
+	opts.max_size = fp.int('max-size', 0, 0, 'Skip files larger than this many KiB (0 = no limit)')
+	opts.cache_dir = fp.string('cache-dir', 0, '', 'Directory for the incremental result cache')
+	opts.verbose = fp.bool('verbose', `v`, false, 'Show progress and every request')
+
+	fp.finalize() or {
+		eprintln('Error parsing arguments: ${err}')
+		println(fp.usage())
+		exit(1)
+	}
+	if opts.input.len == 0 {
+		eprintln('Error: --input is required')
+		println(fp.usage())
+		exit(1)
+	}
+	return opts
+}
+
+// remove_stale_socket removes a socket left by an earlier server at
+// `path`, refusing to remove anything else.
+fn remove_stale_socket(path string) ! {
+	if !os.exists(path) {
+		return
+	}
+	stat := os.stat(path)!
+	if stat.get_filetype() != .socket {
+		return error('${path} exists and is not a socket')
+	}
+	os.rm(path)!
+}
+
+fn accept_tcp(mut listener net.TcpListener, requests chan ServerRequest) {
+	for {
+		mut conn := listener.accept() or {
+			eprintln('Warning: accepting a connection failed: ${err}')
+			continue
+		}
+		// Clients may keep a connection open between queries
+		conn.set_read_timeout(net.infinite_timeout)
+		spawn serve_connection(mut conn, requests)
+	}
+}
+
+fn accept_unix(mut listener unix.StreamListener, requests chan ServerRequest) {
+	for {
+		mut conn := listener.accept() or {
+			eprintln('Warning: accepting a connection failed: ${err}')
+			continue
+		}
+		conn.set_read_timeout(net.infinite_timeout)
+		spawn serve_connection(mut conn, requests)
+	}
+}
+
+// ServerConn is what serve_connection needs from a TCP or Unix socket
+// connection.
+interface ServerConn {
+mut:
+	read(mut buf []u8) !int
+	write(buf []u8) !int
+	close() !
+}
+
+// serve_connection reads request lines from `conn` until the client
+// disconnects, passing each to the model thread and writing back its
+// reply.
+fn serve_connection(mut conn ServerConn, requests chan ServerRequest) {
+	mut reader := io.new_buffered_reader(reader: conn)
+	for {
+		line := reader.read_line() or { break }
+		if line.trim_space().len == 0 {
+			continue
+		}
+		reply := chan string{cap: 1}
+		requests <- ServerRequest{
+			line:  line
+			reply: reply
+		}
+		answer := <-reply
+		conn.write(answer.bytes()) or { break }
+	}
+	conn.close() or {}
+}
+
+// run answers requests until the program is stopped.
+fn (mut m ServerModel) run(requests chan ServerRequest) {
+	for {
+		request := <-requests or { break }
+		sw := time.new_stopwatch()
+		answer := m.answer(request.line)
+		request.reply <- answer
+		if m.verbose {
+			eprintln('${request.line} answered in ${ms(sw.elapsed().nanoseconds()):.2f} ms')
+		}
+	}
+}
+
+// answer decodes one request line and returns the reply line.
+fn (mut m ServerModel) answer(line string) string {
+	query := json.decode(ServerQuery, line) or { return server_error('invalid request: ${err}') }
+	mut b := OutputBuffer{}
+	match query.op {
+		'analyze' {
+			path := m.resolve(query.path) or { return server_error(err.msg()) }
+			count := m.refresh(path)
+			b.write_string('{"ok":true,"files":')
+			b.write_int(count)
+			b.write_u8(`}`)
+		}
+		'file' {
+			path := m.resolve(query.path) or { return server_error(err.msg()) }
+			i := m.collector.slot(path) or { -1 }
+			mut refs := []SymbolRef{}
+			if i >= 0 {
+				for k in 0 .. m.collector.results[i].elements.len {
+					refs << SymbolRef{
+						file:    i
+						element: k
+					}
+				}
+			}
+			m.write_elements(mut b, refs, '')
+		}
+		'symbol' {
+			if query.name.len == 0 {
+				return server_error('symbol needs a name')
+			}
+			m.write_elements(mut b, m.lookup(query.name, query.prefix), query.kind)
+		}
+		'stats' {
+			mut elements := 0
+			for result in m.collector.results {
+				elements += result.elements.len
+			}
+			b.write_string('{"ok":true,"files":')
+			b.write_int(m.collector.file_count())
+			b.write_string(',"elements":')
+			b.write_int(elements)
+			b.write_u8(`}`)
+		}
+		else {
+			return server_error('unknown op: ${query.op}')
+		}
+	}
+	b.write_u8(`\n`)
+	return b.data.bytestr()
+}
+
+fn server_error(msg string) string {
+	mut b := OutputBuffer{}
+	b.write_string('{"ok":false,"error":')
+	write_json_string(mut b, msg)
+	b.write_string('}\n')
+	return b.data.bytestr()
+}
+
+// resolve turns a request path into a path below the root, as the walk
+// spells it. An empty path is the root itself.
+fn (m &ServerModel) resolve(path string) !string {
+	if path.len == 0 {
+		return m.root
+	}
+	full := if os.is_abs_path(path) { path } else { os.join_path(m.root, path) }
+	clean := os.norm_path(full)
+	if clean != m.root && !clean.starts_with(m.root + os.path_separator) {
+		return error('${path} is outside the served tree')
+	}
+	return clean
+}
+
+// refresh re-analyzes the files at or below `path` whose stamp changed,
+// and drops the ones that are gone. Returns the number of files analyzed
+// or dropped.
+fn (mut m ServerModel) refresh(path string) int {
+	mut candidates := map[string]bool{}
+	if os.is_dir(path) {
+		for file in m.files_below(path) {
+			candidates[file] = true
+		}
+		prefix := path + os.path_separator
+		for file, _ in m.stamps {
+			if path == m.root || file.starts_with(prefix) {
+				candidates[file] = true
+			}
+		}
+	} else {
+		candidates[path] = true
+	}
+
+	mut changes := ChangeSet{}
+	for file, _ in candidates {
+		stat := os.stat(file) or {
+			m.stamps.delete(file)
+			changes.files[file] = true
+			continue
+		}
+		stamp := FileStamp{
+			mtime: stat.mtime
+			size:  stat.size
+		}
+		if previous := m.stamps[file] {
+			if previous == stamp {
+				continue
+			}
+		}
+		m.stamps[file] = stamp
+		changes.files[file] = true
+	}
+	if changes.files.len == 0 {
+		return 0
+	}
+	m.stale = true
+	return apply_changes(mut m.analyzer, mut m.collector, m.root, changes)
+}
+
+// files_below lists the files the walk would analyze below `dir`.
+fn (mut m ServerModel) files_below(dir string) []string {
+	if dir == m.root {
+		return m.analyzer.collect_files(dir)
+	}
+	if m.analyzer.path_excluded(m.root, dir, true, mut m.scopes) {
+		return []string{}
+	}
+	entries := read_dir_entries(dir)
+	mut files := []string{}
+	m.analyzer.walk_directory(dir, path_relative_to(m.root, dir), m.analyzer.scope_for_dir(m.root,
+		dir, mut m.scopes), entries, mut files)
+	return files
+}
+
+// lookup returns the elements named `name`, or whose name starts with it
+// when `prefix` is set.
+fn (mut m ServerModel) lookup(name string, prefix bool) []SymbolRef {
+	if m.stale {
+		m.index_symbols()
+	}
+	if !prefix {
+		return m.symbols[name] or { []SymbolRef{} }
+	}
+	// Lower bound: the first name not less than `name`
+	mut lo := 0
+	mut hi := m.names.len
+	for lo < hi {
+		mid := lo + (hi - lo) / 2
+		if m.names[mid] < name {
+			lo = mid + 1
+		} else {
+			hi = mid
+		}
+	}
+	mut refs := []SymbolRef{}
+	for i in lo .. m.names.len {
+		if !m.names[i].starts_with(name) {
+			break
+		}
+		refs << m.symbols[m.names[i]]
+	}
+	return refs
+}
+
+// index_symbols rebuilds the name tables after results changed.
+fn (mut m ServerModel) index_symbols() {
+	m.symbols = map[string][]SymbolRef{}
+	for i, result in m.collector.results {
+		for k, e in result.elements {
+			m.symbols[result.name(e).clone()] << SymbolRef{
+				file:    i
+				element: k
+			}
+		}
+	}
+	m.names = m.symbols.keys()
+	m.names.sort()
+	m.stale = false
+}
+
+// write_elements writes an "elements" reply with the referenced elements,
+// keeping only those of kind `kind` when it is not empty.
+fn (m &ServerModel) write_elements(mut b OutputBuffer, refs []SymbolRef, kind string) {
+	b.write_string('{"ok":true,"elements":[')
+	mut first := true
+	for ref in refs {
+		result := m.collector.results[ref.file]
+		e := result.elements[ref.element]
+		element_kind := m.collector.kinds.names[e.kind]
+		if kind.len > 0 && element_kind != kind {
+			continue
+		}
+		if !first {
+			b.write_u8(`,`)
+		}
+		first = false
+		write_json_element(mut b, result.file_path, e.line_number, m.collector.access.names[e.access],
+			element_kind, result.name(e), result.parent(e), result.doc(e))
+	}
+	b.write_string(']}')
+}
@@ -0,0 +1,307 @@
+module main
+
+import os
+import flag
+import json
+import hash.fnv1a
+import parsers
+
+// Sharded runs (--shard i/N) analyze the files whose path, relative to the
+// input directory, hashes to shard i, so N machines walking the same tree
+// split it without coordinating. Their binary outputs carry the
+// binary_flag_sharded header flag and a section after the strings:
+//
+//   magic     shard_section_magic
+//   u32       shard index (0-based), u32 shard count
+//   u32       walk position of every file, in file order
+//
+// `code-analyzer merge` interleaves the files of all N outputs by walk
+// position, which gives the output of a single run over the whole tree.
+const shard_section_magic = 'CASHARD1'
+const shard_section_header_size = 16
+
+// parse_shard parses a --shard value `i/N` (1 <= i <= N) into a 0-based
+// index and the count.
+fn parse_shard(spec string) !(int, int) {
+	parts := spec.split('/')
+	if parts.len == 2 {
+		i := parts[0].int()
+		n := parts[1].int()
+		if n >= 1 && i >= 1 && i <= n && '${i}/${n}' == spec {
+			return i - 1, n
+		}
+	}
+	return error('invalid --shard ${spec} (expected i/N with 1 <= i <= N)')
+}
+
+// in_shard reports whether `path` belongs to this run's shard.
+fn (a &Analyzer) in_shard(path string) bool {
+	if a.shard_count <= 1 {
+		return true
+	}
+	rel := path_relative_to(a.shard_root, path)
+	return fnv1a.sum64_string(rel) % u64(a.shard_count) == u64(a.shard_index)
+}
+
+// add_shard_section appends the shard section to the binary output file at
+// `path`; `positions` holds the walk position of each of its files.
+fn add_shard_section(path string, index int, count int, positions []u32) ! {
+	x := load_binary_index(path)!
+	if u64(positions.len) != u64(x.header.file_count) {
+		return error('${path}: ${positions.len} walk positions for ${x.header.file_count} files')
+	}
+	mut data := []u8{cap: shard_section_header_size + 4 * positions.len}
+	data << shard_section_magic.bytes()
+	put_u32(mut data, u32(index))
+	put_u32(mut data, u32(count))
+	for position in positions {
+		put_u32(mut data, position)
+	}
+
+	flags := x.header.flags | binary_flag_sharded
+	flag_bytes := [u8(flags), u8(flags >> 8), u8(flags >> 16), u8(flags >> 24)]
+	if x.compressed {
+		// A compressed file cannot be patched in place
+		mut bytes := x.data.clone()
+		bytes << data
+		for i, b in flag_bytes {
+			bytes[binary_header_flags_offset + i] = b
+		}
+		return write_compressed_file(path, bytes)
+	}
+	mut f := os.open_file(path, 'r+')!
+	defer {
+		f.close()
+	}
+	f.write_to(u64(x.data.len), data)!
+	f.write_to(binary_header_flags_offset, flag_bytes)!
+}
+
+// ShardOutput is a loaded shard output file.
+struct ShardOutput {
+	BinaryIndex
+	path             string
+	index            int
+	count            int
+	positions_offset u64
+}
+
+fn load_shard_output(path string) !ShardOutput {
+	x := load_binary_index(path)!
+	pos := x.header.strings_offset + x.header.strings_size
+	if x.header.flags & binary_flag_sharded == 0 || pos + shard_section_header_size > u64(x.data.len)
+		|| x.data[int(pos)..int(pos) + 8].bytestr() != shard_section_magic {
+		return error('${path} is not the output of a --shard run')
+	}
+	positions_offset := pos + shard_section_header_size
+	if positions_offset + u64(x.header.file_count) * 4 != u64(x.data.len) {
+		return error('${path}: corrupt shard section')
+	}
+	index := get_u32(x.data, pos + 8)
+	count := get_u32(x.data, pos + 12)
+	if count < 1 || index >= count || count > u32(max_int) {
+		return error('${path}: corrupt shard section (shard ${u64(index) + 1}/${count})')
+	}
+	return ShardOutput{
+		BinaryIndex:      x
+		path:             path
+		index:            int(index)
+		count:            int(count)
+		positions_offset: positions_offset
+	}
+}
+
+fn (s &ShardOutput) position(file u32) u32 {
+	return get_u32(s.data, s.positions_offset + u64(file) * 4)
+}
+
+// result decodes the elements of `file` into a ParseResult; its strings are
+// views into the loaded file.
+fn (s &ShardOutput) result(file u32) parsers.ParseResult {
+	entry := s.header.files_offset + u64(file) * binary_file_entry_size
+	first := get_u32(s.data, entry + 4)
+	count := get_u32(s.data, entry + 8)
+	mut result := parsers.ParseResult{
+		file_path: s.file_path(file)
+		elements:  []parsers.CodeElement{cap: int(count)}
+	}
+	for id in first .. first + count {
+		e := s.element(id)
+		result.elements << parsers.CodeElement{
+			element_type: s.kind_name(e.kind)
+			name:         s.string_at(e.name)
+			access:       s.access_name(e.access)
+			parent:       s.string_at(e.parent)
+			doc:          s.string_at(e.doc)
+			line_number:  int(e.line)
+		}
+	}
+	return result
+}
+
+// ShardFileRef is one file of one shard output, ordered by walk position.
+struct ShardFileRef {
+	position u32
+	shard    int
+	file     u32
+}
+
+// merge_shard_outputs writes the files of all shard outputs at `paths` to
+// `output` in walk order, returning the number of files. Every shard of
+// the run must be given exactly once.
+fn merge_shard_outputs(paths []string, output string, show_line bool, format ResultFormat, compress bool) !int {
+	mut shards := []ShardOutput{}
+	for path in paths {
+		shards << load_shard_output(path)!
+	}
+	count := shards[0].count
+	mut given := []string{len: count}
+	for s in shards {
+		if s.count != count {
+			return error('${s.path} is shard ${s.index + 1}/${s.count}, but ${shards[0].path} is one of ${count}')
+		}
+		if given[s.index].len > 0 {
+			return error('${s.path} and ${given[s.index]} are both shard ${s.index + 1}/${count}')
+		}
+		given[s.index] = s.path
+	}
+	mut missing := []string{}
+	for i, path in given {
+		if path.len == 0 {
+			missing << '${i + 1}/${count}'
+		}
+	}
+	if missing.len > 0 {
+		return error('missing shard(s) ${missing.join(', ')}')
+	}
+
+	mut files := []ShardFileRef{}
+	for i, s in shards {
+		for file in 0 .. s.header.file_count {
+			files << ShardFileRef{
+				position: s.position(file)
+				shard:    i
+				file:     file
+			}
+		}
+	}
+	files.sort(a.position < b.position)
+	for k in 1 .. files.len {
+		if files[k].position == files[k - 1].position {
+			return error('${shards[files[k].shard].path} and ${shards[files[k - 1].shard].path} come from different walks (both have a file at walk position ${files[k].position})')
+		}
+	}
+
+	mut writer := new_output_writer(output, show_line, format, compress)!
+	for ref in files {
+		writer.emit(shards[ref.shard].result(ref.file)) or {
+			writer.abort()
+			return err
+		}
+	}
+	writer.close()!
+	return files.len
+}
+
+// merge_caches combines the cache directories at `dirs` into the cache in
+// `output`; for a path cached by several, the first directory wins. All
+// must have been written by this version with the same custom languages.
+fn merge_caches(dirs []string, output string, compress bool) !int {
+	mut merged := CacheFile{
+		version: cache_format_version
+	}
+	mut seen := map[string]bool{}
+	for i, dir in dirs {
+		cache_path := os.join_path(dir, cache_file_name)
+		content := read_decompressed(cache_path) or {
+			return error('cannot read ${cache_path}: ${err}')
+		}
+		stored := json.decode(CacheFile, content.bytestr()) or {
+			return error('${cache_path} is not a valid cache: ${err}')
+		}
+		if stored.version != cache_format_version {
+			return error('${cache_path} was written by another version (format ${stored.version})')
+		}
+		if i == 0 {
+			merged.rules = stored.rules
+		} else if stored.rules != merged.rules {
+			return error('${cache_path} was written with different custom languages than ${dirs[0]}')
+		}
+		for entry in stored.entries {
+			if entry.path in seen {
+				continue
+			}
+			seen[entry.path] = true
+			merged.entries << entry
+		}
+	}
+	cache := ResultCache{
+		dir:      output
+		rules:    merged.rules
+		updated:  merged.entries
+		compress: compress
+	}
+	cache.save()!
+	return merged.entries.len
+}
+
+struct MergeOptions {
+mut:
+	output    string
+	format    string
+	show_line bool
+	cache_dir string
+	compress  bool
+	inputs    []string
+}
+
+// run_merge implements `code-analyzer merge`: shard outputs become one
+// output, or shard caches (with --cache-dir) one cache.
+fn run_merge(argv []string) {
+	opts := parse_merge_arguments(argv)
+	if opts.cache_dir.len > 0 {
+		count := merge_caches(opts.inputs, opts.cache_dir, opts.compress) or {
+			eprintln('Error: ${err}')
+			exit(1)
+		}
+		println('Merged ${count} cache entries from ${opts.inputs.len} caches into ${opts.cache_dir}')
+		return
+	}
+	format := parse_result_format(opts.format) or {
+		eprintln('Error: ${err}')
+		exit(1)
+	}
+	count := merge_shard_outputs(opts.inputs, opts.output, opts.show_line, format, opts.compress) or {
+		eprintln('Error: ${err}')
+		exit(1)
+	}
+	println('Merged ${count} files from ${opts.inputs.len} shards into ${opts.output}')
+}
+
+fn parse_merge_arguments(argv []string) MergeOptions {
+	mut fp := flag.new_flag_parser(argv)
+	fp.application('code-analyzer merge')
+	fp.description('Combine the outputs or caches of --shard runs')
+	fp.usage_example('[--output <file>] [--format <fmt>] [--line] [--compress] <shard output>...')
+	fp.usage_example('--cache-dir <dir> [--compress] <shard cache dir>...')
+	fp.skip_executable()
+
+	mut opts := MergeOptions{}
+	opts.output = fp.string('output', `o`, './merged.bin', 'Merged output file path')
+	opts.format = fp.string('format', `f`, 'binary', 'Merged output format: text, jsonl or binary')
+	opts.show_line = fp.bool('line', `n`, false, 'Show line numbers in a text output')
+	opts.cache_dir = fp.string('cache-dir', 0, '', 'Merge shard cache directories into this one instead')
+	opts.compress = fp.bool('compress', 0, false, 'Write the merged output or cache compressed (gzip)')
+
+	opts.inputs = fp.finalize() or {
+		eprintln('Error parsing arguments: ${err}')
+		println(fp.usage())
+		exit(1)
+	}
+	if opts.inputs.len == 0 {
+		eprintln('Error: no shard outputs given')
+		println(fp.usage())
+		exit(1)
+	}
+	return opts
+}
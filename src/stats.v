@@ -0,0 +1,291 @@
+module main
+
+import os
+import json
+import time
+
+// Number of slowest files kept for the --stats report.
+const stats_slowest_files = 10
+
+// LanguageStats aggregates the files of one extension.
+pub struct LanguageStats {
+pub mut:
+	language string
+	files    int
+	bytes    u64
+	lines    int
+	elements int
+	parse_ns i64
+}
+
+// SlowFile is one entry of the slowest-files list.
+pub struct SlowFile {
+pub mut:
+	path     string
+	bytes    u64
+	read_ns  i64
+	parse_ns i64
+}
+
+// WorkerStats is what one analysis worker of a parallel run did.
+pub struct WorkerStats {
+pub mut:
+	files   int
+	bytes   u64
+	busy_ns i64 // time spent analyzing files rather than waiting for them
+	stolen  int // files taken from another worker's queue
+}
+
+// RunStats is the per-stage instrumentation behind --stats. Everything is
+// updated on the collecting thread from finished FileOutcomes, so no
+// locking is needed. Read and parse times are summed over all workers and
+// can exceed the wall time of a parallel run.
+pub struct RunStats {
+pub mut:
+	wall_ns          i64
+	walk_ns          i64
+	walk_concurrent  bool // the walk overlapped analysis (--jobs > 1)
+	read_ns          i64
+	parse_ns         i64
+	output_ns        i64
+	bytes_read       u64
+	lines_scanned    int
+	elements_emitted int
+	duplicates       int // files whose elements were reused from an identical content, see dedup.v
+	languages        map[string]LanguageStats
+	slowest          []SlowFile
+	analysis_ns      i64 // wall time of the parallel analysis, against which workers are measured
+	workers          []WorkerStats
+}
+
+// record_file adds the measurements of one analyzed file.
+pub fn (mut s RunStats) record_file(outcome FileOutcome) {
+	s.read_ns += outcome.read_ns
+	s.parse_ns += outcome.parse_ns
+	s.bytes_read += outcome.bytes
+	s.lines_scanned += outcome.lines
+	if outcome.duplicate {
+		s.duplicates++
+	}
+
+	ext := if outcome.language.len > 0 { outcome.language } else { os.file_ext(outcome.path) }
+	mut lang := s.languages[ext] or {
+		LanguageStats{
+			language: ext
+		}
+	}
+	lang.files++
+	lang.bytes += outcome.bytes
+	lang.lines += outcome.lines
+	lang.elements += outcome.result.elements.len
+	lang.parse_ns += outcome.parse_ns
+	s.languages[ext] = lang
+
+	s.note_slow(SlowFile{
+		path:     outcome.path
+		bytes:    outcome.bytes
+		read_ns:  outcome.read_ns
+		parse_ns: outcome.parse_ns
+	})
+}
+
+// note_slow keeps `slowest` sorted by total time, longest first, and no
+// longer than stats_slowest_files.
+fn (mut s RunStats) note_slow(file SlowFile) {
+	total := file.read_ns + file.parse_ns
+	if s.slowest.len == stats_slowest_files {
+		last := s.slowest[s.slowest.len - 1]
+		if total <= last.read_ns + last.parse_ns {
+			return
+		}
+		s.slowest.delete_last()
+	}
+	mut pos := s.slowest.len
+	for pos > 0 && s.slowest[pos - 1].read_ns + s.slowest[pos - 1].parse_ns < total {
+		pos--
+	}
+	s.slowest.insert(pos, file)
+}
+
+// record_workers keeps the per-worker totals of a parallel run that took
+// `analysis_ns` from the first file scheduled to the last one analyzed.
+pub fn (mut s RunStats) record_workers(workers []WorkerStats, analysis_ns i64) {
+	s.workers = workers
+	s.analysis_ns = analysis_ns
+}
+
+// utilization returns the share of the analysis time `w` spent busy, in
+// percent.
+fn (s RunStats) utilization(w WorkerStats) f64 {
+	if s.analysis_ns <= 0 {
+		return 0.0
+	}
+	return f64(w.busy_ns) * 100.0 / f64(s.analysis_ns)
+}
+
+pub fn (mut s RunStats) add_output(elapsed time.Duration) {
+	s.output_ns += elapsed.nanoseconds()
+}
+
+// sorted_languages returns the per-language totals, slowest parser first.
+fn (s RunStats) sorted_languages() []LanguageStats {
+	mut langs := s.languages.values()
+	langs.sort(a.parse_ns > b.parse_ns)
+	return langs
+}
+
+fn ms(ns i64) f64 {
+	return f64(ns) / 1_000_000.0
+}
+
+fn mb_per_s(bytes u64, ns i64) f64 {
+	if ns <= 0 {
+		return 0.0
+	}
+	return f64(bytes) / (1024.0 * 1024.0) / (f64(ns) / 1_000_000_000.0)
+}
+
+// print_report writes the human-readable --stats report to stderr.
+pub fn (s RunStats) print_report(progress ProgressTracker) {
+	walk_note := if s.walk_concurrent { ' (concurrent with analysis)' } else { '' }
+	eprintln('\n--- Stats ---')
+	eprintln('Wall time:        ${ms(s.wall_ns):10.1f} ms')
+	eprintln('Walk:             ${ms(s.walk_ns):10.1f} ms${walk_note}')
+	read_rate := mb_per_s(s.bytes_read, s.read_ns)
+	eprintln('Read:             ${ms(s.read_ns):10.1f} ms (${read_rate:.1f} MB/s)')
+	eprintln('Parse:            ${ms(s.parse_ns):10.1f} ms')
+	eprintln('Output:           ${ms(s.output_ns):10.1f} ms')
+	eprintln('Files:            ${progress.files_processed} processed, ${progress.cache_hits} cached, ${progress.files_skipped} skipped, ${progress.files_failed} failed')
+	eprintln('Bytes read:       ${s.bytes_read}')
+	eprintln('Lines scanned:    ${s.lines_scanned}')
+	eprintln('Elements emitted: ${s.elements_emitted}')
+	if s.duplicates > 0 {
+		eprintln('Duplicates:       ${s.duplicates} files not parsed, same content as an earlier file')
+	}
+
+	if s.languages.len > 0 {
+		eprintln('\nPer language:')
+		eprintln('  ext         files        bytes      lines   elements   parse ms     MB/s')
+		for lang in s.sorted_languages() {
+			rate := mb_per_s(lang.bytes, lang.parse_ns)
+			eprintln('  ${lang.language:-8} ${lang.files:8} ${lang.bytes:12} ${lang.lines:10} ${lang.elements:10} ${ms(lang.parse_ns):10.1f} ${rate:8.1f}')
+		}
+	}
+
+	if s.slowest.len > 0 {
+		eprintln('\nSlowest files (read + parse):')
+		for file in s.slowest {
+			eprintln('  ${ms(file.read_ns + file.parse_ns):10.2f} ms  ${file.path} (${file.bytes} bytes)')
+		}
+	}
+
+	if s.workers.len > 0 {
+		eprintln('\nWorkers (busy share of ${ms(s.analysis_ns):.1f} ms of analysis):')
+		eprintln('  worker    files        bytes    busy ms   stolen   busy %')
+		for i, w in s.workers {
+			eprintln('  ${i:6} ${w.files:8} ${w.bytes:12} ${ms(w.busy_ns):10.1f} ${w.stolen:8} ${s.utilization(w):8.1f}')
+		}
+	}
+}
+
+// StatsReport is the --stats-json document; times are in milliseconds.
+struct StatsReport {
+	wall_ms          f64
+	walk_ms          f64
+	walk_concurrent  bool
+	read_ms          f64
+	parse_ms         f64
+	output_ms        f64
+	files_processed  int
+	files_cached     int
+	files_skipped    int
+	files_failed     int
+	files_duplicate  int
+	bytes_read       u64
+	lines_scanned    int
+	elements_emitted int
+	languages        []LanguageReport
+	slowest          []SlowFileReport
+	analysis_ms      f64
+	workers          []WorkerReport
+}
+
+struct LanguageReport {
+	language string
+	files    int
+	bytes    u64
+	lines    int
+	elements int
+	parse_ms f64
+}
+
+struct SlowFileReport {
+	path     string
+	bytes    u64
+	read_ms  f64
+	parse_ms f64
+}
+
+struct WorkerReport {
+	files       int
+	bytes       u64
+	busy_ms     f64
+	stolen      int
+	utilization f64 // percent of analysis_ms
+}
+
+// write_json writes the --stats-json report to `path`.
+pub fn (s RunStats) write_json(path string, progress ProgressTracker) ! {
+	mut languages := []LanguageReport{}
+	for lang in s.sorted_languages() {
+		languages << LanguageReport{
+			language: lang.language
+			files:    lang.files
+			bytes:    lang.bytes
+			lines:    lang.lines
+			elements: lang.elements
+			parse_ms: ms(lang.parse_ns)
+		}
+	}
+	mut slowest := []SlowFileReport{}
+	for file in s.slowest {
+		slowest << SlowFileReport{
+			path:     file.path
+			bytes:    file.bytes
+			read_ms:  ms(file.read_ns)
+			parse_ms: ms(file.parse_ns)
+		}
+	}
+	mut workers := []WorkerReport{}
+	for w in s.workers {
+		workers << WorkerReport{
+			files:       w.files
+			bytes:       w.bytes
+			busy_ms:     ms(w.busy_ns)
+			stolen:      w.stolen
+			utilization: s.utilization(w)
+		}
+	}
+
+	report := StatsReport{
+		wall_ms:          ms(s.wall_ns)
+		walk_ms:          ms(s.walk_ns)
+		walk_concurrent:  s.walk_concurrent
+		read_ms:          ms(s.read_ns)
+		parse_ms:         ms(s.parse_ns)
+		output_ms:        ms(s.output_ns)
+		files_processed:  progress.files_processed
+		files_cached:     progress.cache_hits
+		files_skipped:    progress.files_skipped
+		files_failed:     progress.files_failed
+		files_duplicate:  s.duplicates
+		bytes_read:       s.bytes_read
+		lines_scanned:    s.lines_scanned
+		elements_emitted: s.elements_emitted
+		languages:        languages
+		slowest:          slowest
+		analysis_ms:      ms(s.analysis_ns)
+		workers:          workers
+	}
+	os.write_file(path, json.encode_pretty(report))!
+}
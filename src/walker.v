@@ -0,0 +1,202 @@
+module main
+
+import os
+import time
+
+$if !windows {
+	#include "@VMODROOT/src/c/fastwalk.h"
+}
+
+fn C.ca_open_dir(path &char) voidptr
+fn C.ca_next_entry(dir voidptr, name &&char) int
+fn C.ca_close_dir(dir voidptr)
+
+// Entry kinds reported by read_dir_entries (see src/c/fastwalk.h)
+const entry_unknown = 0
+const entry_file = 1
+const entry_dir = 2
+const entry_other = 3
+
+struct DirEntry {
+	name string
+	kind int
+}
+
+// FoundFile is a file the walk selected for analysis, with its size so
+// analyze_parallel can start the biggest files first.
+struct FoundFile {
+	path string
+	size u64
+}
+
+// DirRequest asks a reader thread to list `path` and send the entries to
+// `reply`, which is buffered for exactly one listing.
+struct DirRequest {
+	path  string
+	reply chan []DirEntry
+}
+
+// read_dir_entries lists a directory together with the entry type readdir
+// reports, so most entries never need a stat call. Entries are sorted by
+// name: the walk order, and so the output, is then the same on every file
+// system, which lets the shards of one tree be merged into exactly what a
+// single run writes.
+fn read_dir_entries(dir_path string) []DirEntry {
+	mut entries := []DirEntry{}
+	$if windows {
+		names := os.ls(dir_path) or { return entries }
+		for name in names {
+			entries << DirEntry{
+				name: name
+				kind: entry_unknown
+			}
+		}
+	} $else {
+		dir := C.ca_open_dir(&char(dir_path.str))
+		if isnil(dir) {
+			return entries
+		}
+		for {
+			mut name := &char(unsafe { nil })
+			kind := C.ca_next_entry(dir, &name)
+			if kind < 0 {
+				break
+			}
+			entry_name := unsafe { cstring_to_vstring(name) }
+			if entry_name == '.' || entry_name == '..' {
+				continue
+			}
+			entries << DirEntry{
+				name: entry_name
+				kind: kind
+			}
+		}
+		C.ca_close_dir(dir)
+	}
+	entries.sort(a.name < b.name)
+	return entries
+}
+
+// resolve_kind falls back to stat for entries whose type readdir did not
+// report (unknown d_type or symlinks).
+fn resolve_kind(full_path string, kind int) int {
+	if kind != entry_unknown {
+		return kind
+	}
+	if os.is_dir(full_path) {
+		return entry_dir
+	}
+	if os.is_file(full_path) {
+		return entry_file
+	}
+	return entry_other
+}
+
+// walk_directory appends the files to analyze below `dir_path` (at `rel`
+// below the root, listed in `entries`) to `files`. Excluded directories
+// are pruned without being read.
+fn (a Analyzer) walk_directory(dir_path string, rel string, scope &IgnoreScope, entries []DirEntry, mut files []string) {
+	for entry in entries {
+		// Skip hidden files and directories
+		if entry.name.starts_with('.') {
+			continue
+		}
+
+		full_path := os.join_path(dir_path, entry.name)
+		kind := resolve_kind(full_path, entry.kind)
+		entry_rel := child_rel(rel, entry.name)
+		if kind == entry_dir {
+			if a.excluded(scope, entry_rel, entry.name, true) {
+				continue
+			}
+			// Recursively walk subdirectories
+			sub_entries := read_dir_entries(full_path)
+			a.walk_directory(full_path, entry_rel, a.enter_dir(scope, full_path, entry_rel,
+				sub_entries), sub_entries, mut files)
+		} else if kind == entry_file && a.wants_file(full_path)
+			&& !a.excluded(scope, entry_rel, entry.name, false) {
+			files << full_path
+		}
+	}
+}
+
+// walk_tree walks `root_path` and sends every file to analyze to `found`,
+// closing it when done. Directory listings are read ahead by `readers`
+// threads, while this thread visits them depth-first, so paths arrive in
+// exactly the order the serial walk_directory produces. Returns the time
+// the walk took in nanoseconds.
+fn walk_tree(a &Analyzer, root_path string, found chan FoundFile, readers int) i64 {
+	sw := time.new_stopwatch()
+	requests := chan DirRequest{cap: 1024}
+	mut reader_threads := []thread{}
+	for _ in 0 .. readers {
+		reader_threads << spawn dir_reader(requests)
+	}
+
+	entries := read_dir_entries(root_path)
+	a.walk_listing(root_path, '', a.enter_dir(unsafe { nil }, root_path, '', entries), entries,
+		requests, found)
+
+	requests.close()
+	reader_threads.wait()
+	found.close()
+	return sw.elapsed().nanoseconds()
+}
+
+fn dir_reader(requests chan DirRequest) {
+	for {
+		request := <-requests or { break }
+		request.reply <- read_dir_entries(request.path)
+	}
+}
+
+fn (a &Analyzer) walk_listing(dir_path string, rel string, scope &IgnoreScope, entries []DirEntry, requests chan DirRequest, found chan FoundFile) {
+	mut paths := []string{cap: entries.len}
+	mut rels := []string{cap: entries.len}
+	mut kinds := []int{cap: entries.len}
+	mut replies := []chan []DirEntry{}
+
+	// Queue every subdirectory for reading before descending into the
+	// first one, so the readers work ahead of this thread. Excluded
+	// directories are never queued.
+	for entry in entries {
+		// Skip hidden files and directories
+		if entry.name.starts_with('.') {
+			continue
+		}
+		full_path := os.join_path(dir_path, entry.name)
+		kind := resolve_kind(full_path, entry.kind)
+		entry_rel := child_rel(rel, entry.name)
+		if kind == entry_dir {
+			if a.excluded(scope, entry_rel, entry.name, true) {
+				continue
+			}
+			reply := chan []DirEntry{cap: 1}
+			requests <- DirRequest{
+				path:  full_path
+				reply: reply
+			}
+			replies << reply
+		}
+		paths << full_path
+		rels << entry_rel
+		kinds << kind
+	}
+
+	mut next_reply := 0
+	for i, full_path in paths {
+		if kinds[i] == entry_dir {
+			reply := replies[next_reply]
+			next_reply++
+			sub_entries := <-reply
+			a.walk_listing(full_path, rels[i], a.enter_dir(scope, full_path, rels[i], sub_entries),
+				sub_entries, requests, found)
+		} else if kinds[i] == entry_file && a.wants_file(full_path)
+			&& !a.excluded(scope, rels[i], os.base(full_path), false) {
+			found <- FoundFile{
+				path: full_path
+				size: os.file_size(full_path)
+			}
+		}
+	}
+}
@@ -0,0 +1,296 @@
+module main
+
+import os
+import time
+
+#include "@VMODROOT/src/c/watch.h"
+
+fn C.ca_watch_init() int
+fn C.ca_watch_add(fd int, path &char) int
+fn C.ca_watch_close(fd int)
+fn C.ca_watch_read(fd int, buf &char, len int, timeout_ms int) int
+fn C.ca_watch_next(buf &char, len int, offset &int, wd &int, name &&char) int
+
+// Event kinds reported by ca_watch_next (see src/c/watch.h)
+const watch_end = 0
+const watch_changed = 2
+const watch_removed = 3
+const watch_dir_added = 4
+const watch_dir_removed = 5
+const watch_overflow = 6
+const watch_gone = 7
+
+// Changes arriving within this many milliseconds of each other are
+// applied together, so saving many files re-writes the output once.
+const watch_debounce_ms = 50
+
+// Interval between rescans when change notifications are unavailable.
+const watch_poll_ms = 500
+
+const watch_buffer_size = 64 * 1024
+
+// WatchOutput is where --watch keeps the output up to date.
+struct WatchOutput {
+	path      string
+	show_line bool
+	format    ResultFormat
+	compress  bool
+	verbose   bool
+}
+
+struct FileStamp {
+	mtime i64
+	size  u64
+}
+
+// ChangeSet is one batch of changes to apply.
+struct ChangeSet {
+mut:
+	files  map[string]bool // files to re-analyze, or to drop if they are gone
+	dirs   []string        // directories that were removed or moved away
+	rescan bool            // notifications were lost; compare the whole tree
+}
+
+// Watcher reports changes under `root`: through inotify on Linux, by
+// polling file stamps elsewhere.
+struct Watcher {
+	root string
+mut:
+	fd     int = -1
+	buf    []u8
+	dirs   map[int]string          // inotify watch descriptor -> directory
+	stamps map[string]FileStamp    // last seen state of every file, when polling
+	scopes map[string]&IgnoreScope // ignore files by directory, see ignore.v
+	warned bool
+}
+
+// watch_tree keeps `c` and the output file in sync with the tree after the
+// initial run: only the files that changed are analyzed again, and the
+// output is rewritten from the results in memory. It does not return.
+fn watch_tree(mut a Analyzer, root string, mut c ResultCollector, out WatchOutput) {
+	mut w := Watcher{
+		root: root
+		fd:   C.ca_watch_init()
+	}
+	if w.fd >= 0 {
+		w.buf = []u8{len: watch_buffer_size}
+		w.watch_dir(a, root, '', unsafe { nil })
+	} else {
+		eprintln('File change notifications are unavailable; polling every ${watch_poll_ms} ms')
+		w.stamps = stamp_files(a, root)
+	}
+	eprintln('Watching ${root} for changes (Ctrl-C to stop)')
+
+	for {
+		changes := if w.fd >= 0 { w.wait_events(a) } else { w.poll(a) }
+		if changes.files.len == 0 && changes.dirs.len == 0 && !changes.rescan {
+			continue
+		}
+
+		sw := time.new_stopwatch()
+		count := apply_changes(mut a, mut c, root, changes)
+		tmp_path := out.path + '.tmp'
+		write_output(c, tmp_path, out.show_line, out.format, out.compress) or {
+			eprintln('Error writing output: ${err}')
+			continue
+		}
+		os.mv(tmp_path, out.path) or {
+			eprintln('Error writing output: ${err}')
+			continue
+		}
+		if out.verbose {
+			eprintln('Updated ${count} file(s) in ${ms(sw.elapsed().nanoseconds()):.1f} ms')
+		}
+	}
+}
+
+// apply_changes re-analyzes the changed files and drops the removed ones,
+// returning the number of files looked at.
+fn apply_changes(mut a Analyzer, mut c ResultCollector, root string, changes ChangeSet) int {
+	mut paths := changes.files.clone()
+	if changes.rescan {
+		// Everything on disk, plus everything held, so deleted files go too
+		for path in a.collect_files(root) {
+			paths[path] = true
+		}
+		for result in c.results {
+			paths[result.file_path] = true
+		}
+	}
+	for dir in changes.dirs {
+		prefix := dir + os.path_separator
+		for result in c.results {
+			if result.file_path.starts_with(prefix) {
+				paths[result.file_path] = true
+			}
+		}
+	}
+
+	mut scopes := map[string]&IgnoreScope{}
+	for path, _ in paths {
+		if !os.is_file(path) || !a.wants_file(path) || os.base(path).starts_with('.')
+			|| a.path_excluded(root, path, false, mut scopes) {
+			c.remove(path)
+			continue
+		}
+		result := a.analyze_file(path) or {
+			if err !is SkippedFile {
+				eprintln('Error analyzing ${path}: ${err}')
+			}
+			c.remove(path)
+			continue
+		}
+		c.replace(result)
+	}
+	return paths.len
+}
+
+// watch_dir adds a watch for `dir` (at `rel` below the root) and every
+// subdirectory the walk would visit.
+fn (mut w Watcher) watch_dir(a &Analyzer, dir string, rel string, parent &IgnoreScope) {
+	wd := C.ca_watch_add(w.fd, &char(dir.str))
+	if wd < 0 {
+		if !w.warned {
+			eprintln('Warning: cannot watch ${dir}; changes below it are missed (is fs.inotify.max_user_watches too low?)')
+			w.warned = true
+		}
+		return
+	}
+	w.dirs[wd] = dir
+	entries := read_dir_entries(dir)
+	scope := a.enter_dir(parent, dir, rel, entries)
+	for entry in entries {
+		// Skip hidden directories, like the walk
+		if entry.name.starts_with('.') {
+			continue
+		}
+		full_path := os.join_path(dir, entry.name)
+		entry_rel := child_rel(rel, entry.name)
+		if resolve_kind(full_path, entry.kind) == entry_dir
+			&& !a.excluded(scope, entry_rel, entry.name, true) {
+			w.watch_dir(a, full_path, entry_rel, scope)
+		}
+	}
+}
+
+// wait_events blocks until notifications arrive, then keeps reading until
+// none have arrived for watch_debounce_ms.
+fn (mut w Watcher) wait_events(a &Analyzer) ChangeSet {
+	mut changes := ChangeSet{}
+	mut timeout := -1
+	for {
+		n := C.ca_watch_read(w.fd, w.buf.data, w.buf.len, timeout)
+		if n < 0 {
+			eprintln('Warning: reading change notifications failed; polling every ${watch_poll_ms} ms')
+			C.ca_watch_close(w.fd)
+			w.fd = -1
+			w.stamps = stamp_files(a, w.root)
+			changes.rescan = true
+			return changes
+		}
+		if n == 0 {
+			if timeout < 0 {
+				continue
+			}
+			return changes
+		}
+		w.decode(a, n, mut changes)
+		timeout = watch_debounce_ms
+	}
+	return changes
+}
+
+// decode adds the first `n` bytes of notifications in `buf` to `changes`.
+fn (mut w Watcher) decode(a &Analyzer, n int, mut changes ChangeSet) {
+	mut offset := 0
+	for {
+		mut wd := 0
+		mut name := &char(unsafe { nil })
+		kind := C.ca_watch_next(w.buf.data, n, &offset, &wd, &name)
+		if kind == watch_end {
+			break
+		}
+		if kind == watch_overflow {
+			changes.rescan = true
+			continue
+		}
+		dir := w.dirs[wd] or { continue }
+		if kind == watch_gone {
+			w.dirs.delete(wd)
+			continue
+		}
+		entry := unsafe { cstring_to_vstring(name) }
+		// Hidden entries are skipped, like in the walk
+		if entry.len == 0 || entry.starts_with('.') {
+			continue
+		}
+
+		path := os.join_path(dir, entry)
+		match kind {
+			watch_changed, watch_removed {
+				changes.files[path] = true
+			}
+			watch_dir_added {
+				if a.path_excluded(w.root, path, true, mut w.scopes) {
+					continue
+				}
+				rel := path_relative_to(w.root, path)
+				parent := a.scope_for_dir(w.root, dir, mut w.scopes)
+				w.watch_dir(a, path, rel, parent)
+				// Files may have been created before the watch was in place
+				entries := read_dir_entries(path)
+				mut files := []string{}
+				a.walk_directory(path, rel, a.enter_dir(parent, path, rel, entries), entries, mut
+					files)
+				for file in files {
+					changes.files[file] = true
+				}
+			}
+			watch_dir_removed {
+				prefix := path + os.path_separator
+				for id, watched in w.dirs.clone() {
+					if watched == path || watched.starts_with(prefix) {
+						w.dirs.delete(id)
+					}
+				}
+				changes.dirs << path
+			}
+			else {}
+		}
+	}
+}
+
+// poll waits watch_poll_ms, then compares the file stamps of the whole tree
+// with the previous scan.
+fn (mut w Watcher) poll(a &Analyzer) ChangeSet {
+	time.sleep(watch_poll_ms * time.millisecond)
+	current := stamp_files(a, w.root)
+	mut changes := ChangeSet{}
+	for path, stamp in current {
+		if previous := w.stamps[path] {
+			if previous == stamp {
+				continue
+			}
+		}
+		changes.files[path] = true
+	}
+	for path, _ in w.stamps {
+		if path !in current {
+			changes.files[path] = true
+		}
+	}
+	w.stamps = current.clone()
+	return changes
+}
+
+fn stamp_files(a &Analyzer, root string) map[string]FileStamp {
+	mut stamps := map[string]FileStamp{}
+	for path in a.collect_files(root) {
+		stat := os.stat(path) or { continue }
+		stamps[path] = FileStamp{
+			mtime: stat.mtime
+			size:  stat.size
+		}
+	}
+	return stamps
+}
@@ -0,0 +1,105 @@
+// Ring Buffer Library
+// Demonstrates C structs, typedefs, static helpers and public functions
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Fixed-capacity byte ring buffer
+struct ring_buffer {
+    unsigned char *data;
+    size_t capacity;
+    size_t head;
+    size_t tail;
+    size_t count;
+};
+
+/// Read cursor over a ring buffer
+typedef struct {
+    const struct ring_buffer *buffer;
+    size_t offset;
+} ring_cursor;
+
+/// Wrap an index into the buffer's capacity
+static size_t ring_wrap(const struct ring_buffer *rb, size_t index) {
+    return index % rb->capacity;
+}
+
+/// Allocate a ring buffer with the given capacity
+struct ring_buffer *ring_create(size_t capacity) {
+    struct ring_buffer *rb = malloc(sizeof(struct ring_buffer));
+    if (rb == NULL) {
+        return NULL;
+    }
+    rb->data = malloc(capacity);
+    if (rb->data == NULL) {
+        free(rb);
+        return NULL;
+    }
+    rb->capacity = capacity;
+    rb->head = 0;
+    rb->tail = 0;
+    rb->count = 0;
+    return rb;
+}
+
+/// Release a ring buffer and its storage
+void ring_destroy(struct ring_buffer *rb) {
+    if (rb != NULL) {
+        free(rb->data);
+        free(rb);
+    }
+}
+
+/// Append bytes, returning how many fit
+size_t ring_write(struct ring_buffer *rb, const unsigned char *src, size_t len) {
+    size_t written = 0;
+    while (written < len && rb->count < rb->capacity) {
+        rb->data[rb->tail] = src[written];
+        rb->tail = ring_wrap(rb, rb->tail + 1);
+        rb->count++;
+        written++;
+    }
+    return written;
+}
+
+/// Remove up to len bytes into dst
+size_t ring_read(struct ring_buffer *rb, unsigned char *dst, size_t len) {
+    size_t read = 0;
+    while (read < len && rb->count > 0) {
+        dst[read] = rb->data[rb->head];
+        rb->head = ring_wrap(rb, rb->head + 1);
+        rb->count--;
+        read++;
+    }
+    return read;
+}
+
+/// Start a cursor at the oldest byte
+ring_cursor ring_cursor_begin(const struct ring_buffer *rb) {
+    ring_cursor cursor;
+    cursor.buffer = rb;
+    cursor.offset = 0;
+    return cursor;
+}
+
+/// Advance a cursor, returning -1 at the end
+int ring_cursor_next(ring_cursor *cursor) {
+    const struct ring_buffer *rb = cursor->buffer;
+    if (cursor->offset >= rb->count) {
+        return -1;
+    }
+    size_t index = ring_wrap(rb, rb->head + cursor->offset);
+    cursor->offset++;
+    return rb->data[index];
+}
+
+/// Print the buffer contents for debugging
+void ring_dump(const struct ring_buffer *rb) {
+    ring_cursor cursor = ring_cursor_begin(rb);
+    int c;
+    while ((c = ring_cursor_next(&cursor)) >= 0) {
+        printf("%02x ", c);
+    }
+    printf("\n");
+}